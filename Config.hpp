@@ -75,6 +75,77 @@
 
 // Servo port to control motors via ESC
 #define SERVO_PORT "/dev/servoblaster"
+// Output protocol : 0 for ServoBlaster lines, 1 for Maestro Set Target commands, 2 for DShot packets to a serial bridge
+#define SERVO_PROTOCOL 0
+// DShot bit rate : 150, 300 or 600 kbit/s
+#define SERVO_DSHOT_SPEED 300
+// Only send the channels that changed, with a full frame every SERVO_KEEPALIVE frames
+#define SERVO_DELTA_OUTPUT true
+#define SERVO_KEEPALIVE 50
+
+// Output verification (Maestro protocol only) : Get Position / Get Errors every SERVO_READBACK_DIVIDER ticks
+#define SERVO_READBACK false
+#define SERVO_READBACK_DIVIDER 5
+#define SERVO_READBACK_TOLERANCE 1 // us
+#define SERVO_READBACK_TIMEOUT 20 // ticks
+
+// ESC telemetry (KISS / BLHeli_32 frames), read by Motor_Pipeline
+#define ESC_TELEMETRY_PORT "/dev/ttyS1"
+#define ESC_TELEMETRY_SHARED true // one line for the 4 ESCs, answering DShot telemetry requests in turn
+#define ESC_MOTOR_POLES 14
+#define ESC_TELEMETRY_MAX_AGE 20000 // us, older telemetry is stale : open loop
+
+// Closed-loop speed : PI correction of the commanded speeds from the ESC telemetry
+#define RPM_KP 0.2
+#define RPM_KI 5. // 1/s
+#define RPM_MAX_CORRECTION 0. // rd/s, 0 : open loop
+
+// Command sources : a source stays live this long after its last command (us)
+#define COMMAND_LEASE_AUTOPILOT 50000
+#define COMMAND_LEASE_GROUND_TEST 500000
+#define COMMAND_LEASE_MANUAL 100000
+#define COMMAND_LEASE_FAILSAFE 1000000
+#define COMMAND_MAX_AGE 20000 // us, maestro_motord drops older commands from the shared segment (e.g. after its restart)
+
+// State estimator (navi_Estimator) : measurement noise on top of the navi_State quantisation, process noise
+#define ESTIMATOR_POSITION_NOISE 0.02 // m
+#define ESTIMATOR_VELOCITY_NOISE 0.05 // m/s
+#define ESTIMATOR_ANGLE_NOISE 0.01 // rad
+#define ESTIMATOR_ACCELERATION_NOISE 5. // m/s^2
+#define ESTIMATOR_ANGULAR_ACCELERATION_NOISE 30. // rad/s^2
+
+// Telemetry downlink (Motor_Downlink) : one slot a tick, stream dividers in slots (rates at 1 kHz)
+#define DOWNLINK_BAUD_RATE 115200
+#define DOWNLINK_STATE_DIVIDER 10 // 100 Hz
+#define DOWNLINK_MOTORS_DIVIDER 20 // 50 Hz
+#define DOWNLINK_EVENTS_DIVIDER 1
+#define DOWNLINK_BATTERY_DIVIDER 1000 // 1 Hz
+
+// Overload governor (Motor_Governor) : periods in us the tick steps through when overloaded
+#define GOVERNOR true
+// Only the rungs longer than the nominal period are used : from 20 ms up (e.g. main.cpp's 100 ms test period) it never steps
+#define GOVERNOR_LADDER {500, 1000, 2000, 5000, 10000, 20000} // 2 kHz, 1 kHz, 500 Hz, 200 Hz, 100 Hz, 50 Hz
+#define GOVERNOR_WINDOW 100000 // us, load evaluated over it
+#define GOVERNOR_HIGH_LOAD 0.7 // mean tick time / period : longer period above
+#define GOVERNOR_LATE_RATIO 0.05 // share of ticks started a quarter of a period late : longer period above
+#define GOVERNOR_LOW_LOAD 0.35 // load at the shorter period : back to it below, GOVERNOR_HOLD windows in a row
+#define GOVERNOR_HOLD 10
+
+// Monitoring : metrics page refreshed every METRICS_PUBLISH_DIVIDER ticks
+#define METRICS_PUBLISH_DIVIDER 10
+
+// Per-motor flight statistics (Motor_Stats) : PWM mean/variance/percentiles, saturation duty cycle
+#define MOTOR_STATS true
+
+// Profiling : hardware counters of the motor thread around the tick stages (see Motor_Perf)
+#define MOTOR_PERF false
+
+// Flight recorder : ticks kept in the ring file (80 bytes each, 65536 ~ 5 MB, 5 min at 200 Hz)
+#define FLIGHT_RECORDER_CAPACITY 65536
+
+// Motor loop : core it is pinned to, SCHED_FIFO priority
+#define MOTOR_LOOP_CPU 0
+#define MOTOR_LOOP_PRIORITY 2
 
 // Times, in microseconds, to control PWM signals
 #define SERVO_VAL_MIN 1000.
@@ -14,13 +14,38 @@
 * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 * GNU General Public License for more details.
  */
- 
+
 #include "MaestroMotor.hpp"
 
 
 
 
-MaestroMotor::MaestroMotor(uint8_t time_rate) : _time_rate(time_rate), _servo_port(SERVO_PORT,9600){
+Motor_System_Clock MaestroMotor::_system_clock;
+
+
+
+MaestroMotor::MaestroMotor(uint8_t time_rate) : _servo_port(SERVO_PORT,9600), _writer(_servo_port), _uring(_servo_port),
+                                                _output(NULL), _clock(&_system_clock),
+                                                _encoder((Servo_Encoder::PROTOCOL)SERVO_PROTOCOL, SERVO_DELTA_OUTPUT, SERVO_KEEPALIVE, (Servo_DShot::SPEED)SERVO_DSHOT_SPEED),
+                                                _readback(SERVO_READBACK_DIVIDER, SERVO_READBACK_TOLERANCE, SERVO_READBACK_TIMEOUT),
+                                                _esc_telemetry(ESC_MOTOR_POLES, ESC_TELEMETRY_SHARED), _period(1000*time_rate),
+                                                _mux(_clock, &_events), _governor(1000*time_rate, &_events), _governing(GOVERNOR),
+                                                _metrics(1000*time_rate), _collecting(MOTOR_STATS), _profiling(MOTOR_PERF), _launch(false), _shutdown(false){
+    pthread_mutex_init(&_mutex_launch,NULL);
+    pthread_mutex_init(&_mutex_shutdown,NULL);
+    
+    _init();
+    
+}
+
+
+MaestroMotor::MaestroMotor(uint8_t time_rate, Motor_Output* output, Motor_Clock* clock) : _servo_port(), _writer(_servo_port), _uring(_servo_port),
+                                                _output(output), _clock(clock),
+                                                _encoder((Servo_Encoder::PROTOCOL)SERVO_PROTOCOL, SERVO_DELTA_OUTPUT, SERVO_KEEPALIVE, (Servo_DShot::SPEED)SERVO_DSHOT_SPEED),
+                                                _readback(SERVO_READBACK_DIVIDER, SERVO_READBACK_TOLERANCE, SERVO_READBACK_TIMEOUT),
+                                                _esc_telemetry(ESC_MOTOR_POLES, ESC_TELEMETRY_SHARED), _period(1000*time_rate),
+                                                _mux(_clock, &_events), _governor(1000*time_rate, &_events), _governing(GOVERNOR),
+                                                _metrics(1000*time_rate), _collecting(MOTOR_STATS), _profiling(MOTOR_PERF), _launch(false), _shutdown(false){
     pthread_mutex_init(&_mutex_launch,NULL);
     pthread_mutex_init(&_mutex_shutdown,NULL);
     
@@ -30,6 +55,16 @@ MaestroMotor::MaestroMotor(uint8_t time_rate) : _time_rate(time_rate), _servo_po
 
 
 MaestroMotor::~MaestroMotor(){
+#ifndef MAESTRO_EMBEDDED
+    if (_thread != NULL){
+        // run() returns on shutdown, launched or not : joined before we go away under it
+        shutdown();
+        _thread->join();
+        delete _thread;
+    }
+#endif
+    _writer.stop();
+    
     pthread_mutex_destroy(&_mutex_shutdown);
     pthread_mutex_destroy(&_mutex_launch);
     
@@ -37,16 +72,30 @@ MaestroMotor::~MaestroMotor(){
 }
 
 
-void MaestroMotor::_init() throw(Motor_Exception){
+void MaestroMotor::_init() MOTOR_THROWS {
+#ifndef MAESTRO_EMBEDDED
+    _thread = NULL;
+#endif
+    
     //Checks the port is currently open
-    if (!_servo_port.isOpen()) throw Motor_Exception(Motor_Exception::other,"Could'nt open servo port",1);
-
+    if (!_output_open()) MOTOR_RAISE(Motor_Exception::other,"Could'nt open servo port",1);
+    
+    _cur_params = _params.acquire();
+    _record = NULL;
+    _tick_flags = 0;
+    
     // Sets the servo id
     _servo_id[0] = servo_1_id;
     _servo_id[1] = servo_2_id;
     _servo_id[2] = servo_3_id;
     _servo_id[3] = servo_4_id;
     
+    for (int i=0; i<4; i++){
+        _encoder.setChannel(i, _servo_id[i]);
+        _readback.setChannel(i, _servo_id[i]);
+    }
+    _readback.setEnabled(SERVO_READBACK && SERVO_PROTOCOL == Servo_Encoder::maestro);
+    
     for (int i=0; i<4; i++){
         _motor_speed[i] = 0;
     }
@@ -54,46 +103,59 @@ void MaestroMotor::_init() throw(Motor_Exception){
     // Writes first commands
     for (int i=0; i<4; i++){
         _servo_out[i] = SERVO_INIT_PULSE;
+        _dshot_out[i] = 0;
     }
     setPosition();
     
-    usleep(2000000);
+    _clock->sleep(2000000);
     
     setPositionToZero();
 }
 
 
 
-void MaestroMotor::checkSpeed(float& square_speed) throw(Motor_Exception){
+void MaestroMotor::checkSpeed(int i, float& square_speed){
     
     if(square_speed<0){
+        _events.push(Motor_Event::speed_saturation_low, i, square_speed, 0);
+        _metrics.recordSaturation(i, Motor_Metrics_Data::saturation_speed_low);
+        _record_flag(i, Motor_Tick_Record::flag_speed_low);
         square_speed = 0;
-        throw new Motor_Exception(Motor_Exception::speed_saturation, "Error : below 0 speed",1);
+        return;
     }
     
-    if(sqrt(square_speed)>SERVO_MAX_REAL){
-        square_speed = SERVO_MAX_REAL*SERVO_MAX_REAL;
-        throw new Motor_Exception(Motor_Exception::speed_saturation, "Error : superior to saturation speed",1);
+    const float max_square_speed = _cur_params->servo_max_real*_cur_params->servo_max_real;
+    if(square_speed>max_square_speed){
+        _events.push(Motor_Event::speed_saturation_high, i, sqrtf(square_speed), _cur_params->servo_max_real);
+        _metrics.recordSaturation(i, Motor_Metrics_Data::saturation_speed_high);
+        _record_flag(i, Motor_Tick_Record::flag_speed_high);
+        square_speed = max_square_speed;
     }
 }
 
 
 
-void MaestroMotor::checkAcceleration(int i, float& speed) throw(Motor_Exception){
+void MaestroMotor::checkAcceleration(int i, float& speed) MOTOR_THROWS {
     
-    if (i<0 || i>3) throw new Motor_Exception(Motor_Exception::other,"Wrong int in checkAccel()",1);
+    if (i<0 || i>3) MOTOR_RAISE(Motor_Exception::other,"Wrong int in checkAccel()",i);
     
     // #louiscomment : attention convention de nommage en c++
-    float preCalcMotorAcceleration=(speed-_motor_speed[i])/_time_rate*1000.;
-    
-    if(preCalcMotorAcceleration>MAX_MOTOR_ACCELERATION){
-        speed =  MAX_MOTOR_ACCELERATION*_time_rate/1000+_motor_speed[i];
-        throw new Motor_Exception(Motor_Exception::acceleration_saturation, "Error : acceleration superior to saturation",1);
+    // dt follows the period : the limit per tick is rescaled when the governor changes it
+    const float dt = _period*1e-6f;
+    float preCalcMotorAcceleration=(speed-_motor_speed[i])/dt;
+    
+    if(preCalcMotorAcceleration>_cur_params->max_motor_acceleration){
+        _events.push(Motor_Event::acceleration_saturation, i, preCalcMotorAcceleration, _cur_params->max_motor_acceleration);
+        _metrics.recordSaturation(i, Motor_Metrics_Data::saturation_acceleration);
+        _record_flag(i, Motor_Tick_Record::flag_acceleration);
+        speed =  _cur_params->max_motor_acceleration*dt+_motor_speed[i];
     }
     
-    if(preCalcMotorAcceleration<-MAX_MOTOR_ACCELERATION){
-        speed = -MAX_MOTOR_ACCELERATION*_time_rate/1000+_motor_speed[i];
-        throw new Motor_Exception(Motor_Exception::acceleration_saturation, "Error : acceleration superior to saturation",1);
+    if(preCalcMotorAcceleration<-_cur_params->max_motor_acceleration){
+        _events.push(Motor_Event::acceleration_saturation, i, preCalcMotorAcceleration, -_cur_params->max_motor_acceleration);
+        _metrics.recordSaturation(i, Motor_Metrics_Data::saturation_acceleration);
+        _record_flag(i, Motor_Tick_Record::flag_acceleration);
+        speed = -_cur_params->max_motor_acceleration*dt+_motor_speed[i];
     }
 }
 
@@ -103,7 +165,10 @@ float MaestroMotor::preCalcMotorSquareSpeed(Eigen::Vector4f& command, SERVO_ID s
     int eps1 = ((servo==SERVO_ID::servo_1_id||servo==SERVO_ID::servo_2_id) ? 0 : 1);
     int eps2 = ((servo==SERVO_ID::servo_1_id||servo==SERVO_ID::servo_3_id) ? 1 : 0);
     
-    return (command[0]/(4*thrust_factor)+(2*eps1-1)*command[eps2+1]/(2*thrust_factor*center_to_motor_distance)-(2*eps2-1)*command[3]/(4*drag_factor));
+    const float thrust = _cur_params->thrust_coef;
+    const float drag = _cur_params->drag_coef;
+    
+    return (command[0]/(4*thrust)+(2*eps1-1)*command[eps2+1]/(2*thrust*_cur_params->arm_length)-(2*eps2-1)*command[3]/(4*drag));
     
 }
 
@@ -117,7 +182,8 @@ void MaestroMotor::_update_motor_speed(Eigen::Vector4f& command){
     
     for (int i=0; i<4 ; i++){
         preCalcSquareSpeed = preCalcMotorSquareSpeed(command,_servo_id[i]);
-        checkSpeed(preCalcSquareSpeed);
+        if (_record != NULL) _record->square_speed[i] = preCalcSquareSpeed;
+        checkSpeed(i, preCalcSquareSpeed);
         preCalcSpeed = sqrtf(preCalcSquareSpeed);
         checkAcceleration(i, preCalcSpeed);
         _motor_speed[i]=preCalcSpeed;
@@ -125,20 +191,41 @@ void MaestroMotor::_update_motor_speed(Eigen::Vector4f& command){
 }
 
 
-void MaestroMotor::_update_servo_out() throw(Motor_Exception){
+void MaestroMotor::_update_servo_out(){
     
     float preCalcPWM;
+    float speed;
+    uint64_t now = _clock->now();
     
     for(int i=0;i<4;i++){
         
-        preCalcPWM=SERVO_VAL_MAX-((SERVO_MAX_REAL-_motor_speed[i])/SERVO_MAX_REAL)*(SERVO_VAL_MAX-SERVO_VAL_MIN);
+        // Closed loop : the command is the feed-forward, the ESC telemetry corrects it
+        speed = _motor_speed[i];
+        if (_cur_params->rpm_max_correction > 0){
+            bool fresh = _esc_telemetry.isFresh(i, now, ESC_TELEMETRY_MAX_AGE);
+            speed += _rpm_control.update(i, speed, _esc_telemetry.getData(i).speed, fresh, _period*1e-6f,
+                                         _cur_params->rpm_kp, _cur_params->rpm_ki, _cur_params->rpm_max_correction);
+        }
+        
+        preCalcPWM=_cur_params->servo_val_min+_cur_params->pwm_offset[i]
+                   +_cur_params->pwm_scale[i]*(speed/_cur_params->servo_max_real)*(_cur_params->servo_val_max-_cur_params->servo_val_min);
         
-        if(preCalcPWM<SERVO_VAL_MIN||preCalcPWM>SERVO_VAL_MAX){
-            throw new Motor_Exception(Motor_Exception::other,"Invalid PWM instruction",2);
+        if(preCalcPWM<_cur_params->servo_val_min){
+            _events.push(Motor_Event::pwm_out_of_range, i, preCalcPWM, _cur_params->servo_val_min);
+            _record_flag(i, Motor_Tick_Record::flag_pwm_range);
+            preCalcPWM = _cur_params->servo_val_min;
+        }
+        if(preCalcPWM>_cur_params->servo_val_max){
+            _events.push(Motor_Event::pwm_out_of_range, i, preCalcPWM, _cur_params->servo_val_max);
+            _record_flag(i, Motor_Tick_Record::flag_pwm_range);
+            preCalcPWM = _cur_params->servo_val_max;
         }
         
         _servo_out[i] = preCalcPWM;
+        _dshot_out[i] = Servo_DShot::throttle(speed, _cur_params->servo_max_real);
     }
+    
+    if (SERVO_PROTOCOL == Servo_Encoder::dshot) _request_telemetry();
 }
 
 
@@ -149,48 +236,182 @@ void MaestroMotor::_update(Eigen::Vector4f& command){
 }
 
 
-void MaestroMotor::setPosition() throw(Motor_Exception){
+bool MaestroMotor::tick(Eigen::Vector4f& command){
+    
+    uint64_t start = Motor_Event_Log::now();
+    uint64_t started = _clock->now();
+    bool success = true;
     
-    if(_servo_port.isOpen()){
+    // Tick boundary : pick up parameters published since the last tick
+    _cur_params = _params.acquire();
+    
+    // Responses to the readback queries of previous ticks, never waited for
+    _poll_readback();
+    
+    // Black box : the slot is filled along the tick, published at its end
+    _record = _recorder.next();
+    if (_record != NULL) _record->flags = 0;
+    _tick_flags = 0;
+    
+    // Counters are per thread : opened here, by the thread that ticks
+    if (_profiling && !_perf.isOpen()) _profiling = _perf.open();
+    Motor_Perf_Sample perf[3];
+    if (_profiling) _perf.read(perf[0]);
+    
+    MOTOR_TRY {
+        _update(command);
+        uint64_t updated = Motor_Event_Log::now();
+        _metrics.recordStage(Motor_Metrics_Data::stage_update, updated-start);
+        if (_profiling){
+            _perf.read(perf[1]);
+            _perf.record(Motor_Metrics_Data::stage_update, perf[0], perf[1]);
+        }
         
-        // Counting the number of ports on which we manage to write
-        int number_of_updated_ports = 0;
-        const char* preCalcPWM;
+        setPosition();
+        _metrics.recordStage(Motor_Metrics_Data::stage_output, Motor_Event_Log::now()-updated);
+        if (_profiling){
+            _perf.read(perf[2]);
+            _perf.record(Motor_Metrics_Data::stage_output, perf[1], perf[2]);
+        }
+    }
+    MOTOR_CATCH {
+        _events.push(Motor_Event::other, MOTOR_EVENT_NO_MOTOR, 0, 0);
+        _record_flag(0, Motor_Tick_Record::flag_tick_failed);
+        success = false;
+    }
+    
+    if (_record != NULL){
+        for (int i=0; i<4; i++){
+            _record->command[i] = command[i];
+            _record->motor_speed[i] = _motor_speed[i];
+            _record->servo_out[i] = _servo_out[i];
+        }
+        _record->params_version = _cur_params->version;
+        _recorder.commit(_record);
+        _record = NULL;
+    }
+    
+    _metrics.recordServoOut(_servo_out);
+    if (_collecting) _stats.record(_servo_out, _motor_speed.data(), _tick_flags);
+    _metrics.recordStage(Motor_Metrics_Data::stage_tick, Motor_Event_Log::now()-start);
+    if (_profiling){
+        _perf.read(perf[2]);
+        _perf.record(Motor_Metrics_Data::stage_tick, perf[0], perf[2]);
+    }
+    if (_metrics.getData().ticks % METRICS_PUBLISH_DIVIDER == 0) _metrics.publish();
+    
+    // Overloaded or back with headroom : the next ticks run at the new period
+    if (_governing && _governor.observe(started, Motor_Event_Log::now()-start)){
+        _period = _governor.getPeriod();
+        _metrics.setPeriod(_period);
+    }
+    
+    return success;
+}
 
-        // For each motor :
-        // Writes the string "servo_id=_servo_outus\n" in serial_port
-        // Increments number_of_updated_ports
 
-        for (int i=0; i<4 ; i++){
-            preCalcPWM = (new std::string(std::to_string(_servo_id[i])+"="+std::to_string(_servo_out[i])+"us\n"))->c_str();
-            number_of_updated_ports+=_servo_port.writeString(preCalcPWM);
-        }
+Eigen::Vector4f MaestroMotor::getMotorSpeed() const {
+    return _motor_speed;
+}
+
+
+void MaestroMotor::getServoOut(uint16_t* servo_out) const {
+    for (int i=0; i<4; i++){
+        servo_out[i] = _servo_out[i];
+    }
+}
+
+
+int MaestroMotor::encodeFrame(char* buffer, unsigned int size, bool full){
+    return _encoder.encode(SERVO_PROTOCOL == Servo_Encoder::dshot ? _dshot_out : _servo_out, buffer, size, full);
+}
+
 
-        if (number_of_updated_ports/4<1) {
-            throw Motor_Exception(Motor_Exception::other,"Couldn't write on ALL ports",2);
+void MaestroMotor::setPosition() MOTOR_THROWS {
+    
+    if(_output_open()){
+        
+        // The orders are coalesced in a single frame, written at once.
+        // The async writer may drop superseded frames : a delta against them would be lost, so it only gets full frames
+        // Read once : a concurrent start() must not split this tick between two paths
+        bool offload = _writer.isRunning();
+        char frame[Serial_Frame::MAX_SIZE];
+        int length = encodeFrame(frame, sizeof(frame), offload);
+        if (length < 0) MOTOR_RAISE(Motor_Exception::other,"Frame too long",2);
+        
+        // Readback queries ride behind the targets, their responses are read on later ticks
+        if (!offload) length += _readback.appendQueries(_servo_out, frame+length, sizeof(frame)-length, _metrics.getData().ticks);
+        
+        // Offload mode : the writer thread transmits it, we don't wait for the UART
+        if (offload){
+            _writer.submit(frame, length);
+            _encoder.acknowledge();
+            return;
         }
+        
+        // io_uring backend : errors show up on completions of previous frames
+        if (_uring.isAvailable()){
+            int failed = _uring.reap();
+            if (failed > 0){
+                _metrics.recordWriteError();
+                _events.push(Motor_Event::serial_write_error, MOTOR_EVENT_NO_MOTOR, failed, 0);
+                _encoder.invalidate();
+                _readback.cancelQueries();
+                length = encodeFrame(frame, sizeof(frame), true);
+                if (length < 0) MOTOR_RAISE(Motor_Exception::other,"Frame too long",2);
+                length += _readback.appendQueries(_servo_out, frame+length, sizeof(frame)-length, _metrics.getData().ticks);
+            }
+            if (length > 0 && _uring.submitFrame(frame, length) < 0){
+                _metrics.recordWriteError();
+                _events.push(Motor_Event::serial_write_error, MOTOR_EVENT_NO_MOTOR, length, 0);
+                _encoder.invalidate();
+                _readback.cancelQueries();
+                MOTOR_RAISE(Motor_Exception::other,"Couldn't submit on ALL ports",2);
+            }
+            _encoder.acknowledge();
+            return;
+        }
+        
+        // Nothing changed since the last frame
+        if (length == 0){
+            _encoder.acknowledge();
+            return;
+        }
+        
+        if (_output_write(frame, length) < 0) {
+            _metrics.recordWriteError();
+            _events.push(Motor_Event::serial_write_error, MOTOR_EVENT_NO_MOTOR, length, 0);
+            _encoder.invalidate();
+            _readback.cancelQueries();
+            MOTOR_RAISE(Motor_Exception::other,"Couldn't write on ALL ports",2);
+        }
+        _encoder.acknowledge();
     }
     
-    else throw Motor_Exception(Motor_Exception::other,"Servo port appears to be closed",1);
+    else MOTOR_RAISE(Motor_Exception::other,"Servo port appears to be closed",1);
 }
 
 
 void MaestroMotor::setPositionToZero(){
     
-    const char* string_order;
+    // Shutdown order must not be overtaken by a pending frame
+    _writer.stop();
+    _uring.drain();
     
     for (int i=0; i<4; i++){
         _servo_out[i] = SERVO_VAL_MIN; // TODO : change for value that shutdown motors
+        _dshot_out[i] = 0; // DShot motor stop
     }
     
-    for (int i=0; i<4 ; i++){
-        string_order = (new std::string(std::to_string(_servo_id[i])+"="+std::to_string(_servo_out[i])+"us\n"))->c_str();
-        _servo_port.writeString(string_order);
-    }
+    char frame[Serial_Frame::MAX_SIZE];
+    int length = encodeFrame(frame, sizeof(frame), true);
+    if (_output_write(frame, length) < 0) _encoder.invalidate();
+    else _encoder.acknowledge();
 }
 
 
-//TODO : connect it w/ Drone class
+#ifndef MAESTRO_EMBEDDED
+// Commands come from _mux : the Drone class publishes there as source_autopilot
 void* MaestroMotor::run() {
     
     // For test purposes
@@ -208,40 +429,38 @@ void* MaestroMotor::run() {
     Eigen::Vector4f command;
     
     while (!getLaunch()){
-        sleep(1);
+        if (getShutdown()) return NULL; // never launched : the motors were never driven
+        _clock->sleep(1000000);
     }
     
     
     while (true) {
-
-        command = drone->getCommand(); // must be blocking until new command arrives
-        try {
-            _update(command);
-            setPosition();
-        }
-        catch (const Motor_Exception& e){
-            // TODO : GREG
-        }
+        
+        _mux.select(command); // highest-priority live source, zero without any
+        tick(command); // TODO : GREG, failures are in the event log
         
         if (getShutdown()) break;
         
-        usleep(1000*_time_rate);
+        _clock->sleep(_period);
     }
     
     setPositionToZero();
     
-    // + launch message : "Shutdown was called and MaestroMotor has now returned"
-    
+    _metrics.publish();
+    _encoder.printReport(stdout);
     
-
+    // + launch message : "Shutdown was called and MaestroMotor has now returned"
     
+    return NULL; // what join() gets
  }
 
 
 void MaestroMotor::start(){
-    Thread* th = new Thread(std::auto_ptr<Runnable>(this),false,Thread::FIFO,2);
-    th->start();
+    if (_thread != NULL) return;
+    _thread = new Thread(std::auto_ptr<Runnable>(new Runner(this)),false,Thread::FIFO,2);
+    _thread->start();
 }
+#endif
 
 
 void MaestroMotor::launch(){
@@ -279,5 +498,199 @@ bool MaestroMotor::getShutdown(){
 
 
 
+uint32_t MaestroMotor::publishParams(const Motor_Params& params){
+    return _params.publish(params);
+}
+
+
 
+bool MaestroMotor::rollbackParams(){
+    return _params.rollback();
+}
 
+
+
+Motor_Params MaestroMotor::getParams(){
+    return _params.current();
+}
+
+
+
+Motor_Event_Log* MaestroMotor::getEventLog(){
+    return &_events;
+}
+
+
+
+Serial_Writer* MaestroMotor::getAsyncWriter(){
+    // Both backends write on _servo_port, which an injected output replaces
+    if (_output != NULL) return NULL;
+    return &_writer;
+}
+
+
+
+Serial_Uring* MaestroMotor::getUringBackend(){
+    if (_output != NULL) return NULL;
+    return &_uring;
+}
+
+
+
+Servo_Encoder_Stats MaestroMotor::getOutputStats(){
+    return _encoder.getStats();
+}
+
+
+
+Motor_Metrics* MaestroMotor::getMetrics(){
+    return &_metrics;
+}
+
+
+Motor_Stats* MaestroMotor::getStats(){
+    return &_stats;
+}
+
+
+
+Motor_Recorder* MaestroMotor::getRecorder(){
+    return &_recorder;
+}
+
+
+
+Servo_Readback* MaestroMotor::getReadback(){
+    return &_readback;
+}
+
+
+Servo_DShot* MaestroMotor::getDShot(){
+    return _encoder.getDShot();
+}
+
+
+Motor_Command_Mux* MaestroMotor::getCommandMux(){
+    return &_mux;
+}
+
+
+Motor_Clock* MaestroMotor::getClock(){
+    return _clock;
+}
+
+
+void MaestroMotor::feedEscTelemetry(int line, const char* bytes, unsigned int length){
+    _esc_telemetry.feed(line, bytes, length, _clock->now());
+}
+
+
+Servo_Telemetry* MaestroMotor::getEscTelemetry(){
+    return &_esc_telemetry;
+}
+
+
+Motor_Rpm_Control* MaestroMotor::getRpmControl(){
+    return &_rpm_control;
+}
+
+
+void MaestroMotor::setProfiling(bool profiling){
+    _profiling = profiling;
+}
+
+
+Motor_Perf* MaestroMotor::getPerf(){
+    return &_perf;
+}
+
+
+void MaestroMotor::setPeriod(uint32_t period){
+    _governor.setNominalPeriod(period);
+    _period = period;
+    _metrics.setPeriod(period);
+}
+
+
+uint32_t MaestroMotor::getPeriod() const {
+    return _period;
+}
+
+
+void MaestroMotor::setGoverning(bool governing){
+    _governing = governing;
+    if (!governing){
+        _governor.reset();
+        _period = _governor.getPeriod();
+        _metrics.setPeriod(_period);
+    }
+}
+
+
+Motor_Governor* MaestroMotor::getGovernor(){
+    return &_governor;
+}
+
+
+
+bool MaestroMotor::_output_open(){
+    if (_output != NULL) return _output->isOpen();
+    return _servo_port.isOpen();
+}
+
+
+
+int MaestroMotor::_output_write(const char* frame, unsigned int length){
+    if (_output != NULL) return _output->write(frame, length);
+    return _servo_port.write_bytes(frame, length);
+}
+
+
+
+
+int MaestroMotor::_output_read(char* buffer, unsigned int size){
+    if (_output != NULL) return _output->read(buffer, size);
+    int ret = _servo_port.read_available(buffer, size);
+    return (ret > 0 ? ret : 0);
+}
+
+
+
+void MaestroMotor::_poll_readback(){
+    if (!_readback.isEnabled()) return;
+    
+    // Bounded : a babbling device can't hold the tick
+    char buffer[64];
+    int length = 0;
+    for (int i=0; i<4; i++){
+        // With io_uring, the read linked behind each frame consumes the responses
+        length = (_uring.isAvailable() ? (int)_uring.readTelemetry(buffer, sizeof(buffer)) : _output_read(buffer, sizeof(buffer)));
+        if (length <= 0) break;
+        _readback.process(buffer, length, _metrics.getData().ticks, _events);
+    }
+    if (length <= 0) _readback.process(buffer, 0, _metrics.getData().ticks, _events); // timeouts
+}
+
+
+
+void MaestroMotor::_request_telemetry(){
+    
+    // ESCs only answer requests : on a shared line, one per tick so that answers don't collide
+    if (!ESC_TELEMETRY_SHARED){
+        for (int i=0; i<4; i++){
+            _encoder.getDShot()->requestTelemetry(i);
+        }
+        return;
+    }
+    int motor = _metrics.getData().ticks % 4;
+    _encoder.getDShot()->requestTelemetry(motor);
+    _esc_telemetry.setRequested(motor);
+}
+
+
+
+void MaestroMotor::_record_flag(int i, uint32_t flag){
+    uint32_t bits = (flag == Motor_Tick_Record::flag_tick_failed ? flag : flag << 4*i);
+    _tick_flags |= bits;
+    if (_record != NULL) _record->flags |= bits;
+}
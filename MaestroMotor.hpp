@@ -25,20 +25,43 @@
 #include "Serial.h"
 #include "Motor_Exception.hpp"
 #include "Config.hpp"
+#include "Motor_Params.hpp"
+#include "Motor_Event_Log.hpp"
+#include "Serial_Writer.hpp"
+#include "Serial_Uring.hpp"
+#include "Servo_Encoder.hpp"
+#include "Servo_Readback.hpp"
+#include "Servo_Telemetry.hpp"
+#include "Motor_Rpm_Control.hpp"
+#include "Motor_Command_Mux.hpp"
+#include "Motor_Metrics.hpp"
+#include "Motor_Recorder.hpp"
+#include "Motor_Stats.hpp"
+#include "Motor_Perf.hpp"
+#include "Motor_Governor.hpp"
+#include "Motor_Io.hpp"
 #include "/usr/local/include/Dense"
+#include <pthread.h>
+#ifndef MAESTRO_EMBEDDED
 #include <string>
 #include "Thread/Runnable.h"
-#include <pthread.h>
 #include "Thread/Thread.h"
+#endif
 
 
 
+#ifndef MAESTRO_EMBEDDED
 class MaestroMotor : public Runnable {
-    
+#else
+class MaestroMotor { // Embedded profile : driven by a Motor_Pipeline
+#endif
+        
+        
+public:
     
     /**
      * \enum SERVO_ID
-     * \brief Enumerates the 4 servo to ease control
+     * \brief Enumerates the 4 servo to ease control (argument of preCalcMotorSquareSpeed)
      */
     enum SERVO_ID{
         servo_1_id=0,  
@@ -48,8 +71,6 @@ class MaestroMotor : public Runnable {
     };
     
     
-public:
-    
     /**
      * \brief Constructor 
      *
@@ -61,6 +82,19 @@ public:
     
     
     
+    /**
+     * \brief Constructor without hardware (headless simulation)
+     *
+     * The servo port is not opened : frames go to output, waits go through clock
+     *
+     * \param uint8_t time_rate : Time rate of the thread
+     * \param Motor_Output* : destination of the frames, must outlive the instance
+     * \param Motor_Clock* : time source for waits, must outlive the instance
+     */
+    MaestroMotor(uint8_t, Motor_Output*, Motor_Clock*);
+    
+    
+    
     /**
      * \brief Destructor
      *
@@ -78,29 +112,29 @@ public:
      *
      * \return 1 if port open, 0 if not (then throw Motor_Exception)
      */
-    void _init() throw(Motor_Exception);
+    void _init() MOTOR_THROWS;
     
     
     /**
      * \brief Check that motor Speed is adequate and returns its value or saturation values
      *
-     * Check it is superior to 0 and inferior to saturation. Throws Motor_Exception if not.
+     * Check it is superior to 0 and inferior to saturation. Saturates and logs an event if not.
      *
-     * \param float : Computed motor speed 
+     * \param int : motor index, float : Computed motor square speed
      */
-    void checkSpeed(float&) throw(Motor_Exception);
+    void checkSpeed(int, float&);
     
     
     /**
      * \brief Check that motor Acceleration is adequate
      *
-     * Check it is inferior to saturation. Throw Motor_Exception if not. Returns the saturated speed if necessary
+     * Check it is inferior to saturation. Saturates and logs an event if not. Throws Motor_Exception on a wrong motor index
      *
-     * \param Eigen::Vector4f : Commands from Autopilot, SERVO_ID of which we check the acceleration, float computed new motor speed
+     * \param int : motor index of which we check the acceleration, float computed new motor speed
      */
     // COMMENT : SERVO_ID needed to compute acceleration from previous speed in _servo_out
-    void checkAcceleration(int, float&) throw(Motor_Exception);
-
+    void checkAcceleration(int, float&) MOTOR_THROWS;
+    
     
     /**
      * \brief Check that motor Acceleration is adequate
@@ -127,10 +161,11 @@ public:
      * \brief Update _servo_out
      *
      * Calculate PWM signals from commands and store them into _servo_out
+     * With rpm_max_correction > 0, the speeds are first corrected from the ESC telemetry
      *
      * \param
      */
-    void _update_servo_out() throw(Motor_Exception);
+    void _update_servo_out();
     
     
     /**
@@ -143,14 +178,58 @@ public:
     void _update(Eigen::Vector4f&);
     
     
+    /**
+     * \brief One control tick : picks up new parameters, _update, then setPosition
+     *
+     * Stages are timed into the metrics. Motor_Exception are caught and logged as events
+     *
+     * \param Eigen::Vector4f : Commands from Autopilot
+     * \return false if the tick failed
+     */
+    bool tick(Eigen::Vector4f&);
+    
+    
+    /**
+     * \brief Encodes _servo_out as a frame for the servo port
+     *
+     * ServoBlaster lines or Maestro commands, only the changed channels in delta mode.
+     * DShot : _dshot_out packets, in a serial bridge frame.
+     * No allocation. The frame is staged in _encoder until acknowledged
+     *
+     * \param char* : output buffer, unsigned int : its size, bool : force a full frame
+     * \return length of the frame, 0 if nothing changed, -1 if the buffer is too small
+     */
+    int encodeFrame(char*, unsigned int, bool full = false);
+    
+    
+    /**
+     * \brief Returns _motor_speed
+     *
+     * Not threadsafe : to be called from the thread running the updates
+     *
+     * \return Eigen::Vector4f motor speeds in rd/s
+     */
+    Eigen::Vector4f getMotorSpeed() const;
+    
+    
+    /**
+     * \brief Copies _servo_out
+     *
+     * Not threadsafe : to be called from the thread running the updates
+     *
+     * \param uint16_t* : 4 PWM signals in us
+     */
+    void getServoOut(uint16_t*) const;
+    
+    
     /**
      * \brief Set the motor speed by writing on GPIO port
      *
-     * Transform _servo_out to string and write on port
+     * Transform _servo_out to string and write on port, or hand it to the async writer if started
      *
      * \return
      */
-    void setPosition() throw(Motor_Exception);
+    void setPosition() MOTOR_THROWS;
     
     
     /**
@@ -206,10 +285,253 @@ public:
     
     
     
+    /**
+     * \brief Publishes new limits and mixer coefficients
+     *
+     * Threadsafe, can be called while the motor thread runs. Taken into account at the next tick
+     *
+     * \param Motor_Params : new parameters
+     * \return version number of the published parameters
+     */
+    uint32_t publishParams(const Motor_Params&);
+    
+    
+    
+    /**
+     * \brief Rolls back to the previously published parameters
+     *
+     * Threadsafe, taken into account at the next tick
+     *
+     * \return false if no parameters were published before
+     */
+    bool rollbackParams();
+    
+    
+    
+    /**
+     * \brief Returns a copy of the latest published parameters
+     *
+     * Threadsafe implementation of getParams
+     *
+     * \return Motor_Params
+     */
+    Motor_Params getParams();
+    
+    
+    
+    /**
+     * \brief Returns the fault/event log filled by the motor thread
+     *
+     * To be attached to a Motor_Event_Drainer
+     *
+     * \return Motor_Event_Log*
+     */
+    Motor_Event_Log* getEventLog();
+    
+    
+    
+    /**
+     * \brief Returns the async writer of the servo port
+     *
+     * Once started, setPosition() no longer blocks on the port : frames are transmitted by the
+     * writer thread, latest wins. Stopped by setPositionToZero()
+     *
+     * \return Serial_Writer*, NULL when constructed on a Motor_Output (the writer only knows the servo port)
+     */
+    Serial_Writer* getAsyncWriter();
+    
+    
+    
+    /**
+     * \brief Returns the io_uring backend of the servo port
+     *
+     * Once set up, setPosition() submits frames through io_uring instead of a blocking write
+     * (the async writer, if started, takes precedence). Must be set up before launch().
+     * Its linked reads consume the device responses : readback is fed from readTelemetry()
+     *
+     * \return Serial_Uring*, NULL when constructed on a Motor_Output
+     */
+    Serial_Uring* getUringBackend();
+    
+    
+    
+    /**
+     * \brief Returns the bytes on wire sent and saved by delta encoding
+     *
+     * Counters are updated by the motor thread without lock : read them once it has returned
+     *
+     * \return Servo_Encoder_Stats
+     */
+    Servo_Encoder_Stats getOutputStats();
+    
+    
+    
+    /**
+     * \brief Returns the runtime metrics
+     *
+     * open() it to export them in shared memory (see tools/maestro_top.cpp)
+     *
+     * \return Motor_Metrics*
+     */
+    Motor_Metrics* getMetrics();
+    
+    
+    
+    /**
+     * \brief Returns the flight recorder
+     *
+     * open() it before launch() to record every tick (see tools/flight_recorder_decode.cpp)
+     *
+     * \return Motor_Recorder*
+     */
+    Motor_Recorder* getRecorder();
+    
+    
+    
+    /**
+     * \brief Returns the per-motor flight statistics
+     *
+     * getSnapshot() can be called from any thread while the motor runs (MOTOR_STATS)
+     *
+     * \return Motor_Stats*
+     */
+    Motor_Stats* getStats();
+    
+    
+    
+    /**
+     * \brief Returns the output verification (Maestro protocol)
+     *
+     * setEnabled(true) before launch() : Get Position / Get Errors queries are appended to the
+     * frames written by setPosition() and their responses matched on later ticks. Faults go
+     * to the event log. Not with the async writer, which may drop frames
+     *
+     * \return Servo_Readback*
+     */
+    Servo_Readback* getReadback();
+    
+    
+    
+    /**
+     * \brief Returns the DShot packet builder (SERVO_PROTOCOL 2), to send ESC commands
+     *
+     * Commands are only sent to stopped motors, e.g. getDShot()->sendCommand(0, Servo_DShot::beep_1)
+     *
+     * \return Servo_DShot*
+     */
+    Servo_DShot* getDShot();
+    
+    
+    
+    /**
+     * \brief Returns the command multiplexer
+     *
+     * Autopilot, ground test tool, RC override and failsafe publish() there, each from its own
+     * thread ; the ticking thread select()s the highest-priority live one
+     *
+     * \return Motor_Command_Mux*
+     */
+    Motor_Command_Mux* getCommandMux();
+    
+    
+    
+    /**
+     * \brief Returns the time source of the instance (system clock unless one was injected)
+     *
+     * \return Motor_Clock*
+     */
+    Motor_Clock* getClock();
+    
+    
+    
+    /**
+     * \brief Parses ESC telemetry read from a line, stamped with the motor clock
+     *
+     * To be called by the thread that ticks (Motor_Pipeline::attachEscTelemetry does)
+     *
+     * \param int : line, const char* : bytes, unsigned int : count
+     */
+    void feedEscTelemetry(int, const char*, unsigned int);
+    
+    
+    
+    /**
+     * \brief Returns the ESC telemetry (RPM, voltage, current, temperature of each motor)
+     *
+     * \return Servo_Telemetry*
+     */
+    Servo_Telemetry* getEscTelemetry();
+    
+    
+    
+    /**
+     * \brief Returns the closed-loop speed correction, active when rpm_max_correction > 0
+     *
+     * \return Motor_Rpm_Control*
+     */
+    Motor_Rpm_Control* getRpmControl();
+    
+    
+    
+    /**
+     * \brief Turns hardware counter profiling of the tick stages on or off
+     *
+     * The counters are per thread : they are opened by the thread running tick(), at its next
+     * tick. Off if they can't be opened (see getPerf()->isOpen())
+     */
+    void setProfiling(bool);
+    
+    
+    
+    /**
+     * \brief Returns the tick profiler (printReport() for IPC and misses per tick)
+     *
+     * \return Motor_Perf*
+     */
+    Motor_Perf* getPerf();
+    
+    
+    
+    /**
+     * \brief Sets the nominal tick period, in us (1000*time_rate by default)
+     *
+     * Speeds, accelerations and the closed loop use it as dt. It is the shortest rung of the
+     * governor ladder. To be called before launch, by the owner of the tick timer
+     */
+    void setPeriod(uint32_t);
+    
+    
+    
+    /**
+     * \brief Returns the current tick period in us : the governor may have lengthened it
+     *
+     * The thread pacing the ticks reads it after each tick
+     */
+    uint32_t getPeriod() const;
+    
+    
+    
+    /**
+     * \brief Turns the overload governor on or off (on with GOVERNOR). Off : back to the nominal period
+     */
+    void setGoverning(bool);
+    
+    
+    
+    /**
+     * \brief Returns the overload governor (transitions and load)
+     *
+     * \return Motor_Governor*
+     */
+    Motor_Governor* getGovernor();
+    
+    
+    
     /*----------------------------------------------------------------------------------------------------*/
     /*-----------------------------------------  THREAD METHODS  -----------------------------------------*/
     /*----------------------------------------------------------------------------------------------------*/
 
+#ifndef MAESTRO_EMBEDDED
     
     /**
      * \brief Run the motors w/ checks
@@ -224,26 +546,74 @@ public:
     /**
      * \brief Start for thread methods
      *
-     * This is the start method for the MaestroMotor thread 
+     * This is the start method for the MaestroMotor thread. Only the first call starts one ;
+     * the thread is asked to shut down and deleted with the MaestroMotor
      *
      * \return
      */
     void start();
+#endif
+        
+        
+        
+        
+        
+        
+private:
     
+    bool _output_open();
+    int _output_write(const char*, unsigned int);
+    int _output_read(char*, unsigned int);
+    void _poll_readback();
+    void _request_telemetry();
+    void _record_flag(int, uint32_t);
     
-    
-    
-    
-
-private:
+    static Motor_System_Clock _system_clock;
     
     Serial _servo_port; //defined from CONFIG
+    Serial_Writer _writer; //I/O offload mode, idle until started
+    Serial_Uring _uring; //io_uring backend, plain writes until set up
+    Motor_Output* _output; //replaces _servo_port when not NULL
+    Motor_Clock* _clock; //time source for waits
+    Servo_Encoder _encoder; //frame encoding, delta against the last transmitted frame
+    Servo_Readback _readback; //Get Position / Get Errors behind the frames, off by default
+    Servo_Telemetry _esc_telemetry; //measured speeds, fed by the ticking thread
+    Motor_Rpm_Control _rpm_control; //speed correction from _esc_telemetry
     
     Eigen::Vector4f _motor_speed; //motor speeds given in rd.s
-
+    
     SERVO_ID _servo_id[4];
     uint16_t _servo_out[4]; //PWM signals sent to ESC given in microseconds
-    uint8_t _time_rate; //time rate
+    uint16_t _dshot_out[4]; //DShot throttle values, 0 stops the motor
+    uint32_t _period; //tick period in us, dt of the updates
+    
+    Motor_Params_Store _params; //hot-swappable limits and coefficients
+    const Motor_Params* _cur_params; //version used for the current tick
+    
+    Motor_Event_Log _events; //saturations and faults, pushed by the motor thread
+    Motor_Command_Mux _mux; //command sources, picked each tick
+    Motor_Governor _governor; //tick period ladder under overload
+    bool _governing; //_governor steps _period
+    Motor_Metrics _metrics; //tick latencies and counters, for external monitoring
+    Motor_Recorder _recorder; //black box, one record per tick once open
+    Motor_Tick_Record* _record; //record of the current tick, NULL outside tick()
+    uint32_t _tick_flags; //saturations of the current tick, as in Motor_Tick_Record
+    Motor_Stats _stats; //per-motor streaming statistics
+    bool _collecting; //_stats fed at each tick
+    Motor_Perf _perf; //hardware counters per stage, opened by the tick thread
+    bool _profiling; //_perf wanted
+
+#ifndef MAESTRO_EMBEDDED
+    /**
+     * Runnable handed to the Thread : the Thread owns it, not the MaestroMotor
+     */
+    struct Runner : public Runnable {
+        Runner(MaestroMotor* maestro) : maestro(maestro) {}
+        void* run(){ return maestro->run(); }
+        MaestroMotor* maestro;
+    };
+    Thread* _thread; //motor thread, NULL until start()
+#endif
     
     
     bool _launch;
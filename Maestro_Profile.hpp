@@ -0,0 +1,23 @@
+//
+//  Maestro_Profile.hpp
+//  MaestroMotor
+//
+//  Build profile. The embedded profile (MAESTRO_EMBEDDED) builds MaestroMotor, Serial and
+//  navi_State without exceptions, RTTI, iostream nor std::string : errors are status codes
+//  and fixed buffers, the motor thread is a Motor_Pipeline (no Runnable/Thread).
+//  Enabled by -DMAESTRO_EMBEDDED, or implied by -fno-exceptions.
+//  Footprint of either profile : tools/maestro_footprint.cpp
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Maestro_Profile_hpp
+#define Maestro_Profile_hpp
+
+
+#if !defined(MAESTRO_EMBEDDED) && !defined(__EXCEPTIONS) && !defined(__cpp_exceptions)
+#define MAESTRO_EMBEDDED
+#endif
+
+
+#endif /* Maestro_Profile_hpp */
@@ -0,0 +1,161 @@
+//
+//  Motor_Command_Mux.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Command_Mux.hpp"
+#include "Config.hpp"
+#include <string.h>
+
+
+
+static const uint64_t DEFAULT_LEASES[Motor_Command_Mux::NB_SOURCES] = {
+    COMMAND_LEASE_AUTOPILOT, COMMAND_LEASE_GROUND_TEST, COMMAND_LEASE_MANUAL, COMMAND_LEASE_FAILSAFE
+};
+
+
+
+Motor_Command_Mux::Motor_Command_Mux(Motor_Clock* clock, Motor_Event_Log* events) : _clock(clock), _events(events), _active(-1){
+    for (int s=0; s<NB_SOURCES; s++){
+        _slots[s].sequence.store(0);
+        for (int i=0; i<4; i++){
+            _slots[s].command[i].store(0);
+        }
+        _slots[s].since.store(0);
+        _slots[s].expiry.store(0);
+        _slots[s].lease = DEFAULT_LEASES[s];
+    }
+    memset(_snapshots, 0, sizeof(_snapshots));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+void Motor_Command_Mux::setLease(SOURCE source, uint64_t lease){
+    _slots[source].lease = lease;
+}
+
+
+void Motor_Command_Mux::publish(SOURCE source, const Eigen::Vector4f& command){
+    publish(source, command, _clock->now());
+}
+
+
+void Motor_Command_Mux::publish(SOURCE source, const Eigen::Vector4f& command, uint64_t now){
+    
+    Slot& slot = _slots[source];
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    
+    slot.sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    for (int i=0; i<4; i++){
+        slot.command[i].store(command[i], std::memory_order_relaxed);
+    }
+    // A lease that had run out starts a new streak : the switch latency counts from here
+    if (slot.expiry.load(std::memory_order_relaxed) <= now) slot.since.store(now, std::memory_order_relaxed);
+    slot.expiry.store(now + slot.lease, std::memory_order_relaxed);
+    
+    slot.sequence.store(sequence+2, std::memory_order_release);
+}
+
+
+void Motor_Command_Mux::release(SOURCE source){
+    Slot& slot = _slots[source];
+    uint64_t now = _clock->now();
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    
+    slot.sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.expiry.store(now, std::memory_order_relaxed);
+    slot.sequence.store(sequence+2, std::memory_order_release);
+}
+
+
+bool Motor_Command_Mux::_read(int source, Snapshot& snapshot){
+    
+    Slot& slot = _slots[source];
+    
+    for (int retry=0; retry<MAX_RETRIES; retry++){
+        uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        
+        Snapshot copy;
+        for (int i=0; i<4; i++){
+            copy.command[i] = slot.command[i].load(std::memory_order_relaxed);
+        }
+        copy.since = slot.since.load(std::memory_order_relaxed);
+        copy.expiry = slot.expiry.load(std::memory_order_relaxed);
+        
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before){
+            snapshot = copy;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int Motor_Command_Mux::select(Eigen::Vector4f& command){
+    
+    uint64_t now = _clock->now();
+    int selected = -1;
+    _stats.selections++;
+    
+    // Highest priority first : lower ones are not even read once a live one is found
+    for (int s=NB_SOURCES-1; s>=0 && selected < 0; s--){
+        if (!_read(s, _snapshots[s])) _stats.torn_reads++;
+        if (now < _snapshots[s].expiry) selected = s;
+    }
+    
+    if (selected != _active){
+        
+        // When the new source should have won : its lease started (preemption), or the active one ran out
+        uint64_t due;
+        if (selected > _active) due = _snapshots[selected].since;
+        else {
+            due = _snapshots[_active].expiry; // read this tick : it ranks above the selected one
+            if (selected >= 0 && _snapshots[selected].since > due) due = _snapshots[selected].since;
+        }
+        uint64_t latency = (now > due ? now - due : 0);
+        
+        if (latency > _stats.max_switch_latency) _stats.max_switch_latency = latency;
+        _stats.switches++;
+        if (_events != NULL) _events->push(Motor_Event::command_source_switch, MOTOR_EVENT_NO_MOTOR, selected, latency);
+        _active = selected;
+    }
+    
+    if (selected < 0){
+        _stats.idle++;
+        command.setZero();
+        return -1;
+    }
+    
+    for (int i=0; i<4; i++){
+        command[i] = _snapshots[selected].command[i];
+    }
+    return selected;
+}
+
+
+int Motor_Command_Mux::getActive() const {
+    return _active;
+}
+
+
+Motor_Command_Mux_Stats Motor_Command_Mux::getStats() const {
+    return _stats;
+}
+
+
+const char* Motor_Command_Mux::sourceName(int source){
+    switch (source) {
+        case source_autopilot : return "autopilot";
+        case source_ground_test : return "ground_test";
+        case source_manual : return "manual";
+        case source_failsafe : return "failsafe";
+        default : return "none";
+    }
+}
@@ -0,0 +1,156 @@
+//
+//  Motor_Command_Mux.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Command_Mux_hpp
+#define Motor_Command_Mux_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include "Motor_Io.hpp"
+#include "Motor_Event_Log.hpp"
+#include "/usr/local/include/Dense"
+
+
+
+/**
+ * \struct Motor_Command_Mux_Stats
+ * \brief Counters of a Motor_Command_Mux
+ */
+struct Motor_Command_Mux_Stats {
+    uint64_t selections;
+    uint64_t switches;
+    uint64_t idle; // selections without any live source : zero command
+    uint64_t torn_reads; // slot being written at every retry : its previous value was used
+    uint64_t max_switch_latency; // us, from the moment a source should have won to the tick it did
+};
+
+
+
+
+/**
+ * \class Motor_Command_Mux
+ * \brief Picks the command of the highest-priority live source at each tick
+ *
+ * Each source publishes into its own slot, from its own thread : a seqlock, no lock and no
+ * allocation on either side. A publish is a lease : the source stays live for its lease
+ * period, then it is ignored until it publishes again. select() runs on the motor thread and
+ * scans the slots from the highest priority down, with a bounded number of retries per slot,
+ * so it takes the same time whatever the publishers do. Without any live source the command
+ * is zero (motors stopped).
+ * Switches go to the event log as command_source_switch : value is the new source (-1 for
+ * none), limit the switch latency in us. The latency is at most one tick period.
+ */
+class Motor_Command_Mux {
+    
+public:
+    
+    /**
+     * \enum SOURCE
+     * \brief Command sources, by increasing priority
+     */
+    enum SOURCE {
+        source_autopilot=0,
+        source_ground_test=1,
+        source_manual=2, // RC override
+        source_failsafe=3,
+        NB_SOURCES=4
+    };
+    
+    enum { MAX_RETRIES = 4 };
+    
+    
+    /**
+     * \brief Constructor, leases from Config.hpp
+     *
+     * \param Motor_Clock* : time of the publishes and of the leases
+     * \param Motor_Event_Log* : where switches go, written by the selecting thread (may be NULL)
+     */
+    Motor_Command_Mux(Motor_Clock*, Motor_Event_Log* = NULL);
+    
+    
+    /**
+     * \brief Sets how long a source stays live after a publish, in us (before it publishes)
+     */
+    void setLease(SOURCE, uint64_t);
+    
+    
+    /**
+     * \brief Publisher side : new command of a source, renews its lease
+     *
+     * One publishing thread per source. Wait-free
+     */
+    void publish(SOURCE, const Eigen::Vector4f&);
+    
+    
+    /**
+     * \brief Publisher side : same, for a command produced earlier (e.g. read from another process)
+     *
+     * \param uint64_t : when the command was produced, in us on the mux clock : the lease runs from there
+     */
+    void publish(SOURCE, const Eigen::Vector4f&, uint64_t timestamp);
+    
+    
+    /**
+     * \brief Publisher side : gives up the lease now
+     */
+    void release(SOURCE);
+    
+    
+    /**
+     * \brief Motor thread : command of the highest-priority live source
+     *
+     * \param Eigen::Vector4f& : command, zero without live source
+     * \return the source, -1 if none
+     */
+    int select(Eigen::Vector4f&);
+    
+    
+    /**
+     * \brief Source picked by the last select(), -1 if none
+     */
+    int getActive() const;
+    
+    
+    Motor_Command_Mux_Stats getStats() const;
+    
+    
+    static const char* sourceName(int);
+    
+    
+private:
+    
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> sequence; // odd while being written
+        std::atomic<float> command[4];
+        std::atomic<uint64_t> since; // us, start of the current lease streak
+        std::atomic<uint64_t> expiry; // us, end of the lease or time of the release
+        uint64_t lease; // us
+    };
+    
+    // Reader-side copy of a slot
+    struct Snapshot {
+        float command[4];
+        uint64_t since;
+        uint64_t expiry;
+    };
+    
+    bool _read(int, Snapshot&);
+    
+    Motor_Clock* _clock;
+    Motor_Event_Log* _events;
+    
+    Slot _slots[NB_SOURCES];
+    Snapshot _snapshots[NB_SOURCES]; // motor thread only
+    
+    int _active;
+    Motor_Command_Mux_Stats _stats;
+};
+
+
+
+#endif /* Motor_Command_Mux_hpp */
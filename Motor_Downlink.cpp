@@ -0,0 +1,207 @@
+//
+//  Motor_Downlink.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Downlink.hpp"
+#include "Serial_Framer.hpp"
+#include "MaestroMotor.hpp"
+#include "navi_Estimator.hpp"
+#include <string.h>
+
+
+
+Motor_Downlink::Motor_Downlink(Motor_Output* output, Motor_Clock* clock, unsigned long baud_rate) : _output(output), _clock(clock),
+                                                _rate(baud_rate/10/1e6), _nb_streams(0),
+                                                _credit(0), _capacity(0), _charged(0), _last(0){
+    memset(_streams, 0, sizeof(_streams));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+int Motor_Downlink::addStream(uint8_t id, int priority, unsigned int divider, Producer producer, void* context, bool queued){
+    if (_nb_streams >= MAX_STREAMS || producer == NULL) return -1;
+    
+    int index = _nb_streams++;
+    Stream& stream = _streams[index];
+    stream.id = id;
+    stream.priority = priority;
+    stream.divider = (divider > 0 ? divider : 1);
+    stream.phase = index % stream.divider;
+    stream.producer = producer;
+    stream.context = context;
+    stream.queued = queued;
+    
+    // Insertion in the priority order, after the equal ones
+    int position = index;
+    while (position > 0 && _streams[_order[position-1]].priority < priority){
+        _order[position] = _order[position-1];
+        position--;
+    }
+    _order[position] = index;
+    return index;
+}
+
+
+void Motor_Downlink::charge(unsigned int bytes){
+    _charged += bytes;
+}
+
+
+bool Motor_Downlink::_produce(Stream& stream, uint64_t now){
+    
+    char raw[2+MAX_PAYLOAD];
+    unsigned int length = stream.producer(stream.context, raw+2, MAX_PAYLOAD);
+    if (length == 0 || length > MAX_PAYLOAD) return false;
+    
+    raw[0] = stream.id;
+    raw[1] = stream.sequence++;
+    stream.length = Serial_Framer::encode(Serial_Framer::cobs, raw, length+2, stream.packet, PACKET_SIZE);
+    
+    if (stream.pending) stream.stats.superseded++;
+    else stream.due = now;
+    stream.pending = true;
+    return true;
+}
+
+
+unsigned int Motor_Downlink::service(){
+    
+    if (_output == NULL || !_output->isOpen()) return 0;
+    
+    uint64_t now = _clock->now();
+    uint64_t elapsed = (_stats.slots > 0 && now > _last ? now - _last : 0);
+    _last = now;
+    
+    // Credit of this slot, less what the other writer used
+    double slot = elapsed*_rate;
+    double cap = (slot > PACKET_SIZE ? slot : (double)PACKET_SIZE);
+    _capacity += slot;
+    _credit += slot - _charged;
+    if (_credit > cap) _credit = cap;
+    _stats.shared += _charged;
+    _charged = 0;
+    
+    // Due streams produce. A queued stream keeps its unsent packet
+    for (unsigned int s=0; s<_nb_streams; s++){
+        Stream& stream = _streams[s];
+        if (_stats.slots % stream.divider != stream.phase) continue;
+        if (stream.queued && stream.pending) continue;
+        _produce(stream, now);
+    }
+    _stats.slots++;
+    
+    // Pack by priority while there is room : a packet that doesn't fit holds the lower ones
+    unsigned int used = 0;
+    bool blocked = false;
+    for (unsigned int k=0; k<_nb_streams; k++){
+        Stream& stream = _streams[_order[k]];
+        
+        while (stream.pending){
+            if (blocked || used + stream.length > _credit || used + stream.length > BATCH_SIZE){
+                stream.stats.deferred++;
+                blocked = true;
+                break;
+            }
+            memcpy(_batch+used, stream.packet, stream.length);
+            used += stream.length;
+            stream.pending = false;
+            
+            stream.stats.packets++;
+            stream.stats.bytes += stream.length;
+            if (now - stream.due > stream.stats.max_latency) stream.stats.max_latency = now - stream.due;
+            
+            // Queued : drain what is waiting, as long as it fits
+            if (!stream.queued || !_produce(stream, now)) break;
+        }
+    }
+    
+    if (used == 0) return 0;
+    
+    _credit -= used;
+    if (_output->write(_batch, used) < 0){
+        _stats.write_errors++;
+        return 0;
+    }
+    _stats.sent += used;
+    return used;
+}
+
+
+Motor_Downlink_Stats Motor_Downlink::getStats() const {
+    Motor_Downlink_Stats stats = _stats;
+    stats.capacity = (uint64_t)_capacity;
+    return stats;
+}
+
+
+Motor_Downlink_Stream_Stats Motor_Downlink::getStreamStats(int index) const {
+    return _streams[index].stats;
+}
+
+
+float Motor_Downlink::getUtilisation() const {
+    if (_capacity <= 0) return 0;
+    return (_stats.sent + _stats.shared)/_capacity;
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------//
+
+
+
+unsigned int Motor_Downlink::packState(void* context, char* payload, unsigned int size){
+    
+    navi_Estimate estimate = ((navi_Estimator*)context)->getEstimate();
+    if (size < 40 || estimate.timestamp == 0) return 0;
+    
+    uint32_t ms = (uint32_t)(estimate.timestamp/1000);
+    float values[9];
+    for (int i=0; i<3; i++){
+        values[i] = estimate.position(i);
+        values[3+i] = estimate.velocity(i);
+        values[6+i] = estimate.attitude(i);
+    }
+    memcpy(payload, &ms, 4);
+    memcpy(payload+4, values, sizeof(values));
+    return 40;
+}
+
+
+unsigned int Motor_Downlink::packMotors(void* context, char* payload, unsigned int size){
+    
+    MaestroMotor* maestro = (MaestroMotor*)context;
+    if (size < 28) return 0;
+    
+    // Same time base as packState (the estimator runs on the injected clock too)
+    uint32_t ms = (uint32_t)(maestro->getClock()->now()/1000);
+    uint16_t pulses[4];
+    maestro->getServoOut(pulses);
+    Eigen::Vector4f speed = maestro->getMotorSpeed();
+    float speeds[4] = {speed[0], speed[1], speed[2], speed[3]};
+    
+    memcpy(payload, &ms, 4);
+    memcpy(payload+4, pulses, sizeof(pulses));
+    memcpy(payload+12, speeds, sizeof(speeds));
+    return 28;
+}
+
+
+unsigned int Motor_Downlink::packEvent(void* context, char* payload, unsigned int size){
+    
+    Motor_Event event;
+    if (size < sizeof(Motor_Event) || ((Motor_Event_Log*)context)->pop(&event, 1) == 0) return 0;
+    memcpy(payload, &event, sizeof(Motor_Event));
+    return sizeof(Motor_Event);
+}
+
+
+unsigned int Motor_Downlink::packBattery(void* context, char* payload, unsigned int size){
+    if (size < 1) return 0;
+    payload[0] = ((navi_State*)context)->get_battery_state();
+    return 1;
+}
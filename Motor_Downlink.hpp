@@ -0,0 +1,185 @@
+//
+//  Motor_Downlink.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Downlink_hpp
+#define Motor_Downlink_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Motor_Io.hpp"
+
+
+
+/**
+ * \struct Motor_Downlink_Stream_Stats
+ * \brief Counters of a downlink stream
+ */
+struct Motor_Downlink_Stream_Stats {
+    uint64_t packets; // sent
+    uint64_t bytes; // sent, framing included
+    uint64_t deferred; // slots it was waiting for room on the link
+    uint64_t superseded; // snapshots replaced by a newer one before being sent
+    uint64_t max_latency; // us, from being due to being written
+};
+
+
+/**
+ * \struct Motor_Downlink_Stats
+ * \brief Counters of a Motor_Downlink
+ */
+struct Motor_Downlink_Stats {
+    uint64_t slots;
+    uint64_t capacity; // bytes the link could carry since the first slot
+    uint64_t sent; // bytes of the downlink
+    uint64_t shared; // bytes charged by the other writer of the link (PWM frames)
+    uint64_t write_errors; // batches the output refused, their packets are lost
+};
+
+
+
+
+/**
+ * \class Motor_Downlink
+ * \brief Telemetry downlink : multi-rate streams packed onto one serial link
+ *
+ * Each stream has a packet id, a priority and a rate divider, in slots (a slot is a
+ * service() call, once per tick in Motor_Pipeline). A producer callback fills the payload :
+ * - snapshot streams are produced when due, and a snapshot still unsent is replaced by the newer one
+ * - queued streams (events) are produced when due and drained while the link has room ; nothing is replaced
+ * Packets are COBS frames (Serial_Framer::cobs) of : id, per-stream sequence, payload.
+ * Every slot, the due packets go out in one write, by decreasing priority, as long as the link
+ * credit allows : the credit grows with the baud rate and is charged with what the other writer
+ * of a shared link sent (the PWM frames). It is capped to a slot of bytes (or one packet on a
+ * slow link), so the next PWM frame never waits behind more telemetry than that. A packet that
+ * doesn't fit waits, and so do the lower priorities.
+ * Single thread (the motor loop). No allocation.
+ */
+class Motor_Downlink {
+    
+public:
+    
+    enum { MAX_STREAMS = 8, MAX_PAYLOAD = 48, PACKET_SIZE = 64, BATCH_SIZE = 1024 };
+    
+    /**
+     * \enum PACKET_ID
+     * \brief Packet ids of the built-in producers
+     */
+    enum PACKET_ID {
+        packet_state=1,
+        packet_motors=2,
+        packet_event=3,
+        packet_battery=4
+    };
+    
+    /**
+     * \brief Fills a payload
+     *
+     * \param void* : context, char* : payload, unsigned int : its size (MAX_PAYLOAD)
+     * \return payload length, 0 if there is nothing to send
+     */
+    typedef unsigned int (*Producer)(void* context, char*, unsigned int);
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param Motor_Output* : the link, must outlive the instance (e.g. a Motor_Loop_Output)
+     * \param Motor_Clock* : time of the slots, unsigned long : baud rate (10 bits a byte)
+     */
+    Motor_Downlink(Motor_Output*, Motor_Clock*, unsigned long baud_rate);
+    
+    
+    /**
+     * \brief Adds a stream. Streams of the same priority go in the order they were added
+     *
+     * \param uint8_t : packet id, int : priority (highest first), unsigned int : divider in slots
+     * \param Producer, void* : its context, bool : queued (see above)
+     * \return index of the stream, -1 if MAX_STREAMS are taken
+     */
+    int addStream(uint8_t id, int priority, unsigned int divider, Producer, void*, bool queued = false);
+    
+    
+    /**
+     * \brief Bytes written on the link by its other writer since the last slot
+     */
+    void charge(unsigned int);
+    
+    
+    /**
+     * \brief Runs a slot : produces the due packets and writes those the link has room for
+     *
+     * \return bytes written
+     */
+    unsigned int service();
+    
+    
+    Motor_Downlink_Stats getStats() const;
+    Motor_Downlink_Stream_Stats getStreamStats(int) const;
+    
+    
+    /**
+     * \brief Share of the link capacity used since the first slot, PWM frames included
+     */
+    float getUtilisation() const;
+    
+    
+    /**
+     * \brief Built-in producers, payloads in host byte order
+     *
+     * - packState (navi_Estimator*) : uint32 ms, position, velocity, attitude as 9 floats
+     * - packMotors (MaestroMotor*) : uint32 ms, 4 uint16 PWM pulses (us), 4 float speeds (rd/s)
+     * - packEvent (Motor_Event_Log*, queued, see Motor_Event_Drainer::forward) : one Motor_Event
+     * - packBattery (navi_State*) : uint8 percentage
+     */
+    static unsigned int packState(void*, char*, unsigned int);
+    static unsigned int packMotors(void*, char*, unsigned int);
+    static unsigned int packEvent(void*, char*, unsigned int);
+    static unsigned int packBattery(void*, char*, unsigned int);
+    
+    
+private:
+    
+    struct Stream {
+        uint8_t id;
+        int priority;
+        unsigned int divider;
+        unsigned int phase; // due at the slots equal to it modulo divider : spreads the streams
+        Producer producer;
+        void* context;
+        bool queued;
+        
+        uint8_t sequence;
+        bool pending;
+        uint64_t due; // us
+        char packet[PACKET_SIZE];
+        unsigned int length;
+        
+        Motor_Downlink_Stream_Stats stats;
+    };
+    
+    bool _produce(Stream&, uint64_t now);
+    
+    Motor_Output* _output;
+    Motor_Clock* _clock;
+    double _rate; // bytes a us
+    
+    Stream _streams[MAX_STREAMS];
+    int _order[MAX_STREAMS]; // by decreasing priority
+    unsigned int _nb_streams;
+    
+    double _credit; // bytes, negative after a burst of the other writer
+    double _capacity;
+    unsigned int _charged;
+    uint64_t _last; // us, time of the last slot
+    
+    char _batch[BATCH_SIZE];
+    Motor_Downlink_Stats _stats;
+};
+
+
+
+#endif /* Motor_Downlink_hpp */
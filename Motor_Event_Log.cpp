@@ -0,0 +1,222 @@
+//
+//  Motor_Event_Log.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Event_Log.hpp"
+#include <unistd.h>
+#include <string.h>
+
+
+
+const char* Motor_Event::typeName(uint8_t type){
+    switch (type) {
+        case speed_saturation_low : return "speed_saturation_low";
+        case speed_saturation_high : return "speed_saturation_high";
+        case acceleration_saturation : return "acceleration_saturation";
+        case pwm_out_of_range : return "pwm_out_of_range";
+        case serial_write_error : return "serial_write_error";
+        case readback_mismatch : return "readback_mismatch";
+        case device_error : return "device_error";
+        case readback_timeout : return "readback_timeout";
+        case command_source_switch : return "command_source_switch";
+        case rate_change : return "rate_change";
+        default : return "other";
+    }
+}
+
+
+int Motor_Event::format(char* buffer, size_t size) const {
+    if (motor_index == MOTOR_EVENT_NO_MOTOR){
+        return snprintf(buffer, size, "%llu.%09llu #%u %s : value %g limit %g",
+                        (unsigned long long)(timestamp/1000000000ULL), (unsigned long long)(timestamp%1000000000ULL),
+                        sequence, typeName(type), value, limit);
+    }
+    return snprintf(buffer, size, "%llu.%09llu #%u %s : motor %u value %g limit %g",
+                    (unsigned long long)(timestamp/1000000000ULL), (unsigned long long)(timestamp%1000000000ULL),
+                    sequence, typeName(type), motor_index, value, limit);
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------//
+
+
+
+Motor_Event_Log::Motor_Event_Log(uint8_t source) : _head(0), _sequence(0), _source(source), _dropped(0), _tail(0){
+    memset(_ring, 0, sizeof(_ring));
+}
+
+
+bool Motor_Event_Log::push(Motor_Event::EVENT_TYPE type, uint8_t motor_index, float value, float limit){
+    
+    uint32_t sequence = _sequence++; // consumed even if dropped, so gaps show in the file
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    
+    if (head - _tail.load(std::memory_order_acquire) >= CAPACITY){
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    Motor_Event& event = _ring[head & (CAPACITY-1)];
+    event.timestamp = now();
+    event.sequence = sequence;
+    event.type = type;
+    event.motor_index = motor_index;
+    event.source = _source;
+    event.reserved = 0;
+    event.value = value;
+    event.limit = limit;
+    
+    _head.store(head+1, std::memory_order_release);
+    return true;
+}
+
+
+bool Motor_Event_Log::relay(const Motor_Event& event){
+    
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    
+    if (head - _tail.load(std::memory_order_acquire) >= CAPACITY){
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    _ring[head & (CAPACITY-1)] = event;
+    _head.store(head+1, std::memory_order_release);
+    return true;
+}
+
+
+unsigned int Motor_Event_Log::pop(Motor_Event* events, unsigned int max){
+    
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t available = _head.load(std::memory_order_acquire) - tail;
+    unsigned int count = (available < max ? available : max);
+    
+    for (unsigned int i=0; i<count; i++){
+        events[i] = _ring[(tail+i) & (CAPACITY-1)];
+    }
+    
+    _tail.store(tail+count, std::memory_order_release);
+    return count;
+}
+
+
+uint32_t Motor_Event_Log::getDropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Motor_Event_Log::now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------//
+
+
+
+Motor_Event_Drainer::Motor_Event_Drainer(const char* path, unsigned int period_ms) : _nb_logs(0), _forward(NULL), _path(path), _file(NULL), _period_ms(period_ms), _running(false){
+}
+
+
+Motor_Event_Drainer::~Motor_Event_Drainer(){
+    stop();
+}
+
+
+bool Motor_Event_Drainer::attach(Motor_Event_Log* log){
+    if (_nb_logs >= MAX_LOGS) return false;
+    _logs[_nb_logs++] = log;
+    return true;
+}
+
+
+void Motor_Event_Drainer::forward(Motor_Event_Log* log){
+    _forward = log;
+}
+
+
+bool Motor_Event_Drainer::start(){
+    
+    if (_path != NULL){
+        _file = fopen(_path, "wb");
+        if (_file == NULL) return false;
+        
+        Motor_Event_File_Header header;
+        memcpy(header.magic, MOTOR_EVENT_MAGIC, 4);
+        header.format_version = MOTOR_EVENT_FORMAT_VERSION;
+        header.record_size = sizeof(Motor_Event);
+        fwrite(&header, sizeof(header), 1, _file);
+    }
+    
+    _running.store(true);
+    if (pthread_create(&_thread, NULL, &Motor_Event_Drainer::_run, this) != 0){
+        _running.store(false);
+        return false;
+    }
+    return true;
+}
+
+
+void Motor_Event_Drainer::stop(){
+    if (_running.exchange(false)){
+        pthread_join(_thread, NULL);
+    }
+    if (_file != NULL){
+        fclose(_file);
+        _file = NULL;
+    }
+}
+
+
+unsigned int Motor_Event_Drainer::drain(){
+    
+    unsigned int total = 0;
+    char line[160];
+    
+    for (unsigned int i=0; i<_nb_logs; i++){
+        unsigned int count;
+        while ((count = _logs[i]->pop(_batch, sizeof(_batch)/sizeof(_batch[0]))) > 0){
+            if (_file != NULL){
+                fwrite(_batch, sizeof(Motor_Event), count, _file);
+            }
+            else {
+                for (unsigned int j=0; j<count; j++){
+                    _batch[j].format(line, sizeof(line));
+                    puts(line);
+                }
+            }
+            if (_forward != NULL){
+                for (unsigned int j=0; j<count; j++){
+                    _forward->relay(_batch[j]);
+                }
+            }
+            total += count;
+        }
+    }
+    
+    if (_file != NULL && total > 0) fflush(_file);
+    return total;
+}
+
+
+void* Motor_Event_Drainer::_run(void* arg){
+    Motor_Event_Drainer* drainer = (Motor_Event_Drainer*)arg;
+    
+    while (drainer->_running.load()){
+        drainer->drain();
+        usleep(1000*drainer->_period_ms);
+    }
+    
+    drainer->drain();
+    return NULL;
+}
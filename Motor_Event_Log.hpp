@@ -0,0 +1,250 @@
+//
+//  Motor_Event_Log.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Event_Log_hpp
+#define Motor_Event_Log_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+
+
+
+/**
+ * \struct Motor_Event
+ * \brief Fixed-size binary fault/event record (24 bytes, also the on-disk format)
+ */
+struct Motor_Event {
+    
+    /**
+     * \enum EVENT_TYPE
+     * \brief Kind of event. Values are part of the file format : only append
+     */
+    enum EVENT_TYPE {
+        speed_saturation_low=1,
+        speed_saturation_high=2,
+        acceleration_saturation=3,
+        pwm_out_of_range=4,
+        serial_write_error=5,
+        readback_mismatch=6, // value : position read, limit : target sent (us)
+        device_error=7, // value : Maestro error bits
+        readback_timeout=8, // value : queries dropped, limit : timeout in ticks
+        command_source_switch=9, // value : new command source (-1 : none), limit : switch latency in us
+        rate_change=10, // value : new tick period, limit : previous one (us)
+        other=255
+    };
+    
+    uint64_t timestamp; // ns, CLOCK_MONOTONIC
+    uint32_t sequence; // per log, gaps mean dropped events
+    uint8_t type; // EVENT_TYPE
+    uint8_t motor_index; // 0xFF when not motor related
+    uint8_t source; // id of the log it was pushed to
+    uint8_t reserved;
+    float value; // offending value
+    float limit; // limit it was checked against
+    
+    
+    /**
+     * \brief Returns a readable name for an EVENT_TYPE
+     */
+    static const char* typeName(uint8_t);
+    
+    
+    /**
+     * \brief Formats the event as a single text line (no allocation)
+     *
+     * \param char* : output buffer, size_t : its size
+     * \return number of chars written, as snprintf
+     */
+    int format(char*, size_t) const;
+};
+
+
+/**
+ * \struct Motor_Event_File_Header
+ * \brief Header written once at the beginning of a binary event file
+ */
+struct Motor_Event_File_Header {
+    char magic[4]; // "MMEV"
+    uint16_t format_version;
+    uint16_t record_size; // sizeof(Motor_Event)
+};
+
+#define MOTOR_EVENT_MAGIC "MMEV"
+#define MOTOR_EVENT_FORMAT_VERSION 1
+#define MOTOR_EVENT_NO_MOTOR 0xFF
+
+
+
+
+/**
+ * \class Motor_Event_Log
+ * \brief Preallocated single-producer/single-consumer ring of Motor_Event
+ *
+ * push() is wait-free and never allocates : when the ring is full the event is dropped and counted.
+ * Each producing thread owns its own log ; the consumer is a Motor_Event_Drainer.
+ */
+class Motor_Event_Log {
+    
+public:
+    
+    enum { CAPACITY = 1024 }; // must be a power of 2
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param uint8_t : source id written in each event, to tell logs apart once drained together
+     */
+    Motor_Event_Log(uint8_t source = 0);
+    
+    
+    /**
+     * \brief Producer side : records an event
+     *
+     * \param EVENT_TYPE, motor index, offending value, limit
+     * \return false if the ring was full (event dropped)
+     */
+    bool push(Motor_Event::EVENT_TYPE, uint8_t, float, float);
+    
+    
+    /**
+     * \brief Producer side : records a copy of an event drained from another log
+     *
+     * Timestamp, sequence and source are kept : gaps still tell the events lost at the origin
+     * \return false if the ring was full (event dropped)
+     */
+    bool relay(const Motor_Event&);
+    
+    
+    /**
+     * \brief Consumer side : pops up to max events
+     *
+     * \param Motor_Event* : output array, unsigned int : its size
+     * \return number of events popped
+     */
+    unsigned int pop(Motor_Event*, unsigned int);
+    
+    
+    /**
+     * \brief Returns the number of events dropped since construction
+     */
+    uint32_t getDropped() const;
+    
+    
+    /**
+     * \brief Monotonic timestamp in ns, served by the vDSO (no syscall)
+     */
+    static uint64_t now();
+    
+    
+private:
+    
+    Motor_Event _ring[CAPACITY];
+    
+    std::atomic<uint32_t> _head; // written by producer
+    uint32_t _sequence; // producer only
+    uint8_t _source;
+    std::atomic<uint32_t> _dropped;
+    char _pad[64]; // keeps the consumer index off the producer cache line
+    std::atomic<uint32_t> _tail; // written by consumer
+    
+};
+
+
+
+
+/**
+ * \class Motor_Event_Drainer
+ * \brief Background thread draining Motor_Event_Log rings
+ *
+ * Events are appended to a binary file (see tools/event_log_decode.cpp) or,
+ * when no file is given, formatted on stdout.
+ */
+class Motor_Event_Drainer {
+    
+public:
+    
+    enum { MAX_LOGS = 8 };
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param const char* : binary output file, NULL for text on stdout
+     * \param unsigned int : drain period in ms
+     */
+    Motor_Event_Drainer(const char* path = NULL, unsigned int period_ms = 50);
+    
+    
+    /**
+     * \brief Destructor (stops the thread, drains remaining events and closes the file)
+     */
+    ~Motor_Event_Drainer();
+    
+    
+    /**
+     * \brief Registers a log to drain. Must be called before start()
+     *
+     * \return false if MAX_LOGS are already attached
+     */
+    bool attach(Motor_Event_Log*);
+    
+    
+    /**
+     * \brief Relays every drained event to a log read by another consumer (e.g. Motor_Downlink).
+     * Must be called before start()
+     */
+    void forward(Motor_Event_Log*);
+    
+    
+    /**
+     * \brief Starts the drain thread
+     *
+     * \return false if the output file couldn't be opened or the thread created
+     */
+    bool start();
+    
+    
+    /**
+     * \brief Stops the drain thread after a last drain
+     */
+    void stop();
+    
+    
+    /**
+     * \brief Drains all attached logs once
+     *
+     * \return number of events drained
+     */
+    unsigned int drain();
+    
+    
+private:
+    
+    static void* _run(void*);
+    
+    Motor_Event_Log* _logs[MAX_LOGS];
+    unsigned int _nb_logs;
+    Motor_Event_Log* _forward;
+    
+    const char* _path;
+    FILE* _file;
+    unsigned int _period_ms;
+    
+    pthread_t _thread;
+    std::atomic<bool> _running;
+    
+    Motor_Event _batch[64];
+    
+};
+
+
+
+#endif /* Motor_Event_Log_hpp */
@@ -8,39 +8,58 @@
 
 #include "Motor_Exception.hpp"
 
-Motor_Exception::Motor_Exception() {
+Motor_Exception::Motor_Exception() : _error_type(other), _motor_index(0) {
+    _what[0] = 0;
 }
 
 
-Motor_Exception::Motor_Exception(ERROR_TYPE error_type,std::string msg, int motor_index) : _msg(msg), _error_type(error_type), _motor_index(motor_index){
-}
-
-
-const char * Motor_Exception::what() const throw() {
+Motor_Exception::Motor_Exception(ERROR_TYPE error_type,const char* msg, int motor_index) : _error_type(error_type), _motor_index(motor_index){
     
-    std::string foo = "Motor Exception --> ";
+    const char* type;
     switch (_error_type) {
             
         case speed_saturation : {
-            foo += "Speed too high Error : ";
+            type = "Speed too high Error : ";
             break;
         }
         case acceleration_saturation : {
-            foo += "Too much saturation Error : ";
+            type = "Too much saturation Error : ";
             break;
         }
         default : {
-            foo += "System Error : ";
+            type = "System Error : ";
         }
     }
     
-    foo += _msg;
-    foo += _motor_index;
-    foo += '\n';
-    const char * result = foo.c_str();
-    return result;
+    snprintf(_what, sizeof(_what), "Motor Exception --> %s%s %d\n", type, msg, _motor_index);
 }
 
 
+const char * Motor_Exception::what() const throw() {
+    return _what;
+}
+
+
+#ifndef MAESTRO_EMBEDDED
 Motor_Exception::~Motor_Exception() _NOEXCEPT {
-}
\ No newline at end of file
+}
+#endif
+
+
+
+// Trivially destructible in the embedded profile : no thread exit handler to register
+static thread_local Motor_Exception _last_error;
+static thread_local bool _last_pending = false;
+
+
+void Motor_Exception::raise(const Motor_Exception& exception){
+    _last_error = exception;
+    _last_pending = true;
+}
+
+
+const Motor_Exception* Motor_Exception::takeLast(){
+    if (!_last_pending) return NULL;
+    _last_pending = false;
+    return &_last_error;
+}
@@ -11,9 +11,30 @@
 
 #include <stdio.h>
 #include <exception>
-#include <string>
+#include "Maestro_Profile.hpp"
 
+
+// Raising a Motor_Exception : thrown, or in the embedded profile kept as the last error of
+// the thread and the raising function returns. MOTOR_CATCH then tests for it
+#ifdef MAESTRO_EMBEDDED
+#define MOTOR_THROWS
+#define MOTOR_RAISE(type, message, index) do { Motor_Exception::raise(Motor_Exception(type, message, index)); return; } while (0)
+#define MOTOR_TRY if (true)
+#define MOTOR_CATCH if (Motor_Exception::takeLast() != NULL)
+#else
+#define MOTOR_THROWS throw(Motor_Exception)
+#define MOTOR_RAISE(type, message, index) throw Motor_Exception(type, message, index)
+#define MOTOR_TRY try
+#define MOTOR_CATCH catch (const Motor_Exception&)
+#endif
+
+
+// Embedded profile : no std::exception base, nothing from libstdc++
+#ifndef MAESTRO_EMBEDDED
 class Motor_Exception : public std::exception {
+#else
+class Motor_Exception {
+#endif
     
 public:
     
@@ -27,19 +48,28 @@ public:
     Motor_Exception();
     
     // #Motors1
-    Motor_Exception(ERROR_TYPE,std::string,int);
+    // Message is formatted once here : what() only returns it
+    Motor_Exception(ERROR_TYPE,const char*,int);
     
     // #Motors1
     virtual char const * what() const throw();
     
+#ifndef MAESTRO_EMBEDDED
     // #Motors1
     ~Motor_Exception() _NOEXCEPT;
+#endif
+    
+    // Embedded profile : last error of the calling thread, instead of a throw
+    static void raise(const Motor_Exception&);
+    
+    // Returns the last error raised by the calling thread and clears it, NULL if none
+    static const Motor_Exception* takeLast();
     
 private:
     
     ERROR_TYPE _error_type;
-    std::string _msg;
     int _motor_index;
+    char _what[128];
     
 };
 
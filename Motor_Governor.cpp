@@ -0,0 +1,130 @@
+//
+//  Motor_Governor.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Governor.hpp"
+#include "Config.hpp"
+#include <string.h>
+
+
+
+static const uint32_t LADDER[] = GOVERNOR_LADDER;
+
+
+
+Motor_Governor::Motor_Governor(uint32_t period_us, Motor_Event_Log* events) : _events(events){
+    memset(&_stats, 0, sizeof(_stats));
+    setNominalPeriod(period_us);
+}
+
+
+void Motor_Governor::setNominalPeriod(uint32_t period_us){
+    _ladder[0] = period_us;
+    _rungs = 1;
+    for (unsigned int i=0; i<sizeof(LADDER)/sizeof(LADDER[0]) && _rungs < MAX_RUNGS; i++){
+        if (LADDER[i] > _ladder[_rungs-1]) _ladder[_rungs++] = LADDER[i];
+    }
+    reset();
+}
+
+
+void Motor_Governor::reset(){
+    _level = 0;
+    _headroom = 0;
+    _late_windows = 0;
+    _hold = GOVERNOR_HOLD;
+    _dwell = 0;
+    _last_step = 0;
+    _reset_window(0);
+}
+
+
+void Motor_Governor::_reset_window(uint64_t start){
+    _window_start = start;
+    _last_start = 0;
+    _busy = 0;
+    _ticks = 0;
+    _late = 0;
+}
+
+
+bool Motor_Governor::observe(uint64_t start, uint64_t duration){
+    
+    uint64_t period = _ladder[_level];
+    
+    if (_window_start == 0) _window_start = start;
+    if (_last_start != 0 && start - _last_start > period + period/4) _late++;
+    _last_start = start;
+    _busy += duration;
+    _ticks++;
+    
+    if (start - _window_start < GOVERNOR_WINDOW) return false;
+    
+    // End of the window
+    float load = _busy/(1000.f*period*_ticks);
+    bool late = (_late > GOVERNOR_LATE_RATIO*_ticks);
+    _late_windows = (late ? _late_windows+1 : 0);
+    _stats.windows++;
+    _stats.late_ticks += _late;
+    _stats.last_load = load;
+    if (load > _stats.max_load) _stats.max_load = load;
+    _dwell++;
+    
+    // Late ticks in one window can be a stall of the system ; in two in a row, the CPU is taken
+    if ((load > GOVERNOR_HIGH_LOAD || _late_windows >= 2) && _level+1 < _rungs){
+        // The last step up didn't hold : wait longer before the next one
+        if (_last_step < 0 && _dwell <= _hold && _hold < 32*GOVERNOR_HOLD) _hold *= 2;
+        _step(1);
+        _reset_window(start);
+        return true;
+    }
+    
+    // Headroom : what the load would be at the shorter period
+    if (_level > 0 && !late && load*period < GOVERNOR_LOW_LOAD*_ladder[_level-1]) _headroom++;
+    else _headroom = 0;
+    
+    // A step up that held : the hold shrinks back
+    if (_last_step < 0 && _dwell == _hold && _hold > GOVERNOR_HOLD) _hold /= 2;
+    if (_level == 0 && _dwell >= GOVERNOR_HOLD) _hold = GOVERNOR_HOLD;
+    
+    if (_headroom >= _hold){
+        _step(-1);
+        _reset_window(start);
+        return true;
+    }
+    
+    _reset_window(start);
+    _last_start = start;
+    return false;
+}
+
+
+void Motor_Governor::_step(int direction){
+    uint32_t previous = _ladder[_level];
+    _level += direction;
+    _headroom = 0;
+    _late_windows = 0;
+    _dwell = 0;
+    _last_step = direction;
+    if (direction > 0) _stats.steps_down++;
+    else _stats.steps_up++;
+    if (_events != NULL) _events->push(Motor_Event::rate_change, MOTOR_EVENT_NO_MOTOR, _ladder[_level], previous);
+}
+
+
+uint32_t Motor_Governor::getPeriod() const {
+    return _ladder[_level];
+}
+
+
+unsigned int Motor_Governor::getLevel() const {
+    return _level;
+}
+
+
+Motor_Governor_Stats Motor_Governor::getStats() const {
+    return _stats;
+}
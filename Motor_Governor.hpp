@@ -0,0 +1,130 @@
+//
+//  Motor_Governor.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Governor_hpp
+#define Motor_Governor_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Motor_Event_Log.hpp"
+
+
+
+/**
+ * \struct Motor_Governor_Stats
+ * \brief Counters of a Motor_Governor
+ */
+struct Motor_Governor_Stats {
+    uint64_t windows; // evaluated
+    uint64_t steps_down; // to a longer period
+    uint64_t steps_up; // back to a shorter one
+    uint64_t late_ticks; // started more than a quarter of a period late
+    float last_load; // mean tick time / period, over the last window
+    float max_load;
+};
+
+
+
+
+/**
+ * \class Motor_Governor
+ * \brief Overload governor : steps the tick period along a ladder
+ *
+ * It is handed the start time and the duration of every tick. Over each window (GOVERNOR_WINDOW)
+ * it computes the load, mean tick time over the period, and the share of late ticks (started a
+ * quarter of a period late : the CPU is taken by someone else). Overloaded (load above
+ * GOVERNOR_HIGH_LOAD, or too many late ticks in two windows in a row) : one rung down to the
+ * next longer period. With headroom for GOVERNOR_HOLD windows in a row (no late ticks, and the
+ * load would stay below GOVERNOR_LOW_LOAD at the shorter period) : one rung back up. The gap
+ * between the two thresholds keeps it from flapping, and so does the hold, doubled each time a
+ * step up has to be undone right away, halved each time one holds.
+ * The ladder is the nominal period, then the GOVERNOR_LADDER periods longer than it : it never
+ * ticks faster than asked. Transitions go to the event log as rate_change (value : new period,
+ * limit : previous period, in us).
+ * The ticking thread only. No allocation.
+ */
+class Motor_Governor {
+    
+public:
+    
+    enum { MAX_RUNGS = 8 };
+    
+    
+    /**
+     * \brief Constructor, ladder and thresholds from Config.hpp
+     *
+     * \param uint32_t : nominal (shortest) period in us, Motor_Event_Log* : where transitions go (may be NULL)
+     */
+    Motor_Governor(uint32_t period_us, Motor_Event_Log* = NULL);
+    
+    
+    /**
+     * \brief Sets the nominal period : rebuilds the ladder and goes back to its first rung
+     */
+    void setNominalPeriod(uint32_t period_us);
+    
+    
+    /**
+     * \brief Back to the nominal period, without logging it
+     */
+    void reset();
+    
+    
+    /**
+     * \brief Accounts a tick
+     *
+     * \param uint64_t : start of the tick in us, uint64_t : its duration in ns
+     * \return true if the period changed (see getPeriod())
+     */
+    bool observe(uint64_t start, uint64_t duration);
+    
+    
+    /**
+     * \brief Period to tick at, in us
+     */
+    uint32_t getPeriod() const;
+    
+    
+    /**
+     * \brief Rung of the ladder, 0 for the nominal period
+     */
+    unsigned int getLevel() const;
+    
+    
+    Motor_Governor_Stats getStats() const;
+    
+    
+private:
+    
+    void _step(int);
+    void _reset_window(uint64_t);
+    
+    Motor_Event_Log* _events;
+    
+    uint32_t _ladder[MAX_RUNGS];
+    unsigned int _rungs;
+    unsigned int _level;
+    
+    // Current window
+    uint64_t _window_start; // us, 0 : starts at the next tick
+    uint64_t _last_start; // us, 0 : no interval to check yet
+    uint64_t _busy; // ns
+    uint32_t _ticks;
+    uint32_t _late;
+    unsigned int _headroom; // windows in a row
+    unsigned int _late_windows; // in a row
+    
+    unsigned int _hold; // windows of headroom to step up
+    unsigned int _dwell; // windows at the current rung
+    int _last_step;
+    
+    Motor_Governor_Stats _stats;
+};
+
+
+
+#endif /* Motor_Governor_hpp */
@@ -0,0 +1,101 @@
+//
+//  Motor_Io.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Io_hpp
+#define Motor_Io_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+/**
+ * \class Motor_Clock
+ * \brief Time source used by MaestroMotor for its waits
+ */
+class Motor_Clock {
+    
+public:
+    
+    /**
+     * \brief Returns the current time in us
+     */
+    virtual uint64_t now() = 0;
+    
+    /**
+     * \brief Waits for the given number of us
+     */
+    virtual void sleep(uint64_t) = 0;
+    
+protected:
+    
+    // Never deleted through the interface : no virtual destructor, nor operator delete to link
+    ~Motor_Clock() {}
+};
+
+
+
+/**
+ * \class Motor_System_Clock
+ * \brief Monotonic clock and real sleeps (default)
+ */
+class Motor_System_Clock : public Motor_Clock {
+    
+public:
+    
+    uint64_t now(){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+    }
+    
+    void sleep(uint64_t us){
+        usleep(us);
+    }
+};
+
+
+
+/**
+ * \class Motor_Output
+ * \brief Destination of the PWM frames, replacing the servo port (e.g. for simulation)
+ */
+class Motor_Output {
+    
+public:
+    
+    /**
+     * \brief Returns true if frames can be written
+     */
+    virtual bool isOpen() = 0;
+    
+    /**
+     * \brief Writes a frame
+     *
+     * \param const char* : frame, unsigned int : length
+     * \return 1 if success, -1 if not (as Serial::write_bytes)
+     */
+    virtual int write(const char*, unsigned int) = 0;
+    
+    /**
+     * \brief Reads what the device sent back, without blocking
+     *
+     * \param char* : buffer, unsigned int : its size
+     * \return number of bytes read, 0 if none (default : write-only output)
+     */
+    virtual int read(char*, unsigned int) { return 0; }
+    
+protected:
+    
+    ~Motor_Output() {}
+};
+
+
+
+#endif /* Motor_Io_hpp */
@@ -0,0 +1,191 @@
+//
+//  Motor_Loop.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Loop.hpp"
+#include "Motor_Event_Log.hpp"
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+
+
+
+Motor_Loop::Motor_Loop() : _running(true) {
+    memset(_sources, 0, sizeof(_sources));
+    memset(&_stats, 0, sizeof(_stats));
+    
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    _wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wake >= 0) watch(_wake, EPOLLIN, &Motor_Loop::_on_wake, this);
+}
+
+
+Motor_Loop::~Motor_Loop(){
+    for (int i=0; i<MAX_SOURCES; i++){
+        if (_sources[i].used && _sources[i].timer) close(_sources[i].fd);
+    }
+    if (_wake >= 0) close(_wake);
+    if (_epoll >= 0) close(_epoll);
+}
+
+
+bool Motor_Loop::isValid() const {
+    return _epoll >= 0 && _wake >= 0;
+}
+
+
+int Motor_Loop::watch(int fd, uint32_t events, Handler handler, void* context){
+    
+    if (_epoll < 0 || fd < 0 || handler == NULL) return -1;
+    
+    for (int i=0; i<MAX_SOURCES; i++){
+        if (_sources[i].used) continue;
+        
+        struct epoll_event event;
+        event.events = events;
+        event.data.u32 = i;
+        if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) < 0) return -1;
+        
+        _sources[i].fd = fd;
+        _sources[i].handler = handler;
+        _sources[i].context = context;
+        _sources[i].used = true;
+        _sources[i].timer = false;
+        return i;
+    }
+    return -1;
+}
+
+
+bool Motor_Loop::modify(int id, uint32_t events){
+    if (id < 0 || id >= MAX_SOURCES || !_sources[id].used) return false;
+    
+    struct epoll_event event;
+    event.events = events;
+    event.data.u32 = id;
+    return epoll_ctl(_epoll, EPOLL_CTL_MOD, _sources[id].fd, &event) == 0;
+}
+
+
+void Motor_Loop::unwatch(int id){
+    if (id < 0 || id >= MAX_SOURCES || !_sources[id].used) return;
+    
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, _sources[id].fd, NULL);
+    if (_sources[id].timer) close(_sources[id].fd);
+    _sources[id].used = false;
+}
+
+
+int Motor_Loop::addTimer(uint64_t period_us, Handler handler, void* context){
+    
+    if (period_us == 0) return -1;
+    
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = period_us/1000000;
+    spec.it_interval.tv_nsec = (period_us%1000000)*1000;
+    spec.it_value = spec.it_interval;
+    
+    int id = -1;
+    if (timerfd_settime(fd, 0, &spec, NULL) == 0) id = watch(fd, EPOLLIN, handler, context);
+    if (id < 0){
+        close(fd);
+        return -1;
+    }
+    _sources[id].timer = true;
+    return id;
+}
+
+
+bool Motor_Loop::setTimer(int id, uint64_t period_us){
+    if (id < 0 || id >= MAX_SOURCES || !_sources[id].used || !_sources[id].timer || period_us == 0) return false;
+    
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = period_us/1000000;
+    spec.it_interval.tv_nsec = (period_us%1000000)*1000;
+    spec.it_value = spec.it_interval;
+    return timerfd_settime(_sources[id].fd, 0, &spec, NULL) == 0;
+}
+
+
+void Motor_Loop::run(int cpu, int priority){
+    
+    if (cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    if (priority > 0){
+        struct sched_param param;
+        param.sched_priority = priority;
+        sched_setscheduler(0, SCHED_FIFO, &param);
+    }
+    
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    long voluntary = usage.ru_nvcsw;
+    long involuntary = usage.ru_nivcsw;
+    
+    // Armed by the constructor only : a stop() issued before run() must not be lost
+    struct epoll_event events[MAX_SOURCES];
+    
+    while (_running){
+        
+        int n = epoll_wait(_epoll, events, MAX_SOURCES, -1);
+        if (n < 0) continue; // EINTR
+        _stats.wakeups++;
+        
+        for (int e=0; e<n && _running; e++){
+            
+            Source& source = _sources[events[e].data.u32];
+            if (!source.used) continue; // unwatched by a previous handler
+            
+            uint32_t value = events[e].events;
+            if (source.timer){
+                uint64_t expirations = 0;
+                if (read(source.fd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+                _stats.timer_expirations += expirations;
+                _stats.timer_overruns += expirations-1;
+                value = (uint32_t)expirations;
+            }
+            
+            uint64_t start = Motor_Event_Log::now();
+            source.handler(source.context, value);
+            uint64_t duration = Motor_Event_Log::now() - start;
+            if (duration > _stats.max_dispatch) _stats.max_dispatch = duration;
+            _stats.dispatched++;
+        }
+    }
+    
+    getrusage(RUSAGE_THREAD, &usage);
+    _stats.voluntary_switches += usage.ru_nvcsw - voluntary;
+    _stats.involuntary_switches += usage.ru_nivcsw - involuntary;
+}
+
+
+void Motor_Loop::stop(){
+    _running = false;
+    uint64_t one = 1;
+    if (write(_wake, &one, sizeof(one)) < 0) return; // already signaled
+}
+
+
+void Motor_Loop::_on_wake(void* context, uint32_t){
+    Motor_Loop* loop = (Motor_Loop*)context;
+    uint64_t value;
+    if (read(loop->_wake, &value, sizeof(value)) < 0) return;
+}
+
+
+Motor_Loop_Stats Motor_Loop::getStats() const {
+    return _stats;
+}
@@ -0,0 +1,155 @@
+//
+//  Motor_Loop.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Loop_hpp
+#define Motor_Loop_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <atomic>
+
+
+
+/**
+ * \struct Motor_Loop_Stats
+ * \brief Snapshot of the Motor_Loop counters
+ */
+struct Motor_Loop_Stats {
+    uint64_t wakeups; // returns from epoll_wait
+    uint64_t dispatched; // handlers called
+    uint64_t timer_expirations;
+    uint64_t timer_overruns; // expirations missed because the loop was late
+    uint64_t max_dispatch; // ns, longest handler
+    long voluntary_switches; // context switches of the loop thread during run()
+    long involuntary_switches;
+};
+
+
+
+
+/**
+ * \class Motor_Loop
+ * \brief Single-threaded epoll event loop : fds, periodic timers and a cross-thread wakeup
+ *
+ * Every wait of the motor stack (next command, tick deadline, serial writable, telemetry line)
+ * is a source of this loop and its continuation a handler : the stages run one after the other
+ * on one thread, pinned to one core, without context switches between them.
+ * Sources live in a fixed table, nothing is allocated once running.
+ */
+class Motor_Loop {
+    
+public:
+    
+    enum { MAX_SOURCES = 16 };
+    
+    /**
+     * \brief Handler : events are EPOLL* flags for fds, the number of expirations for timers
+     */
+    typedef void (*Handler)(void* context, uint32_t events);
+    
+    
+    Motor_Loop();
+    
+    
+    /**
+     * \brief Destructor (closes the timers, not the watched fds)
+     */
+    ~Motor_Loop();
+    
+    
+    /**
+     * \brief Returns false if epoll couldn't be created
+     */
+    bool isValid() const;
+    
+    
+    /**
+     * \brief Watches a fd
+     *
+     * \param int : fd, uint32_t : EPOLLIN / EPOLLOUT, Handler, void* : its context
+     * \return id of the source, -1 if the table is full or epoll refused the fd
+     */
+    int watch(int fd, uint32_t events, Handler, void*);
+    
+    
+    /**
+     * \brief Changes the events of a source (EPOLLOUT on when a write is pending, off when done)
+     */
+    bool modify(int id, uint32_t events);
+    
+    
+    /**
+     * \brief Removes a source, and closes it if it is a timer
+     */
+    void unwatch(int id);
+    
+    
+    /**
+     * \brief Adds a periodic timer (timerfd, CLOCK_MONOTONIC, first expiration after one period)
+     *
+     * \param uint64_t : period in us, Handler, void* : its context
+     * \return id of the source, -1 on failure
+     */
+    int addTimer(uint64_t period_us, Handler, void*);
+    
+    
+    /**
+     * \brief Changes the period of a timer, first expiration after one new period
+     *
+     * \return false if the source is not a timer
+     */
+    bool setTimer(int id, uint64_t period_us);
+    
+    
+    /**
+     * \brief Dispatches events until stop()
+     *
+     * Returns at once if stop() was already called, even before run() : a stopped loop stays stopped
+     *
+     * \param int : core to pin the calling thread to, -1 to leave it
+     * \param int : SCHED_FIFO priority, 0 to leave the policy (best effort, needs CAP_SYS_NICE)
+     */
+    void run(int cpu = -1, int priority = 0);
+    
+    
+    /**
+     * \brief Makes run() return after the current dispatch, or right away if it is not running yet. Threadsafe
+     */
+    void stop();
+    
+    
+    /**
+     * \brief Returns the counters. Not threadsafe : to be called from a handler or after run()
+     */
+    Motor_Loop_Stats getStats() const;
+    
+    
+private:
+    
+    struct Source {
+        int fd;
+        Handler handler;
+        void* context;
+        bool used;
+        bool timer;
+    };
+    
+    static void _on_wake(void*, uint32_t);
+    
+    int _epoll;
+    int _wake; // eventfd
+    std::atomic<bool> _running;
+    
+    Source _sources[MAX_SOURCES];
+    Motor_Loop_Stats _stats;
+    
+};
+
+
+
+#endif /* Motor_Loop_hpp */
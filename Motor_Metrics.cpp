@@ -0,0 +1,166 @@
+//
+//  Motor_Metrics.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Metrics.hpp"
+#include "Motor_Event_Log.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+
+
+Motor_Metrics::Motor_Metrics(unsigned int period_us) : _page(NULL){
+    memset(&_data, 0, sizeof(_data));
+    memset(_histogram, 0, sizeof(_histogram));
+    memset(_count, 0, sizeof(_count));
+    _data.pid = getpid();
+    _data.period_us = period_us;
+}
+
+
+Motor_Metrics::~Motor_Metrics(){
+    if (_page != NULL) munmap(_page, sizeof(Motor_Metrics_Page));
+}
+
+
+bool Motor_Metrics::open(const char* name){
+    
+    if (_page != NULL) return true;
+    
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0664);
+    if (fd < 0) return false;
+    if (ftruncate(fd, sizeof(Motor_Metrics_Page)) < 0){
+        close(fd);
+        return false;
+    }
+    
+    void* ptr = mmap(NULL, sizeof(Motor_Metrics_Page), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return false;
+    
+    // Single writer : a page left by a previous run is simply taken over
+    _page = (Motor_Metrics_Page*)ptr;
+    _page->magic = MOTOR_METRICS_MAGIC;
+    _page->version = MOTOR_METRICS_VERSION;
+    uint32_t sequence = _page->sequence.load();
+    if (sequence & 1) _page->sequence.store(sequence+1);
+    
+    publish();
+    return true;
+}
+
+
+void Motor_Metrics::setPeriod(unsigned int period_us){
+    _data.period_us = period_us;
+}
+
+
+
+unsigned int Motor_Metrics::bucketOf(uint64_t ns){
+    if (ns < SUB_BUCKETS) return ns;
+    
+    unsigned int exponent = 63 - __builtin_clzll(ns); // >= 2
+    unsigned int sub = (ns >> (exponent-2)) & (SUB_BUCKETS-1);
+    unsigned int bucket = (exponent-1)*SUB_BUCKETS + sub;
+    return (bucket < NB_BUCKETS ? bucket : NB_BUCKETS-1);
+}
+
+
+uint64_t Motor_Metrics::bucketValue(unsigned int bucket){
+    if (bucket < SUB_BUCKETS) return bucket;
+    
+    unsigned int exponent = bucket/SUB_BUCKETS + 1;
+    unsigned int sub = bucket%SUB_BUCKETS;
+    return (uint64_t)(SUB_BUCKETS+sub) << (exponent-2);
+}
+
+
+
+void Motor_Metrics::recordStage(Motor_Metrics_Data::STAGE stage, uint64_t ns){
+    
+    _histogram[stage][bucketOf(ns)]++;
+    _count[stage]++;
+    if (ns > _data.max[stage]) _data.max[stage] = ns;
+    
+    if (stage == Motor_Metrics_Data::stage_tick){
+        _data.ticks++;
+        if (ns > (uint64_t)_data.period_us*1000) _data.overruns++;
+    }
+}
+
+
+void Motor_Metrics::recordSaturation(int i, Motor_Metrics_Data::SATURATION saturation){
+    if (i>=0 && i<4) _data.saturations[i][saturation]++;
+}
+
+
+void Motor_Metrics::recordWriteError(){
+    _data.serial_write_errors++;
+}
+
+
+void Motor_Metrics::recordServoOut(const uint16_t* servo_out){
+    memcpy(_data.servo_out, servo_out, sizeof(_data.servo_out));
+}
+
+
+
+uint64_t Motor_Metrics::_percentile(int stage, uint64_t count, double ratio) const {
+    if (count == 0) return 0;
+    
+    uint64_t rank = count*ratio;
+    uint64_t seen = 0;
+    for (unsigned int bucket=0; bucket<NB_BUCKETS; bucket++){
+        seen += _histogram[stage][bucket];
+        if (seen > rank) return bucketValue(bucket);
+    }
+    return _data.max[stage];
+}
+
+
+void Motor_Metrics::publish(){
+    
+    for (int stage=0; stage<Motor_Metrics_Data::NB_STAGES; stage++){
+        _data.p50[stage] = _percentile(stage, _count[stage], 0.50);
+        _data.p90[stage] = _percentile(stage, _count[stage], 0.90);
+        _data.p99[stage] = _percentile(stage, _count[stage], 0.99);
+    }
+    _data.timestamp = Motor_Event_Log::now();
+    
+    if (_page == NULL) return;
+    
+    uint32_t sequence = _page->sequence.load(std::memory_order_relaxed);
+    _page->sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _page->data = _data;
+    _page->sequence.store(sequence+2, std::memory_order_release);
+}
+
+
+const Motor_Metrics_Data& Motor_Metrics::getData() const {
+    return _data;
+}
+
+
+bool Motor_Metrics::read(const Motor_Metrics_Page* page, Motor_Metrics_Data& data){
+    
+    // Bounded : a motor process that died in publish() leaves the sequence odd for good
+    Motor_Metrics_Data copy;
+    for (int retry=0; retry<MAX_RETRIES; retry++){
+        uint32_t before = page->sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        copy = page->data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (page->sequence.load(std::memory_order_relaxed) == before){
+            data = copy;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,198 @@
+//
+//  Motor_Metrics.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Metrics_hpp
+#define Motor_Metrics_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+
+
+#define MOTOR_METRICS_NAME "/maestro_motor_metrics"
+#define MOTOR_METRICS_MAGIC 0x4D4D4D54 // "MMMT"
+#define MOTOR_METRICS_VERSION 1
+
+
+
+/**
+ * \struct Motor_Metrics_Data
+ * \brief Runtime metrics of the motor thread, as exported in the metrics page
+ */
+struct Motor_Metrics_Data {
+    
+    /**
+     * \enum STAGE
+     * \brief Timed stages of a tick
+     */
+    enum STAGE {
+        stage_update=0, // _update : mixer, saturations, PWM
+        stage_output=1, // setPosition : encoding and write/submit
+        stage_tick=2, // whole tick, from the command to the output (waiting for the command excluded)
+        NB_STAGES=3
+    };
+    
+    /**
+     * \enum SATURATION
+     * \brief Counted saturations
+     */
+    enum SATURATION {
+        saturation_speed_low=0,
+        saturation_speed_high=1,
+        saturation_acceleration=2,
+        NB_SATURATIONS=3
+    };
+    
+    uint32_t pid;
+    uint32_t period_us; // nominal tick period
+    uint64_t timestamp; // ns, CLOCK_MONOTONIC, of the last publish
+    uint64_t ticks;
+    uint64_t overruns; // ticks longer than the period
+    uint64_t serial_write_errors;
+    
+    // Latency percentiles since start, ns
+    uint64_t p50[NB_STAGES];
+    uint64_t p90[NB_STAGES];
+    uint64_t p99[NB_STAGES];
+    uint64_t max[NB_STAGES];
+    
+    uint64_t saturations[4][NB_SATURATIONS]; // per motor
+    uint16_t servo_out[4]; // last PWM frame, us
+};
+
+
+/**
+ * \struct Motor_Metrics_Page
+ * \brief Layout of the shared metrics page, on its own cache lines
+ */
+struct alignas(64) Motor_Metrics_Page {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> sequence; // seqlock, odd while being written
+    char _pad[52];
+    Motor_Metrics_Data data;
+};
+
+
+
+
+/**
+ * \class Motor_Metrics
+ * \brief Collects the motor thread metrics and publishes them in a shared memory page
+ *
+ * record*() calls are plain memory updates for the motor thread ; publish() copies the
+ * data into the page under a seqlock. No syscall and no lock on the motor thread :
+ * external monitors (tools/maestro_top.cpp) map the page read-only and poll it.
+ */
+class Motor_Metrics {
+    
+public:
+    
+    // Latency histogram : 4 sub-buckets per power of 2, from 1 ns to ~1 s
+    enum { SUB_BUCKETS = 4, NB_BUCKETS = 30*SUB_BUCKETS };
+    enum { MAX_RETRIES = 64 }; // seqlock reads by read(), before the page is reported stale
+    
+    
+    /**
+     * \brief Constructor (records locally until open() succeeds)
+     *
+     * \param unsigned int : nominal tick period in us, for overruns
+     */
+    Motor_Metrics(unsigned int period_us);
+    
+    
+    /**
+     * \brief Destructor (unmaps the page, never unlinks)
+     */
+    ~Motor_Metrics();
+    
+    
+    /**
+     * \brief Creates or attaches the shared page
+     *
+     * \return false if it couldn't be mapped
+     */
+    bool open(const char* name = MOTOR_METRICS_NAME);
+    
+    
+    /**
+     * \brief Changes the nominal tick period
+     */
+    void setPeriod(unsigned int period_us);
+    
+    
+    /**
+     * \brief Records the duration of a stage. A stage_tick also counts a tick (and an overrun)
+     */
+    void recordStage(Motor_Metrics_Data::STAGE, uint64_t ns);
+    
+    
+    /**
+     * \brief Records a saturation of a motor
+     */
+    void recordSaturation(int, Motor_Metrics_Data::SATURATION);
+    
+    
+    /**
+     * \brief Records a serial write error
+     */
+    void recordWriteError();
+    
+    
+    /**
+     * \brief Records the last PWM frame
+     */
+    void recordServoOut(const uint16_t*);
+    
+    
+    /**
+     * \brief Computes the percentiles and copies the data into the page
+     */
+    void publish();
+    
+    
+    /**
+     * \brief Returns the local data of the motor thread
+     *
+     * Counters (ticks, overruns, errors, saturations, max) and servo_out are live ; the
+     * percentiles and the timestamp are those of the last publish()
+     */
+    const Motor_Metrics_Data& getData() const;
+    
+    
+    /**
+     * \brief Histogram bucket of a duration, and lower bound of a bucket
+     */
+    static unsigned int bucketOf(uint64_t ns);
+    static uint64_t bucketValue(unsigned int);
+    
+    
+    /**
+     * \brief Reader side : consistent copy of a mapped page, no syscall
+     *
+     * \return false if no consistent copy could be taken (the writer died in publish()) :
+     *         the data is stale and left untouched
+     */
+    static bool read(const Motor_Metrics_Page*, Motor_Metrics_Data&);
+    
+    
+private:
+    
+    uint64_t _percentile(int stage, uint64_t count, double) const;
+    
+    Motor_Metrics_Data _data;
+    uint32_t _histogram[Motor_Metrics_Data::NB_STAGES][NB_BUCKETS];
+    uint64_t _count[Motor_Metrics_Data::NB_STAGES];
+    
+    Motor_Metrics_Page* _page;
+    
+};
+
+
+
+#endif /* Motor_Metrics_hpp */
@@ -0,0 +1,228 @@
+//
+//  Motor_Params.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Params.hpp"
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+
+
+Motor_Params Motor_Params::fromConfig(){
+    Motor_Params params;
+    params.max_motor_speed = MAX_MOTOR_SPEED;
+    params.max_motor_acceleration = MAX_MOTOR_ACCELERATION;
+    params.servo_max_real = SERVO_MAX_REAL;
+    params.thrust_coef = thrust_factor;
+    params.drag_coef = drag_factor;
+    params.arm_length = center_to_motor_distance;
+    params.servo_val_min = SERVO_VAL_MIN;
+    params.servo_val_max = SERVO_VAL_MAX;
+    params.rpm_kp = RPM_KP;
+    params.rpm_ki = RPM_KI;
+    params.rpm_max_correction = RPM_MAX_CORRECTION;
+    for (int i=0; i<4; i++){
+        params.pwm_offset[i] = 0;
+        params.pwm_scale[i] = 1;
+    }
+    params.version = 0;
+    return params;
+}
+
+
+
+/**
+ * Fields of a parameters file : name, first value, number of values
+ */
+struct Motor_Params_Field {
+    const char* name;
+    size_t offset;
+    int count;
+};
+
+static const Motor_Params_Field FIELDS[] = {
+    {"max_motor_speed", offsetof(Motor_Params, max_motor_speed), 1},
+    {"max_motor_acceleration", offsetof(Motor_Params, max_motor_acceleration), 1},
+    {"servo_max_real", offsetof(Motor_Params, servo_max_real), 1},
+    {"thrust_coef", offsetof(Motor_Params, thrust_coef), 1},
+    {"drag_coef", offsetof(Motor_Params, drag_coef), 1},
+    {"arm_length", offsetof(Motor_Params, arm_length), 1},
+    {"servo_val_min", offsetof(Motor_Params, servo_val_min), 1},
+    {"servo_val_max", offsetof(Motor_Params, servo_val_max), 1},
+    {"rpm_kp", offsetof(Motor_Params, rpm_kp), 1},
+    {"rpm_ki", offsetof(Motor_Params, rpm_ki), 1},
+    {"rpm_max_correction", offsetof(Motor_Params, rpm_max_correction), 1},
+    {"pwm_offset", offsetof(Motor_Params, pwm_offset), 4},
+    {"pwm_scale", offsetof(Motor_Params, pwm_scale), 4}
+};
+
+
+bool Motor_Params::load(const char* path){
+    
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+    
+    // Parsed into a copy : a bad file leaves the parameters untouched
+    Motor_Params params = *this;
+    bool valid = true;
+    char line[256];
+    char* state = NULL;
+    
+    while (valid && fgets(line, sizeof(line), file) != NULL){
+        
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+        char* name = strtok_r(line, " \t\r\n", &state);
+        if (name == NULL) continue;
+        
+        const Motor_Params_Field* field = NULL;
+        for (unsigned int f=0; f<sizeof(FIELDS)/sizeof(FIELDS[0]); f++){
+            if (strcmp(name, FIELDS[f].name) == 0) field = &FIELDS[f];
+        }
+        if (field == NULL){
+            valid = false;
+            break;
+        }
+        
+        float* values = (float*)((char*)&params + field->offset);
+        for (int i=0; i<field->count; i++){
+            char* token = strtok_r(NULL, " \t\r\n", &state);
+            char* end = NULL;
+            float value = (token != NULL ? strtof(token, &end) : 0);
+            if (token == NULL || *end != '\0' || !isfinite(value)){
+                valid = false;
+                break;
+            }
+            values[i] = value;
+        }
+    }
+    fclose(file);
+    
+    if (valid) *this = params;
+    return valid;
+}
+
+
+bool Motor_Params::save(const char* path, const char* comment) const {
+    
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+    
+    if (comment != NULL) fprintf(file, "# %s\n", comment);
+    for (unsigned int f=0; f<sizeof(FIELDS)/sizeof(FIELDS[0]); f++){
+        const float* values = (const float*)((const char*)this + FIELDS[f].offset);
+        fprintf(file, "%s", FIELDS[f].name);
+        for (int i=0; i<FIELDS[f].count; i++){
+            fprintf(file, " %.9g", values[i]);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+
+
+
+Motor_Params_Store::Motor_Params_Store(){
+    _init(Motor_Params::fromConfig());
+}
+
+
+Motor_Params_Store::Motor_Params_Store(const Motor_Params& params){
+    _init(params);
+}
+
+
+Motor_Params_Store::~Motor_Params_Store(){
+    pthread_mutex_destroy(&_mutex_writer);
+}
+
+
+void Motor_Params_Store::_init(const Motor_Params& params){
+    pthread_mutex_init(&_mutex_writer,NULL);
+    
+    _last_version = 1;
+    _pool[0] = params;
+    _pool[0].version = _last_version;
+    
+    _current.store(&_pool[0]);
+    _hazard.store(NULL);
+    _previous = NULL;
+}
+
+
+
+const Motor_Params* Motor_Params_Store::acquire(){
+    
+    // Hazard pointer protocol : announce the version, then check it is still current.
+    // A writer that missed the announcement has published again, so we retry on the newer one.
+    Motor_Params* params = _current.load(std::memory_order_acquire);
+    Motor_Params* check;
+    do {
+        check = params;
+        _hazard.store(check, std::memory_order_seq_cst);
+        params = _current.load(std::memory_order_seq_cst);
+    } while (params != check);
+    
+    return params;
+}
+
+
+
+uint32_t Motor_Params_Store::publish(const Motor_Params& params){
+    pthread_mutex_lock(&_mutex_writer);
+    
+    Motor_Params* current = _current.load(std::memory_order_relaxed);
+    Motor_Params* held = _hazard.load(std::memory_order_seq_cst);
+    
+    // At most 3 slots are in use, there always is a free one
+    Motor_Params* slot = NULL;
+    for (int i=0; i<POOL_SIZE; i++){
+        if (&_pool[i]!=current && &_pool[i]!=_previous && &_pool[i]!=held){
+            slot = &_pool[i];
+            break;
+        }
+    }
+    
+    *slot = params;
+    slot->version = ++_last_version;
+    
+    _previous = current;
+    _current.store(slot, std::memory_order_seq_cst);
+    
+    uint32_t version = slot->version;
+    pthread_mutex_unlock(&_mutex_writer);
+    return version;
+}
+
+
+
+bool Motor_Params_Store::rollback(){
+    pthread_mutex_lock(&_mutex_writer);
+    
+    if (_previous == NULL){
+        pthread_mutex_unlock(&_mutex_writer);
+        return false;
+    }
+    
+    // Both versions stay out of the free pool, so the swap needs no reclamation
+    Motor_Params* current = _current.load(std::memory_order_relaxed);
+    _current.store(_previous, std::memory_order_seq_cst);
+    _previous = current;
+    
+    pthread_mutex_unlock(&_mutex_writer);
+    return true;
+}
+
+
+
+Motor_Params Motor_Params_Store::current(){
+    pthread_mutex_lock(&_mutex_writer);
+    Motor_Params params = *_current.load(std::memory_order_relaxed);
+    pthread_mutex_unlock(&_mutex_writer);
+    return params;
+}
@@ -0,0 +1,161 @@
+//
+//  Motor_Params.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Params_hpp
+#define Motor_Params_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "Config.hpp"
+
+
+
+/**
+ * \struct Motor_Params
+ * \brief Tunable limits and mixer coefficients used by MaestroMotor at each tick
+ *
+ * Defaults come from Config.hpp. Field names differ from the Config.hpp macros on purpose
+ * (thrust_factor, drag_factor... are #defines)
+ */
+struct Motor_Params {
+    
+    float max_motor_speed; // rd/s
+    float max_motor_acceleration; // rd/s^2
+    float servo_max_real; // rd/s, speed mapped to SERVO_VAL_MAX
+    float thrust_coef;
+    float drag_coef;
+    float arm_length; // m, center to motor distance
+    float servo_val_min; // us
+    float servo_val_max; // us
+    float rpm_kp; // speed correction from ESC telemetry : proportional gain
+    float rpm_ki; // 1/s
+    float rpm_max_correction; // rd/s, 0 : open loop
+    float pwm_offset[4]; // us, per motor : zero-speed PWM above servo_val_min
+    float pwm_scale[4]; // per motor : PWM slope relative to the shared mapping, 1 by default
+    
+    uint32_t version; // set by Motor_Params_Store::publish()
+    
+    
+    /**
+     * \brief Returns the parameters as defined in Config.hpp
+     */
+    static Motor_Params fromConfig();
+    
+    
+    /**
+     * \brief Reads a parameters file over the current values
+     *
+     * One "name value..." line per field, named as in this struct ; '#' starts a comment.
+     * Fields absent from the file are left as they are. Written by save() and tools/motor_identify.cpp
+     *
+     * \param const char* : path
+     * \return false if the file couldn't be read or has an unknown field or a bad value
+     */
+    bool load(const char* path);
+    
+    
+    /**
+     * \brief Writes every field to a parameters file, readable by load()
+     *
+     * \param const char* : path, const char* : comment written on top (may be NULL)
+     * \return false if the file couldn't be written
+     */
+    bool save(const char* path, const char* comment = NULL) const;
+};
+
+
+
+
+/**
+ * \class Motor_Params_Store
+ * \brief RCU-style store of Motor_Params, hot-swappable while the motor thread runs
+ *
+ * One reader (the motor thread) calls acquire() at each tick boundary : no lock, no allocation.
+ * Writers (tuning thread) call publish() or rollback(), serialized by a mutex.
+ * Versions live in a preallocated pool ; a slot is reused only once it is neither current,
+ * previous (kept for rollback) nor held by the reader (hazard pointer).
+ */
+class Motor_Params_Store {
+    
+public:
+    
+    /**
+     * \brief Constructor, initial version is given by Config.hpp
+     */
+    Motor_Params_Store();
+    
+    
+    /**
+     * \brief Constructor with explicit initial version
+     *
+     * \param Motor_Params : initial parameters
+     */
+    Motor_Params_Store(const Motor_Params&);
+    
+    
+    ~Motor_Params_Store();
+    
+    
+    /**
+     * \brief Reader side : returns the current version and protects it until the next acquire()
+     *
+     * Must only be called from the motor thread
+     *
+     * \return pointer to the current parameters, valid until the next call
+     */
+    const Motor_Params* acquire();
+    
+    
+    /**
+     * \brief Writer side : publishes a new version, picked up by the reader at its next acquire()
+     *
+     * The current version becomes the rollback target
+     *
+     * \param Motor_Params : new parameters (version field is ignored)
+     * \return the version number given to the new parameters
+     */
+    uint32_t publish(const Motor_Params&);
+    
+    
+    /**
+     * \brief Writer side : swaps back to the previous version
+     *
+     * Calling it twice restores the version that was rolled back
+     *
+     * \return false if there is no previous version
+     */
+    bool rollback();
+    
+    
+    /**
+     * \brief Writer side : returns a copy of the current version
+     */
+    Motor_Params current();
+    
+    
+private:
+    
+    void _init(const Motor_Params&);
+    
+    enum { POOL_SIZE = 4 }; // current + previous + reader-held + one free
+    
+    Motor_Params _pool[POOL_SIZE];
+    
+    std::atomic<Motor_Params*> _current;
+    std::atomic<Motor_Params*> _hazard; // version in use by the reader
+    Motor_Params* _previous; // writer side only
+    uint32_t _last_version;
+    
+    pthread_mutex_t _mutex_writer;
+    
+};
+
+
+
+#endif /* Motor_Params_hpp */
@@ -0,0 +1,278 @@
+//
+//  Motor_Perf.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Perf.hpp"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+
+
+
+// Event of each counter, and the group it belongs to
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    int group;
+    const char* name;
+} COUNTERS[Motor_Perf_Sample::NB_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, Motor_Perf::group_hardware, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, Motor_Perf::group_hardware, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, Motor_Perf::group_hardware, "cache-misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, Motor_Perf::group_hardware, "branch-misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, Motor_Perf::group_software, "ctx-switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, Motor_Perf::group_software, "task-clock"}
+};
+
+
+static const char* STAGE_NAMES[Motor_Metrics_Data::NB_STAGES] = {"update", "output", "tick"};
+
+
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t rdpmc(uint32_t counter){
+    uint32_t low, high;
+    __asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+    return low | ((uint64_t)high << 32);
+}
+#define MOTOR_PERF_RDPMC 1
+#else
+#define MOTOR_PERF_RDPMC 0
+#endif
+
+
+
+Motor_Perf::Motor_Perf() : _rdpmc(false){
+    for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+        _fd[c] = -1;
+        _page[c] = NULL;
+    }
+    for (int g=0; g<NB_GROUPS; g++){
+        _leader[g] = -1;
+        _nb_members[g] = 0;
+    }
+    memset(_stats, 0, sizeof(_stats));
+}
+
+
+Motor_Perf::~Motor_Perf(){
+    close();
+}
+
+
+int Motor_Perf::_openCounter(Motor_Perf_Sample::COUNTER counter){
+    
+    int group = COUNTERS[counter].group;
+    
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = COUNTERS[counter].type;
+    attr.config = COUNTERS[counter].config;
+    attr.exclude_kernel = 1; // allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = (_leader[group] < 0); // the leader starts the whole group
+    
+    // This thread, any CPU
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, _leader[group], 0);
+    if (fd < 0) return -1;
+    
+    if (_leader[group] < 0) _leader[group] = fd;
+    _members[group][_nb_members[group]++] = counter;
+    return fd;
+}
+
+
+bool Motor_Perf::open(){
+    
+    if (isOpen()) return true;
+    
+    for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+        _fd[c] = _openCounter((Motor_Perf_Sample::COUNTER)c);
+    }
+    if (!isOpen()) return false;
+    
+    // rdpmc needs every hardware counter mapped with user access granted
+    _rdpmc = MOTOR_PERF_RDPMC && _nb_members[group_hardware] > 0;
+    for (unsigned int m=0; m<_nb_members[group_hardware]; m++){
+        int c = _members[group_hardware][m];
+        void* page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, _fd[c], 0);
+        if (page == MAP_FAILED){
+            _rdpmc = false;
+            continue;
+        }
+        _page[c] = page;
+        if (!((perf_event_mmap_page*)page)->cap_user_rdpmc) _rdpmc = false;
+    }
+    
+    for (int g=0; g<NB_GROUPS; g++){
+        if (_leader[g] < 0) continue;
+        ioctl(_leader[g], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(_leader[g], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    return true;
+}
+
+
+void Motor_Perf::close(){
+    for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+        if (_page[c] != NULL) munmap(_page[c], sysconf(_SC_PAGESIZE));
+        if (_fd[c] >= 0) ::close(_fd[c]);
+        _fd[c] = -1;
+        _page[c] = NULL;
+    }
+    for (int g=0; g<NB_GROUPS; g++){
+        _leader[g] = -1;
+        _nb_members[g] = 0;
+    }
+    _rdpmc = false;
+}
+
+
+bool Motor_Perf::isOpen() const {
+    return _leader[group_hardware] >= 0 || _leader[group_software] >= 0;
+}
+
+
+bool Motor_Perf::isAvailable(Motor_Perf_Sample::COUNTER counter) const {
+    return _fd[counter] >= 0;
+}
+
+
+bool Motor_Perf::usesRdpmc() const {
+    return _rdpmc;
+}
+
+
+void Motor_Perf::_readGroup(int group, Motor_Perf_Sample& sample){
+    
+    sample.enabled[group] = 0;
+    sample.running[group] = 0;
+    if (_leader[group] < 0) return;
+    
+    // nr, time_enabled, time_running, then the values in opening order
+    uint64_t buffer[3 + Motor_Perf_Sample::NB_COUNTERS];
+    ssize_t length = ::read(_leader[group], buffer, sizeof(buffer));
+    if (length < (ssize_t)(3*sizeof(uint64_t))) return;
+    
+    sample.enabled[group] = buffer[1];
+    sample.running[group] = buffer[2];
+    for (unsigned int m=0; m<buffer[0] && m<_nb_members[group]; m++){
+        sample.value[_members[group][m]] = buffer[3+m];
+    }
+}
+
+
+bool Motor_Perf::_readRdpmc(Motor_Perf_Sample& sample){
+#if MOTOR_PERF_RDPMC
+    for (unsigned int m=0; m<_nb_members[group_hardware]; m++){
+        int c = _members[group_hardware][m];
+        volatile perf_event_mmap_page* page = (volatile perf_event_mmap_page*)_page[c];
+        
+        // Seqlock against the kernel updating the page when the thread is scheduled
+        uint32_t sequence, index;
+        uint64_t count;
+        do {
+            sequence = page->lock;
+            __asm__ volatile("" ::: "memory");
+            index = page->index;
+            count = page->offset;
+            if (index != 0){
+                // Sign extended over the counter width
+                int64_t pmc = rdpmc(index - 1);
+                pmc <<= 64 - page->pmc_width;
+                pmc >>= 64 - page->pmc_width;
+                count += pmc;
+            }
+            __asm__ volatile("" ::: "memory");
+        } while (page->lock != sequence);
+        
+        // Not on the PMU right now (multiplexed out) : only the kernel knows
+        if (index == 0) return false;
+        sample.value[c] = count;
+    }
+    
+    // No time accounting on this path : a group off the PMU is caught above
+    sample.enabled[group_hardware] = 1;
+    sample.running[group_hardware] = 1;
+    return true;
+#else
+    (void)sample;
+    return false;
+#endif
+}
+
+
+void Motor_Perf::read(Motor_Perf_Sample& sample){
+    memset(&sample, 0, sizeof(sample));
+    if (!(_rdpmc && _readRdpmc(sample))) _readGroup(group_hardware, sample);
+    _readGroup(group_software, sample);
+}
+
+
+void Motor_Perf::record(Motor_Metrics_Data::STAGE stage, const Motor_Perf_Sample& begin, const Motor_Perf_Sample& end){
+    
+    Motor_Perf_Stats& stats = _stats[stage];
+    
+    // A group multiplexed out during the stage counted only part of it : scaling one tick would be a guess
+    for (int g=0; g<NB_GROUPS; g++){
+        if (end.enabled[g]-begin.enabled[g] != end.running[g]-begin.running[g]){
+            stats.multiplexed++;
+            return;
+        }
+    }
+    
+    stats.samples++;
+    for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+        uint64_t delta = end.value[c]-begin.value[c];
+        stats.total[c] += delta;
+        if (delta > stats.max[c]) stats.max[c] = delta;
+    }
+}
+
+
+Motor_Perf_Stats Motor_Perf::getStats(Motor_Metrics_Data::STAGE stage) const {
+    return _stats[stage];
+}
+
+
+void Motor_Perf::printReport(FILE* file) const {
+    
+    fprintf(file, "counters :");
+    for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+        fprintf(file, " %s%s", COUNTERS[c].name, (isAvailable((Motor_Perf_Sample::COUNTER)c) ? "" : " (n/a)"));
+    }
+    fprintf(file, ", read with %s\n", (_rdpmc ? "rdpmc" : "read()"));
+    
+    fprintf(file, "%-8s %9s %7s %6s", "stage", "samples", "muxed", "IPC");
+    for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+        fprintf(file, " %14s %10s", COUNTERS[c].name, "max");
+    }
+    fprintf(file, "\n");
+    
+    // Means per tick
+    for (int s=0; s<Motor_Metrics_Data::NB_STAGES; s++){
+        const Motor_Perf_Stats& stats = _stats[s];
+        double n = (stats.samples > 0 ? stats.samples : 1);
+        double cycles = stats.total[Motor_Perf_Sample::cycles];
+        fprintf(file, "%-8s %9llu %7llu %6.2f", STAGE_NAMES[s], (unsigned long long)stats.samples,
+                (unsigned long long)stats.multiplexed,
+                (cycles > 0 ? stats.total[Motor_Perf_Sample::instructions]/cycles : 0.));
+        for (int c=0; c<Motor_Perf_Sample::NB_COUNTERS; c++){
+            fprintf(file, " %14.1f %10llu", stats.total[c]/n, (unsigned long long)stats.max[c]);
+        }
+        fprintf(file, "\n");
+    }
+}
+
+
+const char* Motor_Perf::counterName(Motor_Perf_Sample::COUNTER counter){
+    return COUNTERS[counter].name;
+}
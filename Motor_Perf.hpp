@@ -0,0 +1,145 @@
+//
+//  Motor_Perf.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Perf_hpp
+#define Motor_Perf_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Motor_Metrics.hpp"
+
+
+
+/**
+ * \struct Motor_Perf_Sample
+ * \brief Counter values at one point of a tick
+ */
+struct Motor_Perf_Sample {
+    
+    /**
+     * \enum COUNTER
+     * \brief Counted events
+     */
+    enum COUNTER {
+        cycles=0,
+        instructions=1,
+        cache_misses=2,
+        branch_misses=3,
+        context_switches=4,
+        task_clock=5, // ns on CPU
+        NB_COUNTERS=6
+    };
+    
+    uint64_t value[NB_COUNTERS];
+    uint64_t enabled[2]; // ns the hardware and software groups were enabled and running
+    uint64_t running[2];
+};
+
+
+/**
+ * \struct Motor_Perf_Stats
+ * \brief Counters aggregated over the samples of one stage
+ */
+struct Motor_Perf_Stats {
+    uint64_t samples;
+    uint64_t multiplexed; // samples dropped : the counters were not on the PMU for the whole stage
+    uint64_t total[Motor_Perf_Sample::NB_COUNTERS];
+    uint64_t max[Motor_Perf_Sample::NB_COUNTERS];
+};
+
+
+
+
+/**
+ * \class Motor_Perf
+ * \brief Per-thread hardware counters around the stages of a tick, through perf_event_open
+ *
+ * open() counts the calling thread only, in user mode : cycles, instructions, cache and branch
+ * misses in one group, context switches and task clock in another (software events). When the
+ * kernel allows it (x86, cap_user_rdpmc), the hardware group is read with rdpmc from the mapped
+ * event pages, without syscall ; otherwise, and always for the software group, with one read()
+ * per group. Counters the CPU or the VM lacks are left out and reported as such.
+ * Opt-in profiling : a sample costs about a microsecond when it falls back to read().
+ */
+class Motor_Perf {
+    
+public:
+    
+    enum GROUP { group_hardware=0, group_software=1, NB_GROUPS=2 };
+    
+    
+    Motor_Perf();
+    
+    
+    /**
+     * \brief Destructor (closes the counters)
+     */
+    ~Motor_Perf();
+    
+    
+    /**
+     * \brief Opens the counters for the calling thread, which must be the one sampling
+     *
+     * \return false if no counter could be opened
+     */
+    bool open();
+    void close();
+    bool isOpen() const;
+    
+    
+    /**
+     * \brief Whether a counter could be opened, and whether the hardware group is read with rdpmc
+     */
+    bool isAvailable(Motor_Perf_Sample::COUNTER) const;
+    bool usesRdpmc() const;
+    
+    
+    /**
+     * \brief Reads the current values
+     */
+    void read(Motor_Perf_Sample&);
+    
+    
+    /**
+     * \brief Adds the difference of two samples to a stage
+     */
+    void record(Motor_Metrics_Data::STAGE, const Motor_Perf_Sample& begin, const Motor_Perf_Sample& end);
+    
+    
+    Motor_Perf_Stats getStats(Motor_Metrics_Data::STAGE) const;
+    
+    
+    /**
+     * \brief Prints IPC and events per tick of each stage
+     */
+    void printReport(FILE* file = stdout) const;
+    
+    
+    static const char* counterName(Motor_Perf_Sample::COUNTER);
+    
+    
+private:
+    
+    int _openCounter(Motor_Perf_Sample::COUNTER);
+    void _readGroup(int group, Motor_Perf_Sample&);
+    bool _readRdpmc(Motor_Perf_Sample&);
+    
+    int _fd[Motor_Perf_Sample::NB_COUNTERS];
+    void* _page[Motor_Perf_Sample::NB_COUNTERS]; // mapped event pages, for rdpmc
+    
+    // Group leaders, and their members in read() order
+    int _leader[NB_GROUPS];
+    int _members[NB_GROUPS][Motor_Perf_Sample::NB_COUNTERS];
+    unsigned int _nb_members[NB_GROUPS];
+    
+    bool _rdpmc;
+    Motor_Perf_Stats _stats[Motor_Metrics_Data::NB_STAGES];
+};
+
+
+
+#endif /* Motor_Perf_hpp */
@@ -0,0 +1,275 @@
+//
+//  Motor_Pipeline.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Pipeline.hpp"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+
+
+Motor_Loop_Output::Motor_Loop_Output(Motor_Loop& loop, int fd) : _loop(loop), _fd(fd), _pending(0), _stalls(0){
+    _source = _loop.watch(_fd, 0, &Motor_Loop_Output::_on_writable, this); // EPOLLOUT armed on demand
+}
+
+
+Motor_Loop_Output::~Motor_Loop_Output(){
+    drain(100);
+    _unwatch();
+}
+
+
+void Motor_Loop_Output::_unwatch(){
+    _loop.unwatch(_source);
+    _source = -1;
+}
+
+
+bool Motor_Loop_Output::isOpen(){
+    return _fd >= 0 && _source >= 0;
+}
+
+
+int Motor_Loop_Output::write(const char* frame, unsigned int length){
+    
+    // Behind a backlog : queue, the stream must stay in order
+    if (_pending > 0){
+        if (_pending + length > BACKLOG_SIZE) return -1;
+        memcpy(_backlog+_pending, frame, length);
+        _pending += length;
+        return 1;
+    }
+    
+    ssize_t written = ::write(_fd, frame, length);
+    if (written == (ssize_t)length) return 1;
+    if (written < 0){
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        written = 0;
+    }
+    
+    // Port full : the rest goes out when it turns writable
+    if (length - written > BACKLOG_SIZE) return -1;
+    memcpy(_backlog, frame+written, length-written);
+    _pending = length-written;
+    _stalls++;
+    _loop.modify(_source, EPOLLOUT);
+    return 1;
+}
+
+
+int Motor_Loop_Output::read(char* buffer, unsigned int size){
+    ssize_t ret = ::read(_fd, buffer, size);
+    if (ret < 0) return 0; // EAGAIN, or the port is gone and the next write says so
+    return ret;
+}
+
+
+void Motor_Loop_Output::_flush(){
+    
+    ssize_t written = ::write(_fd, _backlog, _pending);
+    if (written < 0){
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        _pending = 0; // port gone : drop, MaestroMotor sees the next write fail
+    }
+    else if ((unsigned int)written < _pending){
+        memmove(_backlog, _backlog+written, _pending-written);
+        _pending -= written;
+        return;
+    }
+    else _pending = 0;
+    
+    _loop.modify(_source, 0);
+}
+
+
+bool Motor_Loop_Output::drain(int timeout_ms){
+    struct pollfd fd;
+    fd.fd = _fd;
+    fd.events = POLLOUT;
+    
+    while (_pending > 0 && _source >= 0){
+        fd.revents = 0;
+        if (::poll(&fd, 1, timeout_ms) <= 0 || (fd.revents & (POLLERR | POLLHUP))) return false;
+        _flush();
+    }
+    return _pending == 0;
+}
+
+
+void Motor_Loop_Output::_on_writable(void* context, uint32_t events){
+    Motor_Loop_Output* output = (Motor_Loop_Output*)context;
+    
+    // Hang up or error are reported even when not asked : the port is gone, stop watching it
+    if (events & (EPOLLERR | EPOLLHUP)){
+        output->_pending = 0;
+        output->_unwatch();
+        return;
+    }
+    output->_flush();
+}
+
+
+unsigned int Motor_Loop_Output::getBacklog() const {
+    return _pending;
+}
+
+
+uint64_t Motor_Loop_Output::getStalls() const {
+    return _stalls;
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------//
+
+
+
+Motor_Pipeline::Motor_Pipeline(MaestroMotor& maestro, Motor_Loop& loop, unsigned int period_us) : _maestro(maestro), _loop(loop),
+                                                _tick_source(-1),
+                                                _has_command(false), _stopped(false),
+                                                _telemetry(NULL), _framer(NULL), _telemetry_handler(NULL), _telemetry_context(NULL),
+                                                _telemetry_source(-1), _nb_esc_lines(0),
+                                                _downlink(NULL), _downlink_shared(false), _pwm_bytes(0), _ticks(0), _late_ticks(0){
+    _command.setZero();
+    _maestro.setPeriod(period_us);
+    _period = period_us;
+    _tick_source = _loop.addTimer(period_us, &Motor_Pipeline::_on_tick, this);
+}
+
+
+Motor_Pipeline::~Motor_Pipeline(){
+    for (unsigned int i=0; i<_nb_esc_lines; i++){
+        _loop.unwatch(_esc_lines[i].source);
+    }
+    _loop.unwatch(_telemetry_source);
+    _loop.unwatch(_tick_source);
+}
+
+
+bool Motor_Pipeline::isValid() const {
+    return _tick_source >= 0;
+}
+
+
+void Motor_Pipeline::postCommand(const Eigen::Vector4f& command, Motor_Command_Mux::SOURCE source){
+    _maestro.getCommandMux()->publish(source, command);
+}
+
+
+void Motor_Pipeline::_on_tick(void* context, uint32_t expirations){
+    Motor_Pipeline* pipeline = (Motor_Pipeline*)context;
+    MaestroMotor& maestro = pipeline->_maestro;
+    
+    if (pipeline->_stopped) return;
+    
+    if (maestro.getShutdown()){
+        maestro.setPositionToZero();
+        maestro.getMetrics()->publish();
+        pipeline->_stopped = true;
+        pipeline->_loop.stop();
+        return;
+    }
+    
+    // Constant time, whatever the sources do : no lock shared with them
+    if (maestro.getCommandMux()->select(pipeline->_command) >= 0) pipeline->_has_command = true;
+    
+    if (maestro.getLaunch() && pipeline->_has_command){
+        // A late loop runs one tick, not a burst : the missed deadlines are only counted
+        pipeline->_late_ticks += expirations-1;
+        pipeline->_ticks++;
+        maestro.tick(pipeline->_command);
+        
+        if (maestro.getPeriod() != pipeline->_period){
+            pipeline->_period = maestro.getPeriod();
+            pipeline->_loop.setTimer(pipeline->_tick_source, pipeline->_period);
+        }
+    }
+    
+    // Telemetry goes in what the PWM frame of this tick left of the slot
+    if (pipeline->_downlink != NULL){
+        if (pipeline->_downlink_shared){
+            uint64_t sent = maestro.getOutputStats().bytes_sent;
+            pipeline->_downlink->charge(sent - pipeline->_pwm_bytes);
+            pipeline->_pwm_bytes = sent;
+        }
+        pipeline->_downlink->service();
+    }
+}
+
+
+void Motor_Pipeline::_on_telemetry(void* context, uint32_t){
+    Motor_Pipeline* pipeline = (Motor_Pipeline*)context;
+    Frame_View frame;
+    int read;
+    
+    // Views are valid until the next poll : every frame is handed out before reading more
+    do {
+        read = pipeline->_framer->poll(*pipeline->_telemetry);
+        while (pipeline->_framer->next(frame)){
+            pipeline->_telemetry_handler(pipeline->_telemetry_context, frame);
+        }
+    } while (read > 0);
+}
+
+
+bool Motor_Pipeline::attachTelemetry(Serial& port, Serial_Framer& framer, Telemetry_Handler handler, void* context){
+    if (handler == NULL || _telemetry_source >= 0) return false;
+    
+    _telemetry = &port;
+    _framer = &framer;
+    _telemetry_handler = handler;
+    _telemetry_context = context;
+    _telemetry_source = _loop.watch(port.getFd(), EPOLLIN, &Motor_Pipeline::_on_telemetry, this);
+    return _telemetry_source >= 0;
+}
+
+
+void Motor_Pipeline::_on_esc_telemetry(void* context, uint32_t){
+    Esc_Line* line = (Esc_Line*)context;
+    char buffer[256];
+    int read;
+    
+    // Bounded : a babbling line can't hold the next tick
+    for (int i=0; i<4; i++){
+        read = line->port->read_available(buffer, sizeof(buffer));
+        if (read <= 0) break;
+        line->pipeline->_maestro.feedEscTelemetry(line->line, buffer, read);
+    }
+}
+
+
+bool Motor_Pipeline::attachEscTelemetry(Serial& port, int line){
+    if (_nb_esc_lines >= Servo_Telemetry::NB_LINES) return false;
+    
+    Esc_Line& esc = _esc_lines[_nb_esc_lines];
+    esc.pipeline = this;
+    esc.port = &port;
+    esc.line = line;
+    esc.source = _loop.watch(port.getFd(), EPOLLIN, &Motor_Pipeline::_on_esc_telemetry, &esc);
+    if (esc.source < 0) return false;
+    _nb_esc_lines++;
+    return true;
+}
+
+
+void Motor_Pipeline::attachDownlink(Motor_Downlink& downlink, bool shared){
+    _downlink = &downlink;
+    _downlink_shared = shared;
+    _pwm_bytes = _maestro.getOutputStats().bytes_sent;
+}
+
+
+uint64_t Motor_Pipeline::getTicks() const {
+    return _ticks;
+}
+
+
+uint64_t Motor_Pipeline::getLateTicks() const {
+    return _late_ticks;
+}
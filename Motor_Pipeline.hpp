@@ -0,0 +1,214 @@
+//
+//  Motor_Pipeline.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Pipeline_hpp
+#define Motor_Pipeline_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "MaestroMotor.hpp"
+#include "Motor_Loop.hpp"
+#include "Motor_Io.hpp"
+#include "Serial_Framer.hpp"
+#include "Motor_Downlink.hpp"
+
+
+
+/**
+ * \class Motor_Loop_Output
+ * \brief Non-blocking servo port output driven by a Motor_Loop
+ *
+ * A frame the UART can't take at once is kept, and the rest is written when the fd turns
+ * writable (EPOLLOUT armed only meanwhile). Later frames queue behind it so the byte
+ * stream stays in order ; when the backlog is full write() fails and MaestroMotor sends
+ * a full frame next tick.
+ */
+class Motor_Loop_Output : public Motor_Output {
+    
+public:
+    
+    enum { BACKLOG_SIZE = 256 };
+    
+    /**
+     * \brief Constructor
+     *
+     * \param Motor_Loop& : loop of the motor thread, int : fd of the servo port (non-blocking)
+     */
+    Motor_Loop_Output(Motor_Loop&, int fd);
+    
+    /**
+     * \brief Destructor, drains the backlog (the shutdown frame is often the last one)
+     */
+    ~Motor_Loop_Output();
+    
+    bool isOpen();
+    
+    int write(const char*, unsigned int);
+    
+    int read(char*, unsigned int);
+    
+    /**
+     * \brief Writes the backlog out, blocking up to timeout_ms. For after the loop has stopped
+     *
+     * \return false if bytes are left
+     */
+    bool drain(int timeout_ms);
+    
+    /**
+     * \brief Returns the bytes waiting for the port to be writable
+     */
+    unsigned int getBacklog() const;
+    
+    /**
+     * \brief Returns the number of times the port was found full
+     */
+    uint64_t getStalls() const;
+    
+private:
+    
+    static void _on_writable(void*, uint32_t);
+    void _flush();
+    void _unwatch();
+    
+    Motor_Loop& _loop;
+    int _fd;
+    int _source;
+    
+    char _backlog[BACKLOG_SIZE];
+    unsigned int _pending;
+    uint64_t _stalls;
+};
+
+
+
+
+/**
+ * \class Motor_Pipeline
+ * \brief Motor stack on a single Motor_Loop : commands, tick deadline, output and telemetry
+ *
+ * - commands : postCommand() from any thread publishes in the MaestroMotor command mux
+ * - tick deadline : periodic timer, runs MaestroMotor::tick() with the command of the
+ *   highest-priority live source. Re-armed when the governor changes the period
+ * - serial writable : through Motor_Loop_Output, when the MaestroMotor was built on one
+ * - telemetry line : readable port, split by a Serial_Framer, frames handed to a handler
+ * - ESC telemetry lines : readable ports, parsed by MaestroMotor::feedEscTelemetry
+ * - telemetry downlink : a Motor_Downlink slot after each tick
+ *
+ * Replaces MaestroMotor::start() and its thread : the loop runs on the caller's thread.
+ * Ticks start once the MaestroMotor is launched and a command arrived ; after shutdown()
+ * the motors are set to zero and the loop stops.
+ */
+class Motor_Pipeline {
+    
+public:
+    
+    /**
+     * \brief Telemetry handler, called on the loop thread for each frame
+     */
+    typedef void (*Telemetry_Handler)(void* context, const Frame_View&);
+    
+    
+    /**
+     * \brief Constructor, registers the command and tick sources on the loop
+     *
+     * \param MaestroMotor&, Motor_Loop&, unsigned int : tick period in us (set as the MaestroMotor nominal period)
+     */
+    Motor_Pipeline(MaestroMotor&, Motor_Loop&, unsigned int period_us);
+    
+    
+    ~Motor_Pipeline();
+    
+    
+    /**
+     * \brief Returns false if a source couldn't be registered
+     */
+    bool isValid() const;
+    
+    
+    /**
+     * \brief Hands the next command of a source to the motor. Threadsafe, wait-free
+     *
+     * One thread per source (see Motor_Command_Mux)
+     */
+    void postCommand(const Eigen::Vector4f&, Motor_Command_Mux::SOURCE = Motor_Command_Mux::source_autopilot);
+    
+    
+    /**
+     * \brief Reads telemetry from a port on the loop
+     *
+     * \param Serial& : port, Serial_Framer& : its framing, Telemetry_Handler, void* : its context
+     * \return false if the port couldn't be watched
+     */
+    bool attachTelemetry(Serial&, Serial_Framer&, Telemetry_Handler, void*);
+    
+    
+    /**
+     * \brief Reads ESC telemetry from a port on the loop, ahead of the ticks that use it
+     *
+     * \param Serial& : port, int : its line (the motor, unless the line is shared)
+     * \return false if the port couldn't be watched or all lines are taken
+     */
+    bool attachEscTelemetry(Serial&, int line = 0);
+    
+    
+    /**
+     * \brief Runs a slot of the downlink after each tick, launched or not
+     *
+     * \param Motor_Downlink&, bool : its link also carries the PWM frames (their bytes are charged to it)
+     */
+    void attachDownlink(Motor_Downlink&, bool shared);
+    
+    
+    /**
+     * \brief Returns the number of ticks run, and skipped because the loop was late
+     */
+    uint64_t getTicks() const;
+    uint64_t getLateTicks() const;
+    
+    
+private:
+    
+    static void _on_tick(void*, uint32_t);
+    static void _on_telemetry(void*, uint32_t);
+    static void _on_esc_telemetry(void*, uint32_t);
+    
+    MaestroMotor& _maestro;
+    Motor_Loop& _loop;
+    
+    int _tick_source;
+    uint32_t _period; // us, of the tick timer
+    
+    Eigen::Vector4f _command; // loop thread only
+    bool _has_command; // a source was live once : ticks run from then on
+    bool _stopped;
+    
+    Serial* _telemetry;
+    Serial_Framer* _framer;
+    Telemetry_Handler _telemetry_handler;
+    void* _telemetry_context;
+    int _telemetry_source;
+    
+    struct Esc_Line {
+        Motor_Pipeline* pipeline;
+        Serial* port;
+        int line;
+        int source;
+    };
+    Esc_Line _esc_lines[Servo_Telemetry::NB_LINES];
+    unsigned int _nb_esc_lines;
+    
+    Motor_Downlink* _downlink;
+    bool _downlink_shared;
+    uint64_t _pwm_bytes; // sent by the MaestroMotor at the last slot
+    
+    uint64_t _ticks;
+    uint64_t _late_ticks;
+};
+
+
+
+#endif /* Motor_Pipeline_hpp */
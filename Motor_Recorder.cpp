@@ -0,0 +1,113 @@
+//
+//  Motor_Recorder.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Recorder.hpp"
+#include "Motor_Event_Log.hpp"
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+
+Motor_Recorder::Motor_Recorder() : _header(NULL), _records(NULL), _size(0), _capacity(0), _head(0) {
+}
+
+
+Motor_Recorder::~Motor_Recorder(){
+    _close();
+}
+
+
+void Motor_Recorder::_close(){
+    if (_header == NULL) return;
+    msync(_header, _size, MS_SYNC);
+    munlock(_header, _size);
+    munmap(_header, _size);
+    _header = NULL;
+    _records = NULL;
+}
+
+
+bool Motor_Recorder::open(const char* path, unsigned int capacity, unsigned int period_us){
+    
+    _close();
+    if (capacity == 0) return false;
+    
+    size_t size = MOTOR_RECORDER_HEADER_SIZE + (size_t)capacity*sizeof(Motor_Tick_Record);
+    
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0) return false;
+    
+    // Blocks are allocated now : no allocation, nor ENOSPC as SIGBUS, in flight
+    if (posix_fallocate(fd, 0, size) != 0){
+        ::close(fd);
+        return false;
+    }
+    
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) return false;
+    
+    // Touches every page for writing, then pins them : no fault on the motor thread
+    memset(ptr, 0, size);
+    mlock(ptr, size); // best effort, may exceed RLIMIT_MEMLOCK
+    
+    _header = (Motor_Recorder_Header*)ptr;
+    _records = (Motor_Tick_Record*)((char*)ptr + MOTOR_RECORDER_HEADER_SIZE);
+    _size = size;
+    _capacity = capacity;
+    _head = 0;
+    
+    memcpy(_header->magic, MOTOR_RECORDER_MAGIC, 4);
+    _header->version = MOTOR_RECORDER_FORMAT_VERSION;
+    _header->record_size = sizeof(Motor_Tick_Record);
+    _header->capacity = capacity;
+    _header->period_us = period_us;
+    _header->pid = getpid();
+    _header->created = time(NULL);
+    _header->head.store(0, std::memory_order_release);
+    return true;
+}
+
+
+bool Motor_Recorder::isOpen() const {
+    return _header != NULL;
+}
+
+
+Motor_Tick_Record* Motor_Recorder::next(){
+    if (_header == NULL) return NULL;
+    
+    Motor_Tick_Record* record = &_records[_head % _capacity];
+    
+    // Invalidates the slot before overwriting it
+    ((std::atomic<uint64_t>*)&record->sequence)->store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return record;
+}
+
+
+void Motor_Recorder::commit(Motor_Tick_Record* record){
+    if (record == NULL) return;
+    
+    record->timestamp = Motor_Event_Log::now();
+    _head++;
+    ((std::atomic<uint64_t>*)&record->sequence)->store(_head, std::memory_order_release);
+    _header->head.store(_head, std::memory_order_release);
+}
+
+
+void Motor_Recorder::sync(){
+    if (_header != NULL) msync(_header, _size, MS_SYNC);
+}
+
+
+uint64_t Motor_Recorder::getHead() const {
+    return _head;
+}
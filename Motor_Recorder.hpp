@@ -0,0 +1,152 @@
+//
+//  Motor_Recorder.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Recorder_hpp
+#define Motor_Recorder_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+
+#define MOTOR_RECORDER_MAGIC "MMFR"
+#define MOTOR_RECORDER_FORMAT_VERSION 1
+#define MOTOR_RECORDER_HEADER_SIZE 4096
+
+
+
+/**
+ * \struct Motor_Tick_Record
+ * \brief What MaestroMotor computed during one control tick, 80 bytes
+ *
+ * sequence is cleared first and written last : a slot caught mid-write by a crash reads as empty
+ */
+struct Motor_Tick_Record {
+    
+    /**
+     * \brief Bits of flags, per motor i : (FLAG << 4*i). tick_failed is global
+     */
+    enum FLAG {
+        flag_speed_low=1, // negative square speed, clamped to 0
+        flag_speed_high=2, // above servo_max_real
+        flag_acceleration=4, // above max_motor_acceleration
+        flag_pwm_range=8, // PWM out of [servo_val_min, servo_val_max]
+        flag_tick_failed=(1<<16) // Motor_Exception during the tick
+    };
+    
+    uint64_t sequence; // 1 for the first tick, 0 for an empty slot
+    uint64_t timestamp; // ns, CLOCK_MONOTONIC
+    float command[4]; // U1..U4
+    float square_speed[4]; // before saturation, rd^2/s^2
+    float motor_speed[4]; // after saturation, rd/s
+    uint16_t servo_out[4]; // us
+    uint32_t flags;
+    uint32_t params_version;
+};
+
+
+/**
+ * \struct Motor_Recorder_Header
+ * \brief First page of the recorder file
+ */
+struct Motor_Recorder_Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity; // records in the ring
+    uint32_t period_us;
+    uint32_t pid;
+    uint64_t created; // s, CLOCK_REALTIME
+    std::atomic<uint64_t> head; // records written since the creation
+};
+
+
+
+
+/**
+ * \class Motor_Recorder
+ * \brief Black box : ring of Motor_Tick_Record in a memory-mapped file
+ *
+ * The file is preallocated, mapped, prefaulted and locked by open(). record() is then plain
+ * memory stores : no syscall and no page fault on the motor thread. The mapping is shared with
+ * the page cache, so records survive a crash of the process (not a power loss, see sync()).
+ * Decoded by tools/flight_recorder_decode.cpp
+ */
+class Motor_Recorder {
+    
+public:
+    
+    /**
+     * \brief Constructor (records nothing until open() succeeds)
+     */
+    Motor_Recorder();
+    
+    
+    /**
+     * \brief Destructor (syncs and unmaps)
+     */
+    ~Motor_Recorder();
+    
+    
+    /**
+     * \brief Creates, or truncates, and maps the recorder file
+     *
+     * \param const char* : path, unsigned int : capacity in records, unsigned int : tick period in us
+     * \return false if the file couldn't be allocated or mapped
+     */
+    bool open(const char* path, unsigned int capacity, unsigned int period_us);
+    
+    
+    /**
+     * \brief Returns true once open() succeeded
+     */
+    bool isOpen() const;
+    
+    
+    /**
+     * \brief Returns the slot of the next record, to be filled then committed
+     *
+     * Single writer : the motor thread. sequence and timestamp are set by commit()
+     *
+     * \return Motor_Tick_Record* or NULL if not open
+     */
+    Motor_Tick_Record* next();
+    
+    
+    /**
+     * \brief Stamps and publishes the slot returned by next()
+     */
+    void commit(Motor_Tick_Record*);
+    
+    
+    /**
+     * \brief Flushes the mapping to the disk (blocking, not for the motor thread)
+     */
+    void sync();
+    
+    
+    /**
+     * \brief Returns the number of records written
+     */
+    uint64_t getHead() const;
+    
+    
+private:
+    
+    void _close();
+    
+    Motor_Recorder_Header* _header;
+    Motor_Tick_Record* _records;
+    size_t _size; // of the mapping
+    unsigned int _capacity;
+    uint64_t _head; // local copy, single writer
+    
+};
+
+
+
+#endif /* Motor_Recorder_hpp */
@@ -0,0 +1,60 @@
+//
+//  Motor_Rpm_Control.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Rpm_Control.hpp"
+#include <string.h>
+
+
+
+Motor_Rpm_Control::Motor_Rpm_Control(){
+    reset();
+    memset(_stats, 0, sizeof(_stats));
+}
+
+
+void Motor_Rpm_Control::reset(){
+    for (int i=0; i<NB_MOTORS; i++){
+        _integral[i] = 0;
+    }
+}
+
+
+float Motor_Rpm_Control::update(int i, float command, float measured, bool fresh, float dt, float kp, float ki, float limit){
+    
+    Motor_Rpm_Control_Stats& stats = _stats[i];
+    
+    // Nothing to track : open loop
+    if (!fresh || !(command > 0)){
+        _integral[i] = 0;
+        stats.open_ticks++;
+        stats.last_error = 0;
+        stats.last_correction = 0;
+        return 0;
+    }
+    
+    float error = command - measured;
+    
+    _integral[i] += ki*error*dt;
+    if (_integral[i] > limit) _integral[i] = limit;
+    if (_integral[i] < -limit) _integral[i] = -limit;
+    
+    float correction = kp*error + _integral[i];
+    if (correction > limit || correction < -limit){
+        correction = (correction > 0 ? limit : -limit);
+        stats.saturated_ticks++;
+    }
+    
+    stats.closed_ticks++;
+    stats.last_error = error;
+    stats.last_correction = correction;
+    return correction;
+}
+
+
+Motor_Rpm_Control_Stats Motor_Rpm_Control::getStats(int i) const {
+    return _stats[i];
+}
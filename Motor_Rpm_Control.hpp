@@ -0,0 +1,78 @@
+//
+//  Motor_Rpm_Control.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Rpm_Control_hpp
+#define Motor_Rpm_Control_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+
+/**
+ * \struct Motor_Rpm_Control_Stats
+ * \brief Counters of a Motor_Rpm_Control, per motor
+ */
+struct Motor_Rpm_Control_Stats {
+    uint64_t closed_ticks; // corrected with fresh telemetry
+    uint64_t open_ticks; // telemetry stale : open loop
+    uint64_t saturated_ticks; // correction at its limit
+    float last_error; // rd/s, commanded - measured
+    float last_correction; // rd/s
+};
+
+
+
+
+/**
+ * \class Motor_Rpm_Control
+ * \brief Per-motor PI correction of the commanded speeds from the measured ones
+ *
+ * The command stays the feed-forward : the correction is added to it, in rd/s, before the
+ * speed is turned into a PWM pulse or a DShot throttle, so the output saturations still apply.
+ * Without fresh telemetry, or with the motor stopped, the integral is cleared and the motor
+ * runs open loop. The integral is clamped to the correction limit (anti-windup).
+ */
+class Motor_Rpm_Control {
+    
+public:
+    
+    enum { NB_MOTORS = 4 };
+    
+    
+    Motor_Rpm_Control();
+    
+    
+    /**
+     * \brief Returns the correction of a motor for this tick
+     *
+     * \param int : motor, float : commanded speed, float : measured speed (rd/s)
+     * \param bool : measure fresh, float : tick period in s
+     * \param float kp, float ki (1/s), float : correction limit (rd/s)
+     * \return correction in rd/s
+     */
+    float update(int, float command, float measured, bool fresh, float dt, float kp, float ki, float limit);
+    
+    
+    /**
+     * \brief Clears the integrals
+     */
+    void reset();
+    
+    
+    Motor_Rpm_Control_Stats getStats(int) const;
+    
+    
+private:
+    
+    float _integral[NB_MOTORS];
+    Motor_Rpm_Control_Stats _stats[NB_MOTORS];
+};
+
+
+
+#endif /* Motor_Rpm_Control_hpp */
@@ -0,0 +1,241 @@
+//
+//  Motor_Shm.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Shm.hpp"
+#include "Motor_Event_Log.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+
+
+
+// Shared (not private) futexes : waiters and wakers live in different processes
+static void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, unsigned int timeout_us){
+    struct timespec timeout;
+    timeout.tv_sec = timeout_us/1000000;
+    timeout.tv_nsec = (timeout_us%1000000)*1000;
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+
+static void futex_wake(std::atomic<uint32_t>* word){
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+// Seqlock write : sequence is odd while the block is inconsistent
+template <typename Block, typename Writer>
+static uint32_t seqlock_write(Block& block, Writer write){
+    uint32_t sequence = block.sequence.load(std::memory_order_relaxed);
+    block.sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    write(block);
+    block.sequence.store(sequence+2, std::memory_order_release);
+    
+    // Store-load : without a full barrier, waiters could be read before the sequence is
+    // visible, missing a waiter that already checked the old sequence (woken by its timeout)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (block.waiters.load(std::memory_order_seq_cst) > 0) futex_wake(&block.sequence);
+    return sequence+2;
+}
+
+
+// Seqlock read : retries until a copy was taken between two identical even sequences.
+// Bounded : a writer that died mid-write leaves the sequence odd until its restart
+template <typename Block, typename Reader>
+static bool seqlock_read(const Block& block, Reader read, uint32_t& sequence){
+    for (int retry=0; retry<Motor_Shm::MAX_RETRIES; retry++){
+        uint32_t before = block.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        read(block);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (block.sequence.load(std::memory_order_relaxed) == before){
+            sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Sleeps until sequence differs from last, or timeout
+template <typename Block>
+static bool wait_newer(Block& block, uint32_t last, unsigned int timeout_us){
+    uint32_t sequence = block.sequence.load(std::memory_order_acquire);
+    if (sequence != last && !(sequence & 1)) return true;
+    if (timeout_us == 0) return false;
+    
+    uint64_t deadline = Motor_Event_Log::now() + (uint64_t)timeout_us*1000;
+    block.waiters.fetch_add(1, std::memory_order_seq_cst);
+    while (true){
+        sequence = block.sequence.load(std::memory_order_seq_cst);
+        if (sequence != last && !(sequence & 1)) break;
+        uint64_t now = Motor_Event_Log::now();
+        if (now >= deadline) break;
+        futex_wait(&block.sequence, sequence, (deadline-now)/1000+1);
+    }
+    block.waiters.fetch_sub(1, std::memory_order_seq_cst);
+    
+    return (sequence != last && !(sequence & 1));
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------//
+
+
+
+Motor_Shm::Motor_Shm(ROLE role, const char* name) : _role(role), _name(name), _segment(NULL),
+                                                     _last_command(0), _last_command_timestamp(0), _last_status(0)
+{
+}
+
+
+Motor_Shm::~Motor_Shm(){
+    if (_segment != NULL) munmap(_segment, sizeof(Motor_Shm_Segment));
+}
+
+
+bool Motor_Shm::open(){
+    
+    if (_segment != NULL) return true;
+    
+    int fd = shm_open(_name, O_RDWR | O_CREAT, 0660);
+    if (fd < 0) return false;
+    
+    // Whoever comes first sizes it, the new pages are zero-filled
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (st.st_size < (off_t)sizeof(Motor_Shm_Segment) && ftruncate(fd, sizeof(Motor_Shm_Segment)) < 0)){
+        close(fd);
+        return false;
+    }
+    
+    void* ptr = mmap(NULL, sizeof(Motor_Shm_Segment), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return false;
+    _segment = (Motor_Shm_Segment*)ptr;
+    
+    // The first opener claims the header, writes it, then publishes the magic : the others
+    // never see the magic before the version
+    uint32_t magic = 0;
+    if (_segment->magic.compare_exchange_strong(magic, MOTOR_SHM_CLAIMED)){
+        _segment->version = MOTOR_SHM_VERSION;
+        _segment->magic.store(MOTOR_SHM_MAGIC, std::memory_order_release);
+        magic = MOTOR_SHM_MAGIC;
+    }
+    // Opened at the same time as the other side : it is only a store away
+    for (int retry=0; magic == MOTOR_SHM_CLAIMED && retry<MAX_RETRIES; retry++){
+        usleep(100);
+        magic = _segment->magic.load(std::memory_order_acquire);
+    }
+    if (magic != MOTOR_SHM_MAGIC || _segment->version != MOTOR_SHM_VERSION){
+        munmap(_segment, sizeof(Motor_Shm_Segment));
+        _segment = NULL;
+        return false;
+    }
+    
+    // A previous writer of our role may have died in the middle of a write
+    if (_role == client){
+        uint32_t sequence = _segment->command.sequence.load();
+        if (sequence & 1) _segment->command.sequence.store(sequence+1);
+        _last_status = _segment->status.sequence.load();
+    }
+    else {
+        uint32_t sequence = _segment->status.sequence.load();
+        if (sequence & 1) _segment->status.sequence.store(sequence+1);
+        // The last command written, if any, is applied again after a restart
+        uint32_t command = _segment->command.sequence.load() & ~1u;
+        _last_command = (command > 0 ? command-2 : 0);
+    }
+    
+    return true;
+}
+
+
+void Motor_Shm::unlink(const char* name){
+    shm_unlink(name);
+}
+
+
+
+uint32_t Motor_Shm::writeCommand(const float* command, bool shutdown){
+    uint64_t timestamp = Motor_Event_Log::now();
+    return seqlock_write(_segment->command, [&](Motor_Shm_Command& block){
+        block.timestamp = timestamp;
+        memcpy(block.command, command, sizeof(block.command));
+        block.shutdown = shutdown;
+    });
+}
+
+
+bool Motor_Shm::waitCommand(float* command, bool& shutdown, unsigned int timeout_us){
+    
+    if (!wait_newer(_segment->command, _last_command, timeout_us)) return false;
+    
+    float copy[4];
+    uint64_t timestamp;
+    uint32_t stop;
+    if (!seqlock_read(_segment->command, [&](const Motor_Shm_Command& block){
+        memcpy(copy, block.command, sizeof(block.command));
+        timestamp = block.timestamp;
+        stop = block.shutdown;
+    }, _last_command)) return false;
+    
+    memcpy(command, copy, sizeof(copy));
+    _last_command_timestamp = timestamp;
+    shutdown = stop;
+    return true;
+}
+
+
+uint64_t Motor_Shm::getCommandTimestamp() const {
+    return _last_command_timestamp;
+}
+
+
+
+void Motor_Shm::writeStatus(const Motor_Status& status){
+    Motor_Status published = status;
+    published.daemon_pid = getpid();
+    published.command_sequence = _last_command;
+    published.heartbeat = Motor_Event_Log::now();
+    
+    seqlock_write(_segment->status, [&](Motor_Shm_Status& block){
+        block.status = published;
+    });
+}
+
+
+bool Motor_Shm::readStatus(Motor_Status& status, unsigned int timeout_us){
+    
+    bool newer = wait_newer(_segment->status, _last_status, timeout_us);
+    
+    Motor_Status copy;
+    if (!seqlock_read(_segment->status, [&](const Motor_Shm_Status& block){
+        copy = block.status;
+    }, _last_status)) return false;
+    
+    status = copy;
+    return newer;
+}
+
+
+bool Motor_Shm::isDaemonAlive(unsigned int max_age_us){
+    Motor_Status status;
+    uint32_t sequence;
+    if (!seqlock_read(_segment->status, [&](const Motor_Shm_Status& block){
+        status = block.status;
+    }, sequence)) return false;
+    return status.daemon_pid != 0 && Motor_Event_Log::now() - status.heartbeat < (uint64_t)max_age_us*1000;
+}
@@ -0,0 +1,203 @@
+//
+//  Motor_Shm.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Shm_hpp
+#define Motor_Shm_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+
+
+#define MOTOR_SHM_NAME "/maestro_motor"
+#define MOTOR_SHM_MAGIC 0x4D4D5348 // "MMSH"
+#define MOTOR_SHM_CLAIMED 0x4D4D5300 // magic while the first opener writes the header
+#define MOTOR_SHM_VERSION 1
+
+
+
+/**
+ * \struct Motor_Shm_Command
+ * \brief Command slot, written by the autopilot (client) under a seqlock
+ */
+struct Motor_Shm_Command {
+    std::atomic<uint32_t> sequence; // odd while being written, also the futex word
+    std::atomic<uint32_t> waiters; // daemon sleeping on sequence
+    uint64_t timestamp; // ns, CLOCK_MONOTONIC, when written
+    float command[4]; // U1..U4, as given to MaestroMotor::_update
+    uint32_t shutdown; // asks the daemon to put the motors down
+};
+
+
+/**
+ * \struct Motor_Status
+ * \brief Status/telemetry published by the daemon
+ */
+struct Motor_Status {
+    uint32_t daemon_pid; // 0 when no daemon ever attached
+    uint32_t command_sequence; // last command sequence applied
+    uint64_t heartbeat; // ns, CLOCK_MONOTONIC, refreshed each daemon loop
+    uint64_t ticks;
+    uint64_t command_latency; // ns between command write and its application
+    float motor_speed[4]; // rd/s
+    uint16_t servo_out[4]; // us
+};
+
+
+/**
+ * \struct Motor_Shm_Status
+ * \brief Status block, written by the daemon under a seqlock
+ */
+struct Motor_Shm_Status {
+    std::atomic<uint32_t> sequence; // odd while being written, also the futex word
+    std::atomic<uint32_t> waiters; // clients sleeping on sequence
+    Motor_Status status;
+};
+
+
+/**
+ * \struct Motor_Shm_Segment
+ * \brief Layout of the shared segment. A zero-filled segment is a valid initial state
+ */
+struct Motor_Shm_Segment {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    char _pad0[56];
+    Motor_Shm_Command command; // own cache lines : client writes here only
+    char _pad1[64];
+    Motor_Shm_Status status; // own cache lines : daemon writes here only
+    char _pad2[64];
+};
+
+
+
+
+/**
+ * \class Motor_Shm
+ * \brief Maps the POSIX shared segment between the autopilot and the motor daemon
+ *
+ * The autopilot (client) writes the command slot, the daemon writes the status block.
+ * Each side is a single writer using a seqlock, readers never block the writer.
+ * Sleeping readers are woken through a futex on the sequence word, only when some are waiting.
+ * The segment outlives both processes, so either one can restart independently.
+ */
+class Motor_Shm {
+    
+public:
+    
+    enum { MAX_RETRIES = 64 }; // seqlock reads, before the block is reported unavailable
+    
+    
+    /**
+     * \enum ROLE
+     * \brief Side of the segment this process writes
+     */
+    enum ROLE {
+        client=0,
+        daemon=1
+    };
+    
+    
+    /**
+     * \brief Constructor (nothing is mapped yet)
+     *
+     * \param ROLE, const char* : segment name
+     */
+    Motor_Shm(ROLE, const char* name = MOTOR_SHM_NAME);
+    
+    
+    /**
+     * \brief Destructor (unmaps, never unlinks)
+     */
+    ~Motor_Shm();
+    
+    
+    /**
+     * \brief Creates or attaches the segment
+     *
+     * Repairs a half-written block left by a crashed writer of our role
+     *
+     * \return false if the segment couldn't be mapped or has another layout version (or its
+     *         creator died before writing the header : unlink it)
+     */
+    bool open();
+    
+    
+    /**
+     * \brief Removes the segment name (mapped processes keep it)
+     */
+    static void unlink(const char* name = MOTOR_SHM_NAME);
+    
+    
+    
+    /**
+     * \brief Client side : publishes a new command and wakes the daemon
+     *
+     * \param const float* : 4 commands, bool : shutdown request
+     * \return sequence number of the command
+     */
+    uint32_t writeCommand(const float*, bool shutdown = false);
+    
+    
+    /**
+     * \brief Daemon side : waits for a command newer than the last one read
+     *
+     * \param float* : 4 commands, bool& : shutdown request
+     * \param unsigned int : timeout in us (0 : don't wait)
+     * \return false on timeout, or if the client died in the middle of a write (commands left untouched)
+     */
+    bool waitCommand(float*, bool&, unsigned int timeout_us);
+    
+    
+    /**
+     * \brief Daemon side : returns the write timestamp of the last command read
+     */
+    uint64_t getCommandTimestamp() const;
+    
+    
+    /**
+     * \brief Daemon side : publishes the status and wakes waiting clients
+     *
+     * \param Motor_Status : daemon_pid, heartbeat and command_sequence are filled here
+     */
+    void writeStatus(const Motor_Status&);
+    
+    
+    /**
+     * \brief Client side : reads a consistent copy of the status
+     *
+     * \param unsigned int : timeout in us waiting for a newer status than the last one read (0 : don't wait)
+     * \return false on timeout (copy still done), or if the daemon died in the middle of a write
+     *         (status left untouched)
+     */
+    bool readStatus(Motor_Status&, unsigned int timeout_us = 0);
+    
+    
+    /**
+     * \brief Client side : returns true if the daemon refreshed its heartbeat within max_age_us
+     *
+     * false as well if the status block is left half-written by a dead daemon
+     */
+    bool isDaemonAlive(unsigned int max_age_us);
+    
+    
+private:
+    
+    ROLE _role;
+    const char* _name;
+    Motor_Shm_Segment* _segment;
+    
+    uint32_t _last_command; // daemon : sequence of the last command read
+    uint64_t _last_command_timestamp;
+    uint32_t _last_status; // client : sequence of the last status read
+    
+};
+
+
+
+#endif /* Motor_Shm_hpp */
@@ -0,0 +1,153 @@
+//
+//  Motor_Sim.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Sim.hpp"
+#include "Work_Pool.hpp"
+
+
+
+// xorshift32 : small, per scenario, reproducible from the seed
+static inline float sim_random(uint32_t& state){
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state & 0xFFFFFF) / (float)0x800000 - 1.f; // [-1, 1)
+}
+
+
+
+Sim_Scenario Motor_Sim::defaultScenario(){
+    Sim_Scenario scenario;
+    memset(&scenario, 0, sizeof(scenario));
+    
+    scenario.params = Motor_Params::fromConfig();
+    scenario.time_rate = MIN_TIME_RATE;
+    scenario.ticks = 2000;
+    scenario.step_tick = 500;
+    scenario.seed = 1;
+    
+    // Hover at half of the maximum speed on every motor : U1 = 4.k.w^2
+    float speed = MAX_MOTOR_SPEED/2;
+    scenario.hover[0] = 4*thrust_factor*speed*speed;
+    scenario.step[0] = scenario.hover[0]/2;
+    return scenario;
+}
+
+
+
+Sim_Result Motor_Sim::run(const Sim_Scenario& scenario){
+    
+    Sim_Result result;
+    memset(&result, 0, sizeof(result));
+    
+    Motor_Virtual_Clock clock;
+    Motor_Memory_Output output;
+    MaestroMotor maestro(scenario.time_rate, &output, &clock);
+    maestro.publishParams(scenario.params);
+    maestro.setGoverning(false); // it measures real tick times : the load of the pool would change dt
+    
+    uint32_t random = (scenario.seed != 0 ? scenario.seed : 1);
+    Eigen::Vector4f command;
+    Eigen::Vector4f previous = maestro.getMotorSpeed();
+    bool settled = false;
+    uint16_t servo_out[4];
+    
+    for (unsigned int t=0; t<scenario.ticks; t++){
+        
+        for (int i=0; i<4; i++){
+            command[i] = scenario.hover[i] + (t >= scenario.step_tick ? scenario.step[i] : 0) + scenario.noise[i]*sim_random(random);
+        }
+        
+        maestro.tick(command);
+        clock.sleep(1000*scenario.time_rate);
+        
+        Eigen::Vector4f speed = maestro.getMotorSpeed();
+        maestro.getServoOut(servo_out);
+        
+        for (int i=0; i<4; i++){
+            if (speed[i] > result.max_speed) result.max_speed = speed[i];
+            if (servo_out[i] > result.max_servo_out) result.max_servo_out = servo_out[i];
+        }
+        
+        if (t > scenario.step_tick && !settled){
+            settled = ((speed-previous).cwiseAbs().maxCoeff() < 0.5f);
+            if (settled) result.settle_ticks = t - scenario.step_tick;
+            result.settled = settled;
+        }
+        previous = speed;
+    }
+    
+    const Motor_Metrics_Data& metrics = maestro.getMetrics()->getData();
+    for (int i=0; i<4; i++){
+        for (int s=0; s<Motor_Metrics_Data::NB_SATURATIONS; s++){
+            result.saturations[s] += metrics.saturations[i][s];
+        }
+    }
+    maestro.getServoOut(result.final_servo_out);
+    result.bytes_out = output.getBytes();
+    return result;
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------------------//
+
+
+
+struct Sim_Batch {
+    const Sim_Scenario* scenarios;
+    Sim_Result* results;
+};
+
+
+static void sim_job(void* context, unsigned int index, unsigned int){
+    Sim_Batch* batch = (Sim_Batch*)context;
+    batch->results[index] = Motor_Sim::run(batch->scenarios[index]); // one writer per slot
+}
+
+
+Sim_Summary Motor_Sim::runAll(const Sim_Scenario* scenarios, Sim_Result* results, unsigned int count, unsigned int workers){
+    Sim_Batch batch;
+    batch.scenarios = scenarios;
+    batch.results = results;
+    
+    Work_Pool pool(workers);
+    pool.run(count, sim_job, &batch);
+    
+    return summarize(results, count);
+}
+
+
+Sim_Summary Motor_Sim::summarize(const Sim_Result* results, unsigned int count){
+    Sim_Summary summary;
+    memset(&summary, 0, sizeof(summary));
+    summary.scenarios = count;
+    
+    uint64_t settle_total = 0;
+    unsigned int settled = 0;
+    
+    for (unsigned int i=0; i<count; i++){
+        const Sim_Result& result = results[i];
+        for (int s=0; s<Motor_Metrics_Data::NB_SATURATIONS; s++){
+            summary.saturations[s] += result.saturations[s];
+        }
+        if (result.max_speed > summary.max_speed) summary.max_speed = result.max_speed;
+        if (result.max_servo_out > summary.max_servo_out) summary.max_servo_out = result.max_servo_out;
+        
+        if (!result.settled){
+            summary.unsettled++;
+            continue;
+        }
+        settle_total += result.settle_ticks;
+        settled++;
+        if (result.settle_ticks > summary.max_settle_ticks) summary.max_settle_ticks = result.settle_ticks;
+    }
+    
+    summary.mean_settle_ticks = (settled > 0 ? (double)settle_total/settled : 0);
+    return summary;
+}
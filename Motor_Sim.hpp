@@ -0,0 +1,174 @@
+//
+//  Motor_Sim.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Sim_hpp
+#define Motor_Sim_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "MaestroMotor.hpp"
+#include "Motor_Io.hpp"
+#include "Motor_Params.hpp"
+
+
+
+/**
+ * \class Motor_Virtual_Clock
+ * \brief Simulated time : sleeping only moves the clock forward
+ */
+class Motor_Virtual_Clock : public Motor_Clock {
+    
+public:
+    
+    Motor_Virtual_Clock() : _now(0) {}
+    
+    uint64_t now(){
+        return _now;
+    }
+    
+    void sleep(uint64_t us){
+        _now += us;
+    }
+    
+private:
+    
+    uint64_t _now;
+};
+
+
+
+/**
+ * \class Motor_Memory_Output
+ * \brief In-memory sink for PWM frames : keeps the last one and counts
+ */
+class Motor_Memory_Output : public Motor_Output {
+    
+public:
+    
+    Motor_Memory_Output() : _frames(0), _bytes(0), _length(0) {}
+    
+    bool isOpen(){
+        return true;
+    }
+    
+    int write(const char* frame, unsigned int length){
+        if (length > sizeof(_last)) return -1;
+        memcpy(_last, frame, length);
+        _length = length;
+        _frames++;
+        _bytes += length;
+        return 1;
+    }
+    
+    uint64_t getFrames() const { return _frames; }
+    uint64_t getBytes() const { return _bytes; }
+    
+private:
+    
+    uint64_t _frames;
+    uint64_t _bytes;
+    char _last[64];
+    unsigned int _length;
+};
+
+
+
+
+/**
+ * \struct Sim_Scenario
+ * \brief One simulated flight : parameters under test and command profile
+ *
+ * Hover command, then a step on every axis at step_tick, plus uniform noise
+ */
+struct Sim_Scenario {
+    Motor_Params params;
+    uint8_t time_rate; // ms
+    unsigned int ticks;
+    unsigned int step_tick;
+    float hover[4]; // U1..U4 before the step
+    float step[4]; // added to U1..U4 from step_tick
+    float noise[4]; // amplitude of the uniform noise on U1..U4
+    uint32_t seed;
+};
+
+
+/**
+ * \struct Sim_Result
+ * \brief Outcome of a Sim_Scenario
+ */
+struct Sim_Result {
+    uint64_t saturations[Motor_Metrics_Data::NB_SATURATIONS]; // all motors
+    bool settled;
+    unsigned int settle_ticks; // after the step, until every speed moves less than 0.5 rd/s per tick
+    float max_speed; // rd/s
+    uint16_t max_servo_out; // us
+    uint16_t final_servo_out[4]; // us
+    uint64_t bytes_out; // written to the sink
+};
+
+
+/**
+ * \struct Sim_Summary
+ * \brief Aggregate of many Sim_Result
+ */
+struct Sim_Summary {
+    unsigned int scenarios;
+    uint64_t saturations[Motor_Metrics_Data::NB_SATURATIONS];
+    double mean_settle_ticks; // settled scenarios only
+    unsigned int max_settle_ticks;
+    unsigned int unsettled; // scenarios that never settled
+    float max_speed;
+    uint16_t max_servo_out;
+};
+
+
+
+
+/**
+ * \class Motor_Sim
+ * \brief Headless runs of MaestroMotor against a virtual clock and an in-memory sink
+ *
+ * Every scenario owns its MaestroMotor, clock, sink and random generator :
+ * scenarios share no mutable state and run in parallel on a Work_Pool.
+ */
+class Motor_Sim {
+    
+public:
+    
+    /**
+     * \brief Returns a scenario with Config.hpp parameters, hover at half thrust
+     */
+    static Sim_Scenario defaultScenario();
+    
+    
+    /**
+     * \brief Runs one scenario on the calling thread
+     */
+    static Sim_Result run(const Sim_Scenario&);
+    
+    
+    /**
+     * \brief Runs count scenarios in parallel
+     *
+     * \param const Sim_Scenario* : scenarios, Sim_Result* : results (same order), unsigned int : count
+     * \param unsigned int : workers, 0 for one per core
+     * \return the aggregate of the results
+     */
+    static Sim_Summary runAll(const Sim_Scenario*, Sim_Result*, unsigned int, unsigned int workers = 0);
+    
+    
+    /**
+     * \brief Aggregates results
+     */
+    static Sim_Summary summarize(const Sim_Result*, unsigned int);
+    
+};
+
+
+
+#endif /* Motor_Sim_hpp */
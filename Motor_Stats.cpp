@@ -0,0 +1,134 @@
+//
+//  Motor_Stats.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Motor_Stats.hpp"
+#include "Config.hpp"
+#include <string.h>
+#include <math.h>
+
+
+
+Motor_Stats::Motor_Stats() : _pwm_min(SERVO_VAL_MIN), _bucket_width((SERVO_VAL_MAX-SERVO_VAL_MIN)/NB_BUCKETS),
+                                _sequence(0), _reset(false){
+    _clear();
+}
+
+
+void Motor_Stats::_clear(){
+    memset(_motors, 0, sizeof(_motors));
+    for (int i=0; i<4; i++){
+        _motors[i].pwm_min = UINT16_MAX;
+    }
+    _ticks = 0;
+}
+
+
+void Motor_Stats::reset(){
+    _reset.store(true, std::memory_order_release);
+}
+
+
+void Motor_Stats::record(const uint16_t* servo_out, const float* speed, uint32_t flags){
+    
+    uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    if (_reset.exchange(false, std::memory_order_acquire)) _clear();
+    _ticks++;
+    
+    for (int i=0; i<4; i++){
+        Accumulator& motor = _motors[i];
+        motor.ticks++;
+        
+        // Welford : one pass, no cancellation over a long flight
+        double n = (double)motor.ticks;
+        double delta = servo_out[i] - motor.pwm_mean;
+        motor.pwm_mean += delta/n;
+        motor.pwm_m2 += delta*(servo_out[i] - motor.pwm_mean);
+        delta = speed[i] - motor.speed_mean;
+        motor.speed_mean += delta/n;
+        motor.speed_m2 += delta*(speed[i] - motor.speed_mean);
+        
+        if (servo_out[i] < motor.pwm_min) motor.pwm_min = servo_out[i];
+        if (servo_out[i] > motor.pwm_max) motor.pwm_max = servo_out[i];
+        
+        float position = (servo_out[i] - _pwm_min)/_bucket_width;
+        int bucket = (position < 0 ? 0 : position >= NB_BUCKETS ? NB_BUCKETS-1 : (int)position);
+        motor.histogram[bucket]++;
+        
+        uint32_t bits = (flags >> 4*i) & 0xF;
+        if (bits != 0){
+            motor.saturated++;
+            for (int kind=0; kind<Motor_Stats_Motor::NB_SATURATIONS; kind++){
+                if (bits & (1 << kind)) motor.saturations[kind]++;
+            }
+        }
+    }
+    
+    _sequence.store(sequence+2, std::memory_order_release);
+}
+
+
+float Motor_Stats::_percentile(const Accumulator& motor, double fraction) const {
+    
+    if (motor.ticks == 0) return 0;
+    
+    // Linear within the bucket holding the rank, bounded by the extremes seen
+    double rank = fraction*motor.ticks;
+    uint64_t below = 0;
+    for (int bucket=0; bucket<NB_BUCKETS; bucket++){
+        if (below + motor.histogram[bucket] >= rank && motor.histogram[bucket] > 0){
+            float value = _pwm_min + _bucket_width*(bucket + (rank - below)/motor.histogram[bucket]);
+            if (value < motor.pwm_min) value = motor.pwm_min;
+            if (value > motor.pwm_max) value = motor.pwm_max;
+            return value;
+        }
+        below += motor.histogram[bucket];
+    }
+    return motor.pwm_max;
+}
+
+
+void Motor_Stats::getSnapshot(Motor_Stats_Snapshot& snapshot) const {
+    
+    Accumulator motors[4];
+    uint64_t ticks;
+    uint32_t before, after;
+    do {
+        before = _sequence.load(std::memory_order_acquire);
+        memcpy(motors, _motors, sizeof(motors));
+        ticks = _ticks;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = _sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    
+    snapshot.ticks = ticks;
+    float mean = 0;
+    for (int i=0; i<4; i++){
+        const Accumulator& motor = motors[i];
+        Motor_Stats_Motor& out = snapshot.motors[i];
+        double n = (motor.ticks > 1 ? motor.ticks-1 : 1);
+        out.pwm_mean = motor.pwm_mean;
+        out.pwm_stddev = sqrt(motor.pwm_m2/n);
+        out.pwm_p5 = _percentile(motor, 0.05);
+        out.pwm_p50 = _percentile(motor, 0.50);
+        out.pwm_p95 = _percentile(motor, 0.95);
+        out.pwm_p99 = _percentile(motor, 0.99);
+        out.pwm_min = (motor.ticks > 0 ? motor.pwm_min : 0);
+        out.pwm_max = motor.pwm_max;
+        out.speed_mean = motor.speed_mean;
+        out.speed_stddev = sqrt(motor.speed_m2/n);
+        out.saturated = motor.saturated;
+        memcpy(out.saturations, motor.saturations, sizeof(out.saturations));
+        out.duty_cycle = (motor.ticks > 0 ? (float)motor.saturated/motor.ticks : 0);
+        mean += out.pwm_mean/4;
+    }
+    for (int i=0; i<4; i++){
+        snapshot.motors[i].imbalance = snapshot.motors[i].pwm_mean - mean;
+    }
+}
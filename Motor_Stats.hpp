@@ -0,0 +1,137 @@
+//
+//  Motor_Stats.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Motor_Stats_hpp
+#define Motor_Stats_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+
+
+/**
+ * \struct Motor_Stats_Motor
+ * \brief Statistics of one motor since the last reset
+ */
+struct Motor_Stats_Motor {
+    
+    /**
+     * \enum SATURATION
+     * \brief Kinds of saturation, in the order of the Motor_Tick_Record flags
+     */
+    enum SATURATION {
+        speed_low=0,
+        speed_high=1,
+        acceleration=2,
+        pwm_range=3,
+        NB_SATURATIONS=4
+    };
+    
+    float pwm_mean; // us
+    float pwm_stddev;
+    float pwm_p5; // from the histogram, within a bucket width
+    float pwm_p50;
+    float pwm_p95;
+    float pwm_p99;
+    uint16_t pwm_min;
+    uint16_t pwm_max;
+    float speed_mean; // rd/s
+    float speed_stddev;
+    uint64_t saturated; // ticks with any saturation
+    uint64_t saturations[NB_SATURATIONS]; // ticks, per kind
+    float duty_cycle; // saturated / ticks
+    float imbalance; // us, pwm_mean less the mean of the 4 motors
+};
+
+
+/**
+ * \struct Motor_Stats_Snapshot
+ * \brief Consistent copy of the 4 motors, see Motor_Stats::getSnapshot()
+ */
+struct Motor_Stats_Snapshot {
+    uint64_t ticks;
+    Motor_Stats_Motor motors[4];
+};
+
+
+
+
+/**
+ * \class Motor_Stats
+ * \brief Streaming per-motor statistics of a flight, in constant memory
+ *
+ * Fed once per tick with the PWM frame, the speeds and the saturation flags : Welford mean
+ * and variance of the PWM and of the speed, a fixed-bucket PWM histogram over
+ * [SERVO_VAL_MIN, SERVO_VAL_MAX] for the percentiles, and tick counts per saturation for the
+ * duty cycle. O(1) and no allocation on the motor thread.
+ * getSnapshot() can be called from any thread : it copies the accumulators under a seqlock
+ * and computes the statistics on the reader side.
+ */
+class Motor_Stats {
+    
+public:
+    
+    enum { NB_BUCKETS = 128 };
+    
+    
+    Motor_Stats();
+    
+    
+    /**
+     * \brief Accounts a tick. Motor thread only
+     *
+     * \param const uint16_t* : PWM of the 4 motors in us, const float* : their speeds in rd/s,
+     *        uint32_t : saturation flags, (Motor_Tick_Record::FLAG << 4*i) for motor i
+     */
+    void record(const uint16_t* servo_out, const float* speed, uint32_t flags);
+    
+    
+    /**
+     * \brief Starts over, at the next record(). Threadsafe
+     */
+    void reset();
+    
+    
+    /**
+     * \brief Consistent statistics of the 4 motors. Threadsafe, no lock taken
+     */
+    void getSnapshot(Motor_Stats_Snapshot&) const;
+    
+    
+private:
+    
+    struct Accumulator {
+        uint64_t ticks;
+        double pwm_mean;
+        double pwm_m2; // sum of the squared deviations
+        double speed_mean;
+        double speed_m2;
+        uint16_t pwm_min;
+        uint16_t pwm_max;
+        uint64_t saturated;
+        uint64_t saturations[Motor_Stats_Motor::NB_SATURATIONS];
+        uint32_t histogram[NB_BUCKETS];
+    };
+    
+    void _clear();
+    float _percentile(const Accumulator&, double) const;
+    
+    Accumulator _motors[4];
+    uint64_t _ticks;
+    
+    float _pwm_min; // us, lower bound of the histogram
+    float _bucket_width; // us
+    
+    std::atomic<uint32_t> _sequence; // seqlock, odd while record() writes
+    std::atomic<bool> _reset;
+    
+};
+
+
+
+#endif /* Motor_Stats_hpp */
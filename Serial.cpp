@@ -13,21 +13,26 @@
 
 //-----------------------------------------------------------------------------------------------------------------//
 
-Serial::Serial() : file(0)
+Serial::Serial() : file(-1)
 {
+    port_name[0] = 0;
 }
 
 
 Serial::Serial(const char* port_name, long unsigned int baud_rate){
     
     
-    port_name = port_name;
+    snprintf(this->port_name, sizeof(this->port_name), "%s", port_name);
     
     struct termios options;
     
     // Open device
     file = open(port_name, O_RDWR | O_NOCTTY | O_NDELAY);       // Open port
+#ifndef MAESTRO_EMBEDDED
     if (file == -1) throw serial_exception::serial_exception(1,"Failed to open port",0);
+#else
+    if (file == -1) return;
+#endif
     fcntl(file, F_SETFL, FNDELAY);                              // Open in in non-blocking mod
     
     //Set parameter
@@ -40,7 +45,11 @@ Serial::Serial(const char* port_name, long unsigned int baud_rate){
         case 9600   : Speed=B9600;   break;
         case 19200  : Speed=B19200;  break;
         case 115200 : Speed=B115200; break;
+#ifndef MAESTRO_EMBEDDED
         default : throw std::invalid_argument("Unvalid baud rate for the device !");
+#else
+        default : Close(); return;
+#endif
     }
     
     cfsetispeed(&options, Speed);                               // Set the baud rate
@@ -54,18 +63,25 @@ Serial::Serial(const char* port_name, long unsigned int baud_rate){
     sleep(2);                                                   //required to make flush work, for some reason (couldn't find why !)
     tcflush(file,TCIOFLUSH);
     
-    std::cout << "Succeeded connecting " << port_name << " and setting options !" << std::endl;
+    printf("Succeeded connecting %s and setting options !\n", port_name);
     //Telling the user the connection was made succesfully
     
 }
 
 
 
+#ifndef MAESTRO_EMBEDDED
 const std::string Serial::getPortName() const
 {
     std::string str(port_name);
     return str;    
 }
+#else
+const char* Serial::getPortName() const
+{
+    return port_name;
+}
+#endif
 
 
 void Serial::Close()
@@ -81,6 +97,11 @@ bool Serial::isOpen()
     return true;
 }
 
+int Serial::getFd() const
+{
+    return file;
+}
+
 Serial::~Serial(){
     close(file);
 }
@@ -130,6 +151,15 @@ int Serial::read_bytes(void *buffer, unsigned int maxNbBytes)
 
 
 
+int Serial::read_available(void *buffer, unsigned int maxNbBytes)
+{
+    int Ret=read(file,buffer,maxNbBytes);                               // Non-blocking fd : returns what is there
+    if (Ret==-1) return (errno==EAGAIN || errno==EWOULDBLOCK) ? 0 : -1; // Nothing available is not an error
+    return Ret;
+}
+
+
+
 //-----------------------------------------------------------------------------------------------------------------//
 
 
@@ -154,9 +184,9 @@ int Serial::readChar(char* buffer)
 
 
 
-int Serial::readLine(char* string_buffer){
+int Serial::readLine(char* string_buffer, unsigned int size){
     
-    return this->readString(string_buffer, '\n', 128);
+    return this->readString(string_buffer, '\n', size);
 
 }
 
@@ -176,7 +206,8 @@ int Serial::readString(char *String,char FinalChar,unsigned int MaxNbBytes)
 {
     unsigned int    NbBytes=0;                                          // Number of bytes read
     char            ret;                                                // Returned value from Read
-    while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
+    if (MaxNbBytes==0) return -3;                                       // No room for the end character
+    while (NbBytes<MaxNbBytes-1)                                        // While the buffer is not full (keeps room for the end character)
     {                                                                   // Read a byte with the restant time
         ret=readChar(&String[NbBytes]);
         if (ret==1)                                                     // If a byte has been read
@@ -190,6 +221,7 @@ int Serial::readString(char *String,char FinalChar,unsigned int MaxNbBytes)
         }
         if (ret<0) return ret;                                          // Error while reading : return the error number
     }
+    String[NbBytes]=0;
     return -3;                                                          // Buffer is full : return -3
 }
 
@@ -11,16 +11,22 @@
 
 
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/shm.h>
 #include <termios.h>
+#include <stdio.h>
 #include <string.h>
-#include <iostream>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include "Maestro_Profile.hpp"
+#ifndef MAESTRO_EMBEDDED
+#include <iostream>
+#include <string>
 #include <stdexcept>
 #include "serial_exception.hpp"
+#endif
 
 
 
@@ -46,7 +52,11 @@ public:
      * \brief Get the port name and return a string
      **/
     
+#ifndef MAESTRO_EMBEDDED
     const std::string getPortName() const;
+#else
+    const char* getPortName() const;
+#endif
     
     //-------------------------------------------------------------------------------------------------//
 
@@ -61,6 +71,7 @@ public:
      * WARNING : Baudrate must be acceptable :
      * B4800, B9600, B19200, B115200 for now
      * By default, daud_rate is set to 9600
+     * Throws serial_exception if it fails ; in the embedded profile the port is left closed (see isOpen())
      **/
     
     Serial(const char*, long unsigned int baud_rate = 9600);
@@ -79,6 +90,16 @@ public:
 
     
     
+    /** \brief Returns the file descriptor of the device
+     * To hand it to another I/O backend, -1 if closed
+     **/
+    
+    int getFd() const;
+    
+    //-------------------------------------------------------------------------------------------------//
+
+    
+    
     
 //-----------------------------------------------------------------------------------------------------------------//
    
@@ -116,6 +137,20 @@ public:
     //-------------------------------------------------------------------------------------------------//
 
     
+    
+    /** ------------------------------------------------------------------------------------------------
+     * \brief reads the bytes currently available, without waiting
+     * \param Buffer of bytes read from the serial port
+     * \param Maximum allowed number of bytes to be read
+     * Return the number of bytes read (0 if none available)
+     *       -1 if error during reading the bytes
+     **/
+
+    int read_available(void *buffer,unsigned int maxNbBytes);
+    
+    //-------------------------------------------------------------------------------------------------//
+
+    
 
     
                             // --------------------------------------- //
@@ -142,11 +177,13 @@ public:
     /** ------------------------------------------------------------------------------------------------
      * \brief Read a line from the serial port
      * \brief No timeout (will wait for a line to come.. kind of shitty but will be eventually be change
-     * \param : no parameters, will return the string of the line
+     * \param string_buffer : buffer of the line, null terminated
+     * \param size : size of string_buffer (terminating 0 included)
      * Line must end with '\n' tag (back to line) or std::endl (this also flush the device)
+     * See Serial_Framer to parse lines without waiting
      **/
     
-    int readLine(char* string_buffer);
+    int readLine(char* string_buffer, unsigned int size);
 
     //-------------------------------------------------------------------------------------------------//
 
@@ -167,7 +204,7 @@ public:
      \brief Read a string from the serial device (without TimeOut)
      \param String : string read on the serial device
      \param FinalChar : final char of the string
-     \param MaxNbBytes : maximum allowed number of bytes read
+     \param MaxNbBytes : size of String, terminating 0 included
      \return >0 success, return the number of bytes read
      \return -1 error while setting the Timeout
      \return -2 error while reading the byte
@@ -218,7 +255,7 @@ public:
 private:
     
     int file;
-    const std::string port_name;
+    char port_name[64];
     
 };
 
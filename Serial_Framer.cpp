@@ -0,0 +1,271 @@
+//
+//  Serial_Framer.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Serial_Framer.hpp"
+
+
+
+Serial_Framer::Serial_Framer(FRAMING framing, unsigned int max_frame, char delimiter) : _framing(framing), _max_frame(max_frame), _delimiter(delimiter)
+{
+    if (_max_frame > (BUFFER_SIZE-4)/2) _max_frame = (BUFFER_SIZE-4)/2; // an encoded frame always fits in the buffer
+    if (_framing == cobs) _delimiter = 0;
+    if (_framing == slip) _delimiter = (char)SLIP_END;
+    reset();
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+void Serial_Framer::reset(){
+    _start = 0;
+    _end = 0;
+    _scan = 0;
+    _discarding = false;
+}
+
+
+Serial_Framer_Stats Serial_Framer::getStats() const {
+    return _stats;
+}
+
+
+
+unsigned int Serial_Framer::feed(const char* bytes, unsigned int count){
+    
+    // Make room by moving the pending bytes to the front
+    if (_end + count > BUFFER_SIZE && _start > 0){
+        memmove(_buffer, _buffer+_start, _end-_start);
+        _end -= _start;
+        _scan -= _start;
+        _start = 0;
+    }
+    
+    unsigned int accepted = BUFFER_SIZE - _end;
+    if (accepted > count) accepted = count;
+    memcpy(_buffer+_end, bytes, accepted);
+    _end += accepted;
+    _stats.bytes_in += accepted;
+    return accepted;
+}
+
+
+int Serial_Framer::poll(Serial& port){
+    
+    if (_start > 0){
+        memmove(_buffer, _buffer+_start, _end-_start);
+        _end -= _start;
+        _scan -= _start;
+        _start = 0;
+    }
+    if (_end == BUFFER_SIZE) return 0;
+    
+    int ret = port.read_available(_buffer+_end, BUFFER_SIZE-_end);
+    if (ret > 0){
+        _end += ret;
+        _stats.bytes_in += ret;
+    }
+    return ret;
+}
+
+
+
+bool Serial_Framer::next(Frame_View& frame){
+    if (_framing == length_prefix) return _next_length_prefixed(frame);
+    return _next_delimited(frame);
+}
+
+
+bool Serial_Framer::_next_delimited(Frame_View& frame){
+    
+    while (true){
+        
+        char* found = (char*)memchr(_buffer+_scan, _delimiter, _end-_scan);
+        
+        if (found == NULL){
+            _scan = _end;
+            // Too long to ever be a frame : drop it, then wait for the next delimiter
+            if (_end-_start > _max_frame*2+2){
+                _stats.dropped_bytes += _end-_start;
+                if (!_discarding) _stats.oversize++;
+                _discarding = true;
+                _start = _scan = _end;
+            }
+            return false;
+        }
+        
+        char* begin = _buffer+_start;
+        unsigned int raw_length = found-begin;
+        _start = _scan = found-_buffer+1;
+        
+        if (_discarding){
+            // Tail of a dropped frame : we are in sync again
+            _stats.dropped_bytes += raw_length+1;
+            _discarding = false;
+            continue;
+        }
+        
+        if (raw_length == 0 && _framing != newline) continue; // consecutive delimiters are used to sync
+        
+        int length = _decode(begin, raw_length);
+        if (length < 0){
+            _stats.decode_errors++;
+            _stats.dropped_bytes += raw_length+1;
+            continue;
+        }
+        if ((unsigned int)length > _max_frame){
+            _stats.oversize++;
+            _stats.dropped_bytes += raw_length+1;
+            continue;
+        }
+        
+        frame.data = begin;
+        frame.length = length;
+        _stats.frames++;
+        return true;
+    }
+}
+
+
+bool Serial_Framer::_next_length_prefixed(Frame_View& frame){
+    
+    while (_end-_start >= 2){
+        
+        unsigned int length = (uint8_t)_buffer[_start] | ((uint8_t)_buffer[_start+1] << 8);
+        
+        if (length == 0 || length > _max_frame){
+            // Not a plausible header : slide by one byte
+            _start++;
+            _stats.dropped_bytes++;
+            continue;
+        }
+        if (_end-_start < 2+length) return false;
+        
+        frame.data = _buffer+_start+2;
+        frame.length = length;
+        _start += 2+length;
+        _scan = _start;
+        _stats.frames++;
+        return true;
+    }
+    return false;
+}
+
+
+
+int Serial_Framer::_decode(char* data, unsigned int length){
+    
+    switch (_framing) {
+            
+        case newline : {
+            if (length > 0 && data[length-1] == '\r') length--;
+            return length;
+        }
+            
+        case cobs : {
+            unsigned int read = 0;
+            unsigned int write = 0;
+            while (read < length){
+                uint8_t code = data[read++];
+                if (code == 0) return -1;
+                for (uint8_t i=1; i<code; i++){
+                    if (read >= length) return -1;
+                    data[write++] = data[read++];
+                }
+                if (code != 0xFF && read < length) data[write++] = 0;
+            }
+            return write;
+        }
+            
+        case slip : {
+            unsigned int write = 0;
+            for (unsigned int read=0; read<length; read++){
+                uint8_t byte = data[read];
+                if (byte == SLIP_ESC){
+                    if (++read >= length) return -1;
+                    switch ((uint8_t)data[read]) {
+                        case SLIP_ESC_END : byte = SLIP_END; break;
+                        case SLIP_ESC_ESC : byte = SLIP_ESC; break;
+                        default : return -1;
+                    }
+                }
+                data[write++] = byte;
+            }
+            return write;
+        }
+            
+        default :
+            return length;
+    }
+}
+
+
+
+unsigned int Serial_Framer::encode(FRAMING framing, const char* payload, unsigned int length, char* out, unsigned int size, char delimiter){
+    
+    unsigned int write = 0;
+    
+    switch (framing) {
+            
+        case newline : {
+            if (length+1 > size) return 0;
+            memcpy(out, payload, length);
+            out[length] = delimiter;
+            return length+1;
+        }
+            
+        case length_prefix : {
+            if (length == 0 || length > 0xFFFF || length+2 > size) return 0;
+            out[0] = length & 0xFF;
+            out[1] = length >> 8;
+            memcpy(out+2, payload, length);
+            return length+2;
+        }
+            
+        case cobs : {
+            // Worst case : one code byte every 254 bytes, plus the delimiter
+            if (length + length/254 + 2 > size) return 0;
+            unsigned int code_index = write++;
+            uint8_t code = 1;
+            for (unsigned int i=0; i<length; i++){
+                if (payload[i] == 0){
+                    out[code_index] = code;
+                    code_index = write++;
+                    code = 1;
+                }
+                else {
+                    out[write++] = payload[i];
+                    if (++code == 0xFF){
+                        out[code_index] = code;
+                        code_index = write++;
+                        code = 1;
+                    }
+                }
+            }
+            out[code_index] = code;
+            out[write++] = 0;
+            return write;
+        }
+            
+        case slip : {
+            for (unsigned int i=0; i<length; i++){
+                uint8_t byte = payload[i];
+                if (byte == SLIP_END || byte == SLIP_ESC){
+                    if (write+2 > size) return 0;
+                    out[write++] = (char)SLIP_ESC;
+                    out[write++] = (char)(byte == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC);
+                }
+                else {
+                    if (write+1 > size) return 0;
+                    out[write++] = byte;
+                }
+            }
+            if (write+1 > size) return 0;
+            out[write++] = (char)SLIP_END;
+            return write;
+        }
+    }
+    return 0;
+}
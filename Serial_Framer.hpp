@@ -0,0 +1,155 @@
+//
+//  Serial_Framer.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Serial_Framer_hpp
+#define Serial_Framer_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Serial.h"
+
+
+
+/**
+ * \struct Frame_View
+ * \brief Reference to a complete frame inside the Serial_Framer buffer (no copy)
+ *
+ * Valid until the next feed() or poll() on the framer
+ */
+struct Frame_View {
+    const char* data;
+    unsigned int length;
+};
+
+
+
+/**
+ * \struct Serial_Framer_Stats
+ * \brief Counters of a Serial_Framer
+ */
+struct Serial_Framer_Stats {
+    uint64_t bytes_in;
+    uint64_t frames;
+    uint64_t dropped_bytes; // skipped while resynchronising
+    uint64_t decode_errors; // malformed COBS/SLIP frames
+    uint64_t oversize; // frames longer than max_frame
+};
+
+
+
+
+/**
+ * \class Serial_Framer
+ * \brief Splits a byte stream (e.g. a Serial port) into frames
+ *
+ * Framings : newline (or any delimiter, trailing '\r' stripped), 16 bits little endian
+ * length prefix, COBS (0x00 delimited) and SLIP. Bytes are buffered in a fixed buffer,
+ * COBS/SLIP frames are decoded in place so frames are handed out as views into it.
+ * Partial frames wait for the next bytes ; after garbage, oversized or malformed frames
+ * the framer drops bytes until the next delimiter (or next plausible length) and resyncs.
+ */
+class Serial_Framer {
+    
+public:
+    
+    /**
+     * \enum FRAMING
+     * \brief Supported framings
+     */
+    enum FRAMING {
+        newline=0,
+        length_prefix=1,
+        cobs=2,
+        slip=3
+    };
+    
+    enum { BUFFER_SIZE = 1024 };
+    enum { SLIP_END = 0xC0, SLIP_ESC = 0xDB, SLIP_ESC_END = 0xDC, SLIP_ESC_ESC = 0xDD };
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param FRAMING : framing of the stream
+     * \param unsigned int : maximum decoded frame length, at most (BUFFER_SIZE-4)/2
+     * \param char : delimiter for newline framing
+     */
+    Serial_Framer(FRAMING, unsigned int max_frame = 128, char delimiter = '\n');
+    
+    
+    /**
+     * \brief Appends bytes received by other means
+     *
+     * \param const char* : bytes, unsigned int : count
+     * \return number of bytes accepted (less than count when the buffer is full)
+     */
+    unsigned int feed(const char*, unsigned int);
+    
+    
+    /**
+     * \brief Reads what is available on the port into the buffer, without blocking
+     *
+     * \param Serial& : port
+     * \return number of bytes read, -1 if error
+     */
+    int poll(Serial&);
+    
+    
+    /**
+     * \brief Extracts the next complete frame
+     *
+     * \param Frame_View& : set to the frame
+     * \return false if no complete frame is buffered
+     */
+    bool next(Frame_View&);
+    
+    
+    /**
+     * \brief Drops every buffered byte
+     */
+    void reset();
+    
+    
+    /**
+     * \brief Returns the counters
+     */
+    Serial_Framer_Stats getStats() const;
+    
+    
+    /**
+     * \brief Encodes a payload with the given framing (delimiter included)
+     *
+     * \param FRAMING, const char* payload, unsigned int payload length, char* output, unsigned int output size
+     * \param char : delimiter for newline framing
+     * \return encoded length, 0 if the output buffer is too small
+     */
+    static unsigned int encode(FRAMING, const char*, unsigned int, char*, unsigned int, char delimiter = '\n');
+    
+    
+private:
+    
+    bool _next_delimited(Frame_View&);
+    bool _next_length_prefixed(Frame_View&);
+    int _decode(char*, unsigned int); // in place, returns decoded length or -1
+    
+    FRAMING _framing;
+    unsigned int _max_frame;
+    char _delimiter;
+    
+    char _buffer[BUFFER_SIZE];
+    unsigned int _start; // first byte not consumed
+    unsigned int _end; // end of buffered bytes
+    unsigned int _scan; // delimiter already searched up to here
+    bool _discarding; // dropping bytes up to the next delimiter
+    
+    Serial_Framer_Stats _stats;
+    
+};
+
+
+
+#endif /* Serial_Framer_hpp */
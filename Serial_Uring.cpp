@@ -0,0 +1,320 @@
+//
+//  Serial_Uring.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Serial_Uring.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+
+
+Serial_Uring::Serial_Uring(Serial& port) : _port(port), _ring_fd(-1), _sqpoll(false),
+                                           _sq_ptr(MAP_FAILED), _sq_size(0), _cq_ptr(MAP_FAILED), _cq_size(0),
+                                           _sqes((struct io_uring_sqe*)MAP_FAILED), _sqes_size(0),
+                                           _to_submit(0), _tx_next(0), _rx_busy(false), _rx_pending_length(0), _failed(0)
+{
+    memset(_tx_busy, 0, sizeof(_tx_busy));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+Serial_Uring::~Serial_Uring(){
+    if (_ring_fd >= 0) drain();
+    _release();
+}
+
+
+void Serial_Uring::_release(){
+    if (_sqes != MAP_FAILED) munmap(_sqes, _sqes_size);
+    if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_size);
+    if (_sq_ptr != MAP_FAILED) munmap(_sq_ptr, _sq_size);
+    if (_ring_fd >= 0) close(_ring_fd);
+    
+    _sqes = (struct io_uring_sqe*)MAP_FAILED;
+    _cq_ptr = MAP_FAILED;
+    _sq_ptr = MAP_FAILED;
+    _ring_fd = -1;
+}
+
+
+
+bool Serial_Uring::setup(bool sqpoll){
+    
+    if (_ring_fd >= 0) return true;
+    if (!_port.isOpen()) return false;
+    
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (sqpoll){
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 1000; // ms before the kernel thread sleeps
+    }
+    
+    _ring_fd = syscall(__NR_io_uring_setup, ENTRIES, &params);
+    if (_ring_fd < 0 && sqpoll){
+        // SQPOLL needs privileges on older kernels : keep io_uring without it
+        memset(&params, 0, sizeof(params));
+        _ring_fd = syscall(__NR_io_uring_setup, ENTRIES, &params);
+    }
+    if (_ring_fd < 0) return false;
+    _sqpoll = (params.flags & IORING_SETUP_SQPOLL);
+    
+    // Map the rings
+    _sq_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    _cq_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap && _cq_size > _sq_size) _sq_size = _cq_size;
+    
+    _sq_ptr = mmap(NULL, _sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (_sq_ptr == MAP_FAILED){
+        _release();
+        return false;
+    }
+    
+    if (single_mmap) _cq_ptr = _sq_ptr;
+    else {
+        _cq_ptr = mmap(NULL, _cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (_cq_ptr == MAP_FAILED){
+            _release();
+            return false;
+        }
+    }
+    
+    _sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe*)mmap(NULL, _sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED){
+        _release();
+        return false;
+    }
+    
+    char* sq = (char*)_sq_ptr;
+    _sq_head = (unsigned*)(sq + params.sq_off.head);
+    _sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    _sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    _sq_array = (unsigned*)(sq + params.sq_off.array);
+    _sq_flags = (unsigned*)(sq + params.sq_off.flags);
+    
+    char* cq = (char*)_cq_ptr;
+    _cq_head = (unsigned*)(cq + params.cq_off.head);
+    _cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    _cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    
+    // Register the port fd and the buffers once
+    int fd = _port.getFd();
+    if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_FILES, &fd, 1) < 0){
+        _release();
+        return false;
+    }
+    
+    struct iovec iovecs[TX_SLOTS+1];
+    for (int i=0; i<TX_SLOTS; i++){
+        iovecs[i].iov_base = _tx[i];
+        iovecs[i].iov_len = sizeof(_tx[i]);
+    }
+    iovecs[TX_SLOTS].iov_base = _rx;
+    iovecs[TX_SLOTS].iov_len = sizeof(_rx);
+    if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_BUFFERS, iovecs, TX_SLOTS+1) < 0){
+        _release();
+        return false;
+    }
+    
+    return true;
+}
+
+
+bool Serial_Uring::isAvailable() const {
+    return _ring_fd >= 0;
+}
+
+
+bool Serial_Uring::isSqpoll() const {
+    return _sqpoll;
+}
+
+
+
+int Serial_Uring::_enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags){
+    _stats.syscalls++;
+    return syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+
+struct io_uring_sqe* Serial_Uring::_get_sqe(){
+    // Not visible to the kernel until _submit() publishes the tail : the caller fills it first
+    unsigned tail = *_sq_tail + _to_submit;
+    unsigned index = tail & *_sq_mask;
+    
+    struct io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+    
+    _to_submit++;
+    return sqe;
+}
+
+
+void Serial_Uring::_submit(){
+    // Every sqe queued since the last call, filled : the SQPOLL thread may consume them right away
+    __atomic_store_n(_sq_tail, *_sq_tail + _to_submit, __ATOMIC_RELEASE);
+    
+    if (_sqpoll){
+        // The kernel thread picks the sqes up by itself, unless it went to sleep. Full barrier
+        // (liburing's io_uring_smp_mb) : the tail store must not pass the flags load, or a
+        // thread going idle right now is missed and the frame waits for the next submit
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(_sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP){
+            _enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+    }
+    else _enter(_to_submit, 0, 0);
+    _to_submit = 0;
+}
+
+
+
+int Serial_Uring::submitFrame(const char* data, unsigned int length){
+    
+    if (length > Serial_Frame::MAX_SIZE) return -1;
+    
+    if (_ring_fd < 0){
+        _stats.writes++;
+        int ret = _port.write_bytes(data, length);
+        if (ret < 0) _stats.write_errors++;
+        return ret;
+    }
+    
+    _reap();
+    
+    // Every sqe we may queue must fit (the sq ring has ENTRIES slots), checked before a tx
+    // buffer is claimed so that none is skipped
+    unsigned int slot = _tx_next;
+    if (_tx_busy[slot] || *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) + 2 > ENTRIES){
+        _stats.busy++;
+        return -1;
+    }
+    _tx_next = (_tx_next+1) % TX_SLOTS;
+    
+    memcpy(_tx[slot], data, length);
+    _tx_busy[slot] = true;
+    _tx_time[slot] = Motor_Event_Log::now();
+    _tx_length[slot] = length;
+    
+    struct io_uring_sqe* sqe = _get_sqe();
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = 0; // index in the registered files
+    sqe->addr = (uint64_t)(uintptr_t)_tx[slot];
+    sqe->len = length;
+    sqe->buf_index = slot;
+    sqe->user_data = OP_WRITE | (slot << 8);
+    
+    if (!_rx_busy){
+        // Telemetry read runs once the frame is out (cancelled if the write fails)
+        sqe->flags |= IOSQE_IO_LINK;
+        
+        sqe = _get_sqe();
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = 0;
+        sqe->addr = (uint64_t)(uintptr_t)_rx;
+        sqe->len = RX_SIZE;
+        sqe->buf_index = TX_SLOTS;
+        sqe->user_data = OP_READ;
+        _rx_busy = true;
+    }
+    
+    _stats.writes++;
+    _submit();
+    return 1;
+}
+
+
+
+int Serial_Uring::reap(){
+    _reap();
+    int failed = _failed;
+    _failed = 0;
+    return failed;
+}
+
+
+void Serial_Uring::_reap(){
+    
+    if (_ring_fd < 0) return;
+    
+    unsigned head = *_cq_head;
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    
+    while (head != tail){
+        const struct io_uring_cqe& cqe = _cqes[head & *_cq_mask];
+        
+        if ((cqe.user_data & 0xFF) == OP_WRITE){
+            unsigned int slot = (cqe.user_data >> 8) & 0xFF;
+            _tx_busy[slot] = false;
+            _stats.completed++;
+            _stats.last_latency = Motor_Event_Log::now() - _tx_time[slot];
+            if (cqe.res < (int)_tx_length[slot]){
+                _stats.write_errors++;
+                _failed++;
+            }
+        }
+        else if ((cqe.user_data & 0xFF) == OP_READ){
+            _rx_busy = false;
+            if (cqe.res > 0){
+                unsigned int length = cqe.res;
+                if (length > RX_SIZE - _rx_pending_length) length = RX_SIZE - _rx_pending_length; // overflow : newest bytes dropped
+                memcpy(_rx_pending + _rx_pending_length, _rx, length);
+                _rx_pending_length += length;
+                _stats.reads++;
+                _stats.bytes_read += cqe.res;
+            }
+        }
+        head++;
+    }
+    
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+
+void Serial_Uring::drain(){
+    
+    if (_ring_fd < 0) return;
+    
+    for (;;){
+        _reap();
+        bool busy = false;
+        for (int i=0; i<TX_SLOTS; i++) busy = busy || _tx_busy[i];
+        if (!busy) return;
+        if (_sqpoll) _enter(0, 1, IORING_ENTER_GETEVENTS|IORING_ENTER_SQ_WAKEUP);
+        else _enter(0, 1, IORING_ENTER_GETEVENTS);
+    }
+}
+
+
+
+unsigned int Serial_Uring::readTelemetry(char* buffer, unsigned int size){
+    
+    if (_ring_fd < 0){
+        ssize_t ret = read(_port.getFd(), buffer, size);
+        return (ret > 0 ? ret : 0);
+    }
+    
+    _reap();
+    unsigned int length = (_rx_pending_length < size ? _rx_pending_length : size);
+    memcpy(buffer, _rx_pending, length);
+    memmove(_rx_pending, _rx_pending + length, _rx_pending_length - length);
+    _rx_pending_length -= length;
+    return length;
+}
+
+
+
+Serial_Uring_Stats Serial_Uring::getStats() const {
+    return _stats;
+}
@@ -0,0 +1,188 @@
+//
+//  Serial_Uring.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Serial_Uring_hpp
+#define Serial_Uring_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "Serial.h"
+#include "Serial_Writer.hpp"
+
+
+
+/**
+ * \struct Serial_Uring_Stats
+ * \brief Counters of the io_uring backend
+ */
+struct Serial_Uring_Stats {
+    uint64_t syscalls; // io_uring_enter calls (0 per frame when the SQPOLL thread is awake)
+    uint64_t writes; // frames submitted
+    uint64_t completed; // write completions reaped
+    uint64_t write_errors; // failed or short writes
+    uint64_t busy; // frames not submitted because every tx buffer was in flight, or the sq ring was full
+    uint64_t reads; // completed telemetry reads
+    uint64_t bytes_read;
+    uint64_t last_latency; // ns between submit and reaped completion of the last frame
+};
+
+
+
+
+/**
+ * \class Serial_Uring
+ * \brief io_uring backend for the writes and telemetry reads of a Serial port
+ *
+ * Uses raw syscalls (no liburing). The port fd and the tx/rx buffers are registered once,
+ * a frame write is submitted as WRITE_FIXED linked to a READ_FIXED telemetry read.
+ * Completions are reaped from the shared ring, without syscall. In SQPOLL mode a kernel
+ * thread also picks up submissions, so the steady state issues no syscall at all.
+ * When io_uring is unavailable, setup() fails and the calls fall back to plain read/write.
+ *
+ * Not threadsafe : to be used from a single thread (the motor thread)
+ */
+class Serial_Uring {
+    
+public:
+    
+    enum { ENTRIES = 16, TX_SLOTS = 4, RX_SIZE = 256 };
+    
+    
+    /**
+     * \brief Constructor (no ring is set up yet, calls use the plain path)
+     *
+     * \param Serial& : port, must outlive the backend
+     */
+    Serial_Uring(Serial&);
+    
+    
+    /**
+     * \brief Destructor (unmaps and closes the ring)
+     */
+    ~Serial_Uring();
+    
+    
+    /**
+     * \brief Sets up the ring and registers the port fd and buffers
+     *
+     * \param bool sqpoll : ask for a kernel submission thread, silently dropped if refused
+     * \return false if io_uring is unavailable (calls keep using the plain path)
+     */
+    bool setup(bool sqpoll = false);
+    
+    
+    /**
+     * \brief Returns true if the ring is set up
+     */
+    bool isAvailable() const;
+    
+    
+    /**
+     * \brief Returns true if the ring runs with a kernel submission thread
+     */
+    bool isSqpoll() const;
+    
+    
+    /**
+     * \brief Submits a frame write, linked to a telemetry read when none is in flight
+     *
+     * Does not wait for completion. Plain blocking write when the ring isn't available
+     *
+     * \param const char* : frame, unsigned int : length (at most Serial_Frame::MAX_SIZE)
+     * \return 1 if submitted (or written), -1 if error or no tx buffer was free
+     */
+    int submitFrame(const char*, unsigned int);
+    
+    
+    /**
+     * \brief Reaps available completions without syscall
+     *
+     * \return number of failed writes since the last call, including those reaped by
+     *         submitFrame() and readTelemetry()
+     */
+    int reap();
+    
+    
+    /**
+     * \brief Waits until every submitted write has completed
+     */
+    void drain();
+    
+    
+    /**
+     * \brief Copies the telemetry bytes received so far
+     *
+     * \param char* : output buffer, unsigned int : its size
+     * \return number of bytes copied
+     */
+    unsigned int readTelemetry(char*, unsigned int);
+    
+    
+    /**
+     * \brief Returns the counters
+     */
+    Serial_Uring_Stats getStats() const;
+    
+    
+private:
+    
+    int _enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags);
+    struct io_uring_sqe* _get_sqe();
+    void _submit();
+    void _reap();
+    void _release();
+    
+    enum { OP_WRITE = 1, OP_READ = 2 };
+    
+    Serial& _port;
+    
+    int _ring_fd;
+    bool _sqpoll;
+    
+    // Mapped rings
+    void* _sq_ptr;
+    size_t _sq_size;
+    void* _cq_ptr;
+    size_t _cq_size;
+    struct io_uring_sqe* _sqes;
+    size_t _sqes_size;
+    
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_mask;
+    unsigned* _sq_array;
+    unsigned* _sq_flags;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned* _cq_mask;
+    struct io_uring_cqe* _cqes;
+    
+    unsigned int _to_submit; // sqes queued since the last _submit()
+    
+    // Registered buffers : TX_SLOTS tx buffers then the rx buffer
+    char _tx[TX_SLOTS][Serial_Frame::MAX_SIZE];
+    bool _tx_busy[TX_SLOTS];
+    uint64_t _tx_time[TX_SLOTS];
+    unsigned int _tx_length[TX_SLOTS];
+    unsigned int _tx_next;
+    char _rx[RX_SIZE];
+    bool _rx_busy;
+    
+    // Telemetry bytes reaped, not yet read
+    char _rx_pending[RX_SIZE];
+    unsigned int _rx_pending_length;
+    
+    unsigned int _failed; // failed writes reaped, not yet returned by reap()
+    
+    Serial_Uring_Stats _stats;
+    
+};
+
+
+
+#endif /* Serial_Uring_hpp */
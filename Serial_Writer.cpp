@@ -0,0 +1,147 @@
+//
+//  Serial_Writer.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Serial_Writer.hpp"
+
+#define SERIAL_WRITER_EVENT_SOURCE 1
+
+
+
+Serial_Writer::Serial_Writer(Serial& port) : _port(port), _back(0), _front(1), _middle(2), _running(false),
+                                             _submitted(0), _written(0), _superseded(0), _write_errors(0),
+                                             _last_queue_age(0), _max_queue_age(0),
+                                             _last_write_time(0), _max_write_time(0), _total_write_time(0),
+                                             _events(SERIAL_WRITER_EVENT_SOURCE)
+{
+    sem_init(&_wakeup, 0, 0);
+}
+
+
+Serial_Writer::~Serial_Writer(){
+    stop();
+    sem_destroy(&_wakeup);
+}
+
+
+bool Serial_Writer::start(){
+    if (_running.load()) return true;
+    
+    _running.store(true);
+    if (pthread_create(&_thread, NULL, &Serial_Writer::_run, this) != 0){
+        _running.store(false);
+        return false;
+    }
+    return true;
+}
+
+
+void Serial_Writer::stop(){
+    if (_running.exchange(false)){
+        sem_post(&_wakeup);
+        pthread_join(_thread, NULL);
+    }
+}
+
+
+bool Serial_Writer::isRunning() const {
+    return _running.load(std::memory_order_relaxed);
+}
+
+
+
+bool Serial_Writer::submit(const char* data, unsigned int length){
+    
+    if (length > Serial_Frame::MAX_SIZE) return false;
+    
+    Serial_Frame& frame = _frames[_back];
+    memcpy(frame.data, data, length);
+    frame.length = length;
+    frame.timestamp = Motor_Event_Log::now();
+    
+    // Publish our buffer, get back the previous middle one
+    uint8_t previous = _middle.exchange(_back | DIRTY, std::memory_order_acq_rel);
+    _back = previous & INDEX_MASK;
+    
+    _submitted.fetch_add(1, std::memory_order_relaxed);
+    if (previous & DIRTY){
+        // The writer didn't take the previous frame : the new one wins, no need to wake it again
+        _superseded.fetch_add(1, std::memory_order_relaxed);
+    }
+    else sem_post(&_wakeup);
+    
+    return true;
+}
+
+
+
+bool Serial_Writer::_take(){
+    if (!(_middle.load(std::memory_order_relaxed) & DIRTY)) return false;
+    
+    uint8_t previous = _middle.exchange(_front, std::memory_order_acq_rel);
+    _front = previous & INDEX_MASK;
+    return true;
+}
+
+
+void Serial_Writer::_transmit(){
+    
+    const Serial_Frame& frame = _frames[_front];
+    
+    uint64_t start = Motor_Event_Log::now();
+    int ret = _port.write_bytes(frame.data, frame.length);
+    uint64_t end = Motor_Event_Log::now();
+    
+    uint64_t queue_age = start - frame.timestamp;
+    uint64_t write_time = end - start;
+    
+    _last_queue_age.store(queue_age, std::memory_order_relaxed);
+    if (queue_age > _max_queue_age.load(std::memory_order_relaxed)) _max_queue_age.store(queue_age, std::memory_order_relaxed);
+    _last_write_time.store(write_time, std::memory_order_relaxed);
+    if (write_time > _max_write_time.load(std::memory_order_relaxed)) _max_write_time.store(write_time, std::memory_order_relaxed);
+    _total_write_time.fetch_add(write_time, std::memory_order_relaxed);
+    
+    if (ret < 0){
+        _write_errors.fetch_add(1, std::memory_order_relaxed);
+        _events.push(Motor_Event::serial_write_error, MOTOR_EVENT_NO_MOTOR, frame.length, 0);
+    }
+    else _written.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void* Serial_Writer::_run(void* arg){
+    Serial_Writer* writer = (Serial_Writer*)arg;
+    
+    while (writer->_running.load()){
+        sem_wait(&writer->_wakeup);
+        if (writer->_take()) writer->_transmit();
+    }
+    
+    // Last frame submitted before stop()
+    if (writer->_take()) writer->_transmit();
+    return NULL;
+}
+
+
+
+Serial_Writer_Stats Serial_Writer::getStats() const {
+    Serial_Writer_Stats stats;
+    stats.submitted = _submitted.load(std::memory_order_relaxed);
+    stats.written = _written.load(std::memory_order_relaxed);
+    stats.superseded = _superseded.load(std::memory_order_relaxed);
+    stats.write_errors = _write_errors.load(std::memory_order_relaxed);
+    stats.last_queue_age = _last_queue_age.load(std::memory_order_relaxed);
+    stats.max_queue_age = _max_queue_age.load(std::memory_order_relaxed);
+    stats.last_write_time = _last_write_time.load(std::memory_order_relaxed);
+    stats.max_write_time = _max_write_time.load(std::memory_order_relaxed);
+    stats.total_write_time = _total_write_time.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+Motor_Event_Log* Serial_Writer::getEventLog(){
+    return &_events;
+}
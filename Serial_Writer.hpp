@@ -0,0 +1,157 @@
+//
+//  Serial_Writer.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Serial_Writer_hpp
+#define Serial_Writer_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <atomic>
+#include "Serial.h"
+#include "Motor_Event_Log.hpp"
+
+
+
+/**
+ * \struct Serial_Frame
+ * \brief One complete PWM frame, transmitted in a single write
+ */
+struct Serial_Frame {
+    
+    enum { MAX_SIZE = 64 };
+    
+    char data[MAX_SIZE];
+    unsigned int length;
+    uint64_t timestamp; // ns, when it was submitted
+};
+
+
+
+/**
+ * \struct Serial_Writer_Stats
+ * \brief Snapshot of the Serial_Writer counters
+ */
+struct Serial_Writer_Stats {
+    uint64_t submitted; // frames handed by the control thread
+    uint64_t written; // frames transmitted
+    uint64_t superseded; // frames replaced by a newer one before being transmitted
+    uint64_t write_errors;
+    uint64_t last_queue_age; // ns between submit and write start
+    uint64_t max_queue_age;
+    uint64_t last_write_time; // ns spent in write
+    uint64_t max_write_time;
+    uint64_t total_write_time;
+};
+
+
+
+
+/**
+ * \class Serial_Writer
+ * \brief Dedicated thread transmitting PWM frames on a Serial port
+ *
+ * The control thread hands frames through a single-slot "latest wins" mailbox (triple buffer) :
+ * submit() never blocks nor allocates, a frame not yet transmitted is replaced by the newer one.
+ */
+class Serial_Writer {
+    
+public:
+    
+    /**
+     * \brief Constructor (does not start the thread)
+     *
+     * \param Serial& : port to write on, must outlive the writer
+     */
+    Serial_Writer(Serial&);
+    
+    
+    /**
+     * \brief Destructor (stops the thread)
+     */
+    ~Serial_Writer();
+    
+    
+    /**
+     * \brief Starts the writer thread
+     *
+     * \return false if the thread couldn't be created
+     */
+    bool start();
+    
+    
+    /**
+     * \brief Stops the writer thread. The pending frame, if any, is transmitted first
+     */
+    void stop();
+    
+    
+    /**
+     * \brief Returns true while the writer thread runs
+     */
+    bool isRunning() const;
+    
+    
+    /**
+     * \brief Control thread side : hands the latest frame to the writer
+     *
+     * \param const char* : frame bytes, unsigned int : length (at most Serial_Frame::MAX_SIZE)
+     * \return false if the frame is too long
+     */
+    bool submit(const char*, unsigned int);
+    
+    
+    /**
+     * \brief Returns a snapshot of the counters
+     */
+    Serial_Writer_Stats getStats() const;
+    
+    
+    /**
+     * \brief Returns the log of write errors, filled by the writer thread
+     */
+    Motor_Event_Log* getEventLog();
+    
+    
+private:
+    
+    static void* _run(void*);
+    
+    bool _take(); // writer side : swaps in the pending frame, if any
+    void _transmit();
+    
+    enum { DIRTY = 0x4, INDEX_MASK = 0x3 };
+    
+    Serial& _port;
+    
+    Serial_Frame _frames[3];
+    uint8_t _back; // owned by the control thread
+    uint8_t _front; // owned by the writer thread
+    std::atomic<uint8_t> _middle; // index of the exchanged frame | DIRTY if not taken yet
+    
+    sem_t _wakeup;
+    pthread_t _thread;
+    std::atomic<bool> _running;
+    
+    std::atomic<uint64_t> _submitted;
+    std::atomic<uint64_t> _written;
+    std::atomic<uint64_t> _superseded;
+    std::atomic<uint64_t> _write_errors;
+    std::atomic<uint64_t> _last_queue_age;
+    std::atomic<uint64_t> _max_queue_age;
+    std::atomic<uint64_t> _last_write_time;
+    std::atomic<uint64_t> _max_write_time;
+    std::atomic<uint64_t> _total_write_time;
+    
+    Motor_Event_Log _events;
+    
+};
+
+
+
+#endif /* Serial_Writer_hpp */
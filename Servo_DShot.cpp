@@ -0,0 +1,169 @@
+//
+//  Servo_DShot.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Servo_DShot.hpp"
+
+
+
+Servo_DShot::Servo_DShot(SPEED speed) : _speed(speed){
+    for (int i=0; i<NB_CHANNELS; i++){
+        _command[i] = motor_stop;
+        _command_repeat[i] = 0;
+        _telemetry[i] = false;
+    }
+}
+
+
+uint16_t Servo_DShot::packet(uint16_t value, bool telemetry){
+    uint16_t data = ((value & 0x7FF) << 1) | (telemetry ? 1 : 0);
+    uint16_t crc = (data ^ (data >> 4) ^ (data >> 8)) & 0x0F;
+    return (data << 4) | crc;
+}
+
+
+bool Servo_DShot::decodePacket(uint16_t packet, uint16_t& value, bool& telemetry){
+    uint16_t data = packet >> 4;
+    if (((data ^ (data >> 4) ^ (data >> 8)) & 0x0F) != (packet & 0x0F)) return false;
+    value = data >> 1;
+    telemetry = data & 1;
+    return true;
+}
+
+
+uint16_t Servo_DShot::throttle(float speed, float speed_max){
+    if (!(speed > 0) || !(speed_max > 0)) return 0; // NaN stops too
+    float value = THROTTLE_MIN + speed/speed_max*(THROTTLE_MAX-THROTTLE_MIN) + 0.5f;
+    return (value < THROTTLE_MAX ? (uint16_t)value : (uint16_t)THROTTLE_MAX);
+}
+
+
+void Servo_DShot::sendCommand(int motor, COMMAND command, unsigned int repeat){
+    if (motor < 0 || motor >= NB_CHANNELS) return;
+    _command[motor] = command;
+    _command_repeat[motor] = repeat;
+}
+
+
+void Servo_DShot::requestTelemetry(int motor){
+    if (motor >= 0 && motor < NB_CHANNELS) _telemetry[motor] = true;
+}
+
+
+void Servo_DShot::encode(const uint16_t* throttles, uint16_t* packets){
+    
+    for (int i=0; i<NB_CHANNELS; i++){
+        uint16_t value = throttles[i];
+        bool telemetry = _telemetry[i];
+        
+        // The ESC ignores commands while its motor spins : they wait
+        if (_command_repeat[i] > 0 && value == 0){
+            value = _command[i];
+            telemetry = true;
+            _command_repeat[i]--;
+        }
+        
+        packets[i] = packet(value, telemetry);
+        _telemetry[i] = false;
+    }
+}
+
+
+int Servo_DShot::encodeDuty(const uint16_t* packets, uint16_t period_ticks, uint16_t* duty, unsigned int size) const {
+    
+    if (size < (FRAME_BITS+1)*NB_CHANNELS) return -1;
+    
+    uint16_t zero = (period_ticks*3 + 4)/8;
+    uint16_t one = (period_ticks*3 + 2)/4;
+    
+    // Branchless over the motors of a bit slot
+    for (int b=0; b<FRAME_BITS; b++){
+        for (int i=0; i<NB_CHANNELS; i++){
+            uint16_t bit = (packets[i] >> (FRAME_BITS-1-b)) & 1;
+            duty[b*NB_CHANNELS + i] = zero + bit*(one-zero);
+        }
+    }
+    for (int i=0; i<NB_CHANNELS; i++){
+        duty[FRAME_BITS*NB_CHANNELS + i] = 0;
+    }
+    return (FRAME_BITS+1)*NB_CHANNELS;
+}
+
+
+void Servo_DShot::encodeMasks(const uint16_t* packets, uint8_t* masks) const {
+    for (int b=0; b<FRAME_BITS; b++){
+        uint8_t mask = 0;
+        for (int i=0; i<NB_CHANNELS; i++){
+            mask |= ((packets[i] >> (FRAME_BITS-1-b)) & 1) << i;
+        }
+        masks[b] = mask;
+    }
+}
+
+
+int Servo_DShot::encodeBridge(const uint16_t* packets, char* out, unsigned int size) const {
+    if (size < BRIDGE_FRAME_SIZE) return -1;
+    out[0] = (char)BRIDGE_SYNC;
+    for (int i=0; i<NB_CHANNELS; i++){
+        out[1+2*i] = packets[i] >> 8;
+        out[2+2*i] = packets[i] & 0xFF;
+    }
+    return BRIDGE_FRAME_SIZE;
+}
+
+
+bool Servo_DShot::decodeDuty(const uint16_t* duty, uint16_t period_ticks, int motor, uint16_t& packet){
+    
+    // A 0 is high 3/8 of the bit, a 1 6/8 : anything off by more than 1/8 is neither
+    uint16_t zero = (period_ticks*3 + 4)/8;
+    uint16_t one = (period_ticks*3 + 2)/4;
+    uint16_t margin = period_ticks/8;
+    
+    packet = 0;
+    for (int b=0; b<FRAME_BITS; b++){
+        uint16_t high = duty[b*NB_CHANNELS + motor];
+        if (high + margin >= one && high <= one + margin) packet = (packet << 1) | 1;
+        else if (high + margin >= zero && high <= zero + margin) packet = packet << 1;
+        else return false;
+    }
+    return duty[FRAME_BITS*NB_CHANNELS + motor] == 0;
+}
+
+
+uint16_t Servo_DShot::decodeMasks(const uint8_t* masks, int motor){
+    uint16_t packet = 0;
+    for (int b=0; b<FRAME_BITS; b++){
+        packet = (packet << 1) | ((masks[b] >> motor) & 1);
+    }
+    return packet;
+}
+
+
+bool Servo_DShot::decodeBridge(const char* frame, int motor, uint16_t& packet){
+    if ((uint8_t)frame[0] != BRIDGE_SYNC) return false;
+    packet = ((uint8_t)frame[1+2*motor] << 8) | (uint8_t)frame[2+2*motor];
+    return true;
+}
+
+
+uint32_t Servo_DShot::getBitPeriod() const {
+    return 1000000/_speed;
+}
+
+
+uint32_t Servo_DShot::getHighZero() const {
+    return getBitPeriod()*3/8;
+}
+
+
+uint32_t Servo_DShot::getHighOne() const {
+    return getBitPeriod()*3/4;
+}
+
+
+Servo_DShot::SPEED Servo_DShot::getSpeed() const {
+    return _speed;
+}
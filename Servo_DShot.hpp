@@ -0,0 +1,187 @@
+//
+//  Servo_DShot.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Servo_DShot_hpp
+#define Servo_DShot_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+
+/**
+ * \class Servo_DShot
+ * \brief DShot150/300/600 digital ESC frames of the 4 motors
+ *
+ * A DShot packet is 16 bits, MSB first : 11 bits of value, the telemetry request bit and a
+ * 4-bit CRC. Values 48-2047 are throttle, 0 is motor stop and 1-47 are special commands,
+ * only honoured by the ESC when its motor is stopped and sent with the telemetry bit set.
+ * Every bit lasts the same time and is high 75% of it for a 1, 37.5% for a 0.
+ *
+ * encode() builds the packets of all motors at once, pending commands included. They are then
+ * laid out for the device driving the lines : interleaved duty cycles for a timer DMA burst,
+ * per-bit GPIO masks for PIO / bit-banging, or a byte frame for a serial bridge.
+ * The decode*() functions read these layouts back, to check them without an ESC.
+ */
+class Servo_DShot {
+    
+public:
+    
+    /**
+     * \enum SPEED
+     * \brief Bit rate, kbit/s
+     */
+    enum SPEED {
+        dshot150=150,
+        dshot300=300,
+        dshot600=600
+    };
+    
+    /**
+     * \enum COMMAND
+     * \brief Special commands (values below THROTTLE_MIN)
+     */
+    enum COMMAND {
+        motor_stop=0,
+        beep_1=1,
+        beep_2=2,
+        beep_3=3,
+        beep_4=4,
+        beep_5=5,
+        esc_info=6,
+        spin_direction_1=7,
+        spin_direction_2=8,
+        mode_3d_off=9,
+        mode_3d_on=10,
+        settings_request=11,
+        save_settings=12,
+        spin_direction_normal=20,
+        spin_direction_reversed=21
+    };
+    
+    enum { NB_CHANNELS = 4, FRAME_BITS = 16 };
+    enum { THROTTLE_MIN = 48, THROTTLE_MAX = 2047 };
+    
+    // Serial bridge frame : sync byte, then the packets of the motors, big endian
+    enum { BRIDGE_SYNC = 0xD5, BRIDGE_FRAME_SIZE = 1 + 2*NB_CHANNELS };
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param SPEED : bit rate, for the bit timings
+     */
+    Servo_DShot(SPEED = dshot300);
+    
+    
+    /**
+     * \brief Builds a packet : value on 11 bits, telemetry bit, CRC
+     */
+    static uint16_t packet(uint16_t value, bool telemetry);
+    
+    
+    /**
+     * \brief Checks the CRC of a packet and splits it
+     *
+     * \return false if the CRC doesn't match
+     */
+    static bool decodePacket(uint16_t packet, uint16_t& value, bool& telemetry);
+    
+    
+    /**
+     * \brief Throttle value of a motor speed : 0 (stop) below or at 0, then THROTTLE_MIN to THROTTLE_MAX
+     *
+     * \param float : speed, float : speed at full throttle
+     */
+    static uint16_t throttle(float speed, float speed_max);
+    
+    
+    /**
+     * \brief Queues a special command for a motor, sent repeat times in a row once it is stopped
+     *
+     * Settings commands (7-12, 20-21) must be received 6 times by the ESC to be applied
+     */
+    void sendCommand(int motor, COMMAND, unsigned int repeat = 1);
+    
+    
+    /**
+     * \brief Sets the telemetry bit of the next packet of a motor
+     */
+    void requestTelemetry(int motor);
+    
+    
+    /**
+     * \brief Packets of one tick
+     *
+     * \param const uint16_t* : NB_CHANNELS throttle values (see throttle())
+     * \param uint16_t* : NB_CHANNELS packets
+     */
+    void encode(const uint16_t*, uint16_t*);
+    
+    
+    /**
+     * \brief Timer DMA burst layout : duty[bit*NB_CHANNELS + motor], in timer ticks
+     *
+     * A trailing slot at 0 ends the frame low.
+     *
+     * \param const uint16_t* : packets, uint16_t : timer ticks per bit
+     * \param uint16_t* : output, unsigned int : its size
+     * \return number of values, -1 if the buffer is too small
+     */
+    int encodeDuty(const uint16_t*, uint16_t period_ticks, uint16_t*, unsigned int) const;
+    
+    
+    /**
+     * \brief GPIO layout : masks[bit], bit m of each mask set when motor m sends a 1
+     *
+     * Each bit slot : every line rises, the 0 lines fall at 37.5%, the others at 75%
+     *
+     * \param const uint16_t* : packets, uint8_t* : FRAME_BITS masks
+     */
+    void encodeMasks(const uint16_t*, uint8_t*) const;
+    
+    
+    /**
+     * \brief Serial bridge layout (BRIDGE_FRAME_SIZE bytes)
+     *
+     * \return length, -1 if the buffer is too small
+     */
+    int encodeBridge(const uint16_t*, char*, unsigned int) const;
+    
+    
+    /**
+     * \brief Decoders of the layouts above : packet of one motor
+     *
+     * \return false if a bit slot is neither a 0 nor a 1 (duty), or the sync byte is wrong (bridge)
+     */
+    static bool decodeDuty(const uint16_t*, uint16_t period_ticks, int motor, uint16_t& packet);
+    static uint16_t decodeMasks(const uint8_t*, int motor);
+    static bool decodeBridge(const char*, int motor, uint16_t& packet);
+    
+    
+    /**
+     * \brief Bit timings, ns
+     */
+    uint32_t getBitPeriod() const;
+    uint32_t getHighZero() const;
+    uint32_t getHighOne() const;
+    SPEED getSpeed() const;
+    
+    
+private:
+    
+    SPEED _speed;
+    
+    uint8_t _command[NB_CHANNELS];
+    unsigned int _command_repeat[NB_CHANNELS];
+    bool _telemetry[NB_CHANNELS];
+    
+};
+
+
+
+#endif /* Servo_DShot_hpp */
@@ -0,0 +1,140 @@
+//
+//  Servo_Encoder.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Servo_Encoder.hpp"
+#include <string.h>
+
+
+
+Servo_Encoder::Servo_Encoder(PROTOCOL protocol, bool delta, unsigned int keepalive, Servo_DShot::SPEED dshot_speed) :
+                                                                                     _protocol(protocol), _dshot(dshot_speed), _delta(delta), _keepalive(keepalive),
+                                                                                     _since_full(0), _acked_valid(false), _staged_full(false),
+                                                                                     _staged_channels(0), _staged_bytes(0), _staged_bytes_full(0)
+{
+    for (int i=0; i<NB_CHANNELS; i++){
+        _channel[i] = i;
+        _acked[i] = 0;
+        _staged[i] = 0;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+void Servo_Encoder::setChannel(int i, uint8_t channel){
+    if (i>=0 && i<NB_CHANNELS) _channel[i] = channel;
+}
+
+
+void Servo_Encoder::setDelta(bool delta){
+    _delta = delta;
+    _acked_valid = false;
+}
+
+
+
+int Servo_Encoder::_encode_channel(int i, uint16_t pulse, char* out, unsigned int size) const {
+    
+    if (_protocol == maestro){
+        if (size < 4) return -1;
+        uint16_t target = pulse*4; // quarters of us
+        out[0] = (char)MAESTRO_SET_TARGET;
+        out[1] = _channel[i];
+        out[2] = target & 0x7F;
+        out[3] = (target >> 7) & 0x7F;
+        return 4;
+    }
+    
+    int ret = snprintf(out, size, "%u=%uus\n", _channel[i], pulse);
+    if (ret < 0 || (unsigned int)ret >= size) return -1;
+    return ret;
+}
+
+
+int Servo_Encoder::encode(const uint16_t* pulses, char* out, unsigned int size, bool full){
+    
+    // ESCs disarm without a steady stream : DShot frames are never deltas
+    if (_protocol == dshot){
+        uint16_t packets[NB_CHANNELS];
+        _dshot.encode(pulses, packets);
+        int length = _dshot.encodeBridge(packets, out, size);
+        if (length < 0) return -1;
+        memcpy(_staged, pulses, sizeof(_staged));
+        _staged_full = true;
+        _staged_channels = NB_CHANNELS;
+        _staged_bytes = length;
+        _staged_bytes_full = length;
+        return length;
+    }
+    
+    _staged_full = full || !_delta || !_acked_valid || (_keepalive > 0 && _since_full+1 >= _keepalive);
+    _staged_channels = 0;
+    _staged_bytes_full = 0;
+    
+    unsigned int length = 0;
+    char scratch[16];
+    
+    for (int i=0; i<NB_CHANNELS; i++){
+        _staged[i] = pulses[i];
+        
+        if (_staged_full || pulses[i] != _acked[i]){
+            int ret = _encode_channel(i, pulses[i], out+length, size-length);
+            if (ret < 0) return -1;
+            length += ret;
+            _staged_bytes_full += ret;
+            _staged_channels++;
+        }
+        else {
+            // Still accounted for, to know what the full frame would have cost
+            _staged_bytes_full += _encode_channel(i, pulses[i], scratch, sizeof(scratch));
+        }
+    }
+    
+    _staged_bytes = length;
+    return length;
+}
+
+
+void Servo_Encoder::acknowledge(){
+    
+    memcpy(_acked, _staged, sizeof(_acked));
+    _acked_valid = true;
+    
+    if (_staged_full) _since_full = 0;
+    else _since_full++;
+    
+    _stats.frames++;
+    if (_staged_full) _stats.full_frames++;
+    if (_staged_channels == 0) _stats.empty_frames++;
+    _stats.channels_sent += _staged_channels;
+    _stats.channels_skipped += NB_CHANNELS - _staged_channels;
+    _stats.bytes_sent += _staged_bytes;
+    _stats.bytes_full += _staged_bytes_full;
+}
+
+
+void Servo_Encoder::invalidate(){
+    _acked_valid = false;
+}
+
+
+Servo_DShot* Servo_Encoder::getDShot(){
+    return &_dshot;
+}
+
+
+Servo_Encoder_Stats Servo_Encoder::getStats() const {
+    return _stats;
+}
+
+
+void Servo_Encoder::printReport(FILE* file) const {
+    uint64_t saved = _stats.bytes_full - _stats.bytes_sent;
+    fprintf(file, "Servo output : %llu frames (%llu full, %llu empty), %llu bytes sent, %llu bytes saved (%.1f%%)\n",
+            (unsigned long long)_stats.frames, (unsigned long long)_stats.full_frames, (unsigned long long)_stats.empty_frames,
+            (unsigned long long)_stats.bytes_sent, (unsigned long long)saved,
+            _stats.bytes_full > 0 ? 100.*saved/_stats.bytes_full : 0.);
+}
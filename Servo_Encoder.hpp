@@ -0,0 +1,157 @@
+//
+//  Servo_Encoder.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Servo_Encoder_hpp
+#define Servo_Encoder_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Servo_DShot.hpp"
+
+
+
+/**
+ * \struct Servo_Encoder_Stats
+ * \brief Bytes on wire of the acknowledged frames, compared with sending full frames
+ */
+struct Servo_Encoder_Stats {
+    uint64_t frames; // acknowledged frames, empty ones included
+    uint64_t full_frames; // forced by keepalive, invalidate() or the caller
+    uint64_t empty_frames; // nothing changed, nothing sent
+    uint64_t channels_sent;
+    uint64_t channels_skipped;
+    uint64_t bytes_sent;
+    uint64_t bytes_full; // what full frames would have cost
+};
+
+
+
+
+/**
+ * \class Servo_Encoder
+ * \brief Encodes the PWM targets of the 4 motors, optionally as a delta
+ *
+ * Protocols : ServoBlaster lines ("id=valueus\n"), Pololu Maestro Set Target
+ * commands (0x84, channel, target in quarter of us on 2x7 bits) or DShot packets for a
+ * serial bridge (see Servo_DShot ; the targets are then throttle values, always all sent).
+ * In delta mode only the channels that differ from the last acknowledged frame are
+ * encoded ; every keepalive frames (and after invalidate()) a full frame is forced.
+ * encode() stages a frame, acknowledge() makes it the reference once transmitted.
+ */
+class Servo_Encoder {
+    
+public:
+    
+    /**
+     * \enum PROTOCOL
+     * \brief Output device protocol
+     */
+    enum PROTOCOL {
+        servoblaster=0,
+        maestro=1,
+        dshot=2
+    };
+    
+    enum { NB_CHANNELS = 4 };
+    enum { MAESTRO_SET_TARGET = 0x84 };
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param PROTOCOL : output protocol
+     * \param bool delta : only encode changed channels
+     * \param unsigned int keepalive : frames between two forced full frames in delta mode (0 : never)
+     * \param SPEED : DShot bit rate
+     */
+    Servo_Encoder(PROTOCOL = servoblaster, bool delta = false, unsigned int keepalive = 50,
+                  Servo_DShot::SPEED = Servo_DShot::dshot300);
+    
+    
+    /**
+     * \brief Sets the device channel (servo id) of a motor
+     *
+     * \param int : motor index, uint8_t : channel
+     */
+    void setChannel(int, uint8_t);
+    
+    
+    /**
+     * \brief Enables or disables delta mode. Next frame is full
+     */
+    void setDelta(bool);
+    
+    
+    /**
+     * \brief Encodes the targets and stages them until acknowledge()
+     *
+     * \param const uint16_t* : NB_CHANNELS pulses in us (DShot : throttle values)
+     * \param char* : output buffer, unsigned int : its size
+     * \param bool full : encode every channel whatever delta mode says
+     * \return encoded length, 0 if nothing changed, -1 if the buffer is too small
+     */
+    int encode(const uint16_t*, char*, unsigned int, bool full = false);
+    
+    
+    /**
+     * \brief The staged frame was transmitted : it becomes the delta reference
+     */
+    void acknowledge();
+    
+    
+    /**
+     * \brief The staged frame was not transmitted : next frame is full
+     */
+    void invalidate();
+    
+    
+    /**
+     * \brief Returns the DShot packet builder, to send special commands
+     */
+    Servo_DShot* getDShot();
+    
+    
+    /**
+     * \brief Returns the counters
+     */
+    Servo_Encoder_Stats getStats() const;
+    
+    
+    /**
+     * \brief Prints bytes sent and saved
+     */
+    void printReport(FILE*) const;
+    
+    
+private:
+    
+    int _encode_channel(int, uint16_t, char*, unsigned int) const;
+    
+    PROTOCOL _protocol;
+    Servo_DShot _dshot;
+    bool _delta;
+    unsigned int _keepalive;
+    unsigned int _since_full; // acknowledged frames since the last full one
+    
+    uint8_t _channel[NB_CHANNELS];
+    uint16_t _acked[NB_CHANNELS]; // reference for delta
+    bool _acked_valid;
+    
+    // Staged frame
+    uint16_t _staged[NB_CHANNELS];
+    bool _staged_full;
+    unsigned int _staged_channels;
+    unsigned int _staged_bytes;
+    unsigned int _staged_bytes_full;
+    
+    Servo_Encoder_Stats _stats;
+    
+};
+
+
+
+#endif /* Servo_Encoder_hpp */
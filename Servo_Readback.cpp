@@ -0,0 +1,165 @@
+//
+//  Servo_Readback.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Servo_Readback.hpp"
+#include <string.h>
+
+
+
+Servo_Readback::Servo_Readback(unsigned int divider, unsigned int tolerance_us, unsigned int timeout_ticks) : _enabled(false),
+                                                _divider(divider > 0 ? divider : 1), _tolerance(tolerance_us),
+                                                _timeout(timeout_ticks > 0 ? timeout_ticks : 1), _next_motor(0), _last_motor(0){
+    for (int i=0; i<NB_CHANNELS; i++){
+        _channel[i] = i;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    _reset(0);
+}
+
+
+void Servo_Readback::_reset(uint64_t quiet_until){
+    _head = 0;
+    _count = 0;
+    _last_appended = 0;
+    _response_bytes = 0;
+    _quiet_until = quiet_until;
+}
+
+
+void Servo_Readback::setEnabled(bool enabled){
+    _enabled = enabled;
+    _reset(0);
+}
+
+
+bool Servo_Readback::isEnabled() const {
+    return _enabled;
+}
+
+
+void Servo_Readback::setChannel(int motor, uint8_t channel){
+    if (motor >= 0 && motor < NB_CHANNELS) _channel[motor] = channel;
+}
+
+
+unsigned int Servo_Readback::appendQueries(const uint16_t* targets, char* out, unsigned int size, uint64_t tick){
+    
+    _last_appended = 0;
+    if (!_enabled || tick < _quiet_until || tick % _divider != 0) return 0;
+    
+    // Get Errors once per round of channels, before the round starts again
+    bool errors = (_next_motor == 0);
+    unsigned int needed = (errors ? 3 : 2);
+    if (size < needed) return 0;
+    if (_count + (errors ? 2 : 1) > MAX_PENDING){
+        _stats.skipped++;
+        return 0;
+    }
+    
+    unsigned int length = 0;
+    Query& position = _pending[(_head+_count) % MAX_PENDING];
+    position.type = MAESTRO_GET_POSITION;
+    position.motor = _next_motor;
+    position.expected = targets[_next_motor];
+    position.tick = tick;
+    out[length++] = (char)MAESTRO_GET_POSITION;
+    out[length++] = _channel[_next_motor];
+    _count++;
+    _last_appended++;
+    
+    if (errors){
+        Query& error = _pending[(_head+_count) % MAX_PENDING];
+        error.type = MAESTRO_GET_ERRORS;
+        error.motor = MOTOR_EVENT_NO_MOTOR;
+        error.expected = 0;
+        error.tick = tick;
+        out[length++] = (char)MAESTRO_GET_ERRORS;
+        _count++;
+        _last_appended++;
+    }
+    
+    _last_motor = _next_motor;
+    _next_motor = (_next_motor+1) % NB_CHANNELS;
+    _stats.queries += _last_appended;
+    return length;
+}
+
+
+void Servo_Readback::cancelQueries(){
+    // The round robin too : the channel (and Get Errors with motor 0) is asked again next time
+    if (_last_appended > 0) _next_motor = _last_motor;
+    _count -= _last_appended;
+    _stats.queries -= _last_appended;
+    _last_appended = 0;
+}
+
+
+void Servo_Readback::process(const char* bytes, unsigned int length, uint64_t tick, Motor_Event_Log& events){
+    
+    if (!_enabled) return;
+    
+    // Resynchronising : late responses are thrown away
+    if (tick < _quiet_until) return;
+    
+    for (unsigned int b=0; b<length; b++){
+        
+        if (_count == 0) break; // unsolicited bytes : nothing to match them with
+        
+        _response[_response_bytes++] = (uint8_t)bytes[b];
+        if (_response_bytes < 2) continue;
+        _response_bytes = 0;
+        
+        const Query& query = _pending[_head];
+        _head = (_head+1) % MAX_PENDING;
+        _count--;
+        
+        uint16_t value = _response[0] | (_response[1] << 8); // little endian
+        _stats.responses++;
+        if (tick - query.tick > _stats.max_latency) _stats.max_latency = tick - query.tick;
+        
+        if (query.type == MAESTRO_GET_ERRORS){
+            // Only bits 0-8 exist : anything above is a position, a response was lost
+            if (value & ~MAESTRO_ERROR_MASK){
+                _stats.timeouts++;
+                events.push(Motor_Event::readback_timeout, MOTOR_EVENT_NO_MOTOR, _count, _timeout);
+                _reset(tick + _timeout);
+                return;
+            }
+            _stats.last_error_bits = value;
+            if (value != 0){
+                _stats.device_errors++;
+                events.push(Motor_Event::device_error, MOTOR_EVENT_NO_MOTOR, value, 0);
+            }
+            continue;
+        }
+        
+        // Position in quarters of us
+        int position = value/4;
+        int difference = position - query.expected;
+        if (difference > (int)_tolerance || difference < -(int)_tolerance){
+            _stats.mismatches++;
+            events.push(Motor_Event::readback_mismatch, query.motor, position, query.expected);
+        }
+    }
+    
+    // Oldest query unanswered for too long : the stream can't be trusted anymore
+    if (_count > 0 && tick - _pending[_head].tick > _timeout){
+        _stats.timeouts++;
+        events.push(Motor_Event::readback_timeout, _pending[_head].motor, _count, _timeout);
+        _reset(tick + _timeout);
+    }
+}
+
+
+unsigned int Servo_Readback::getPending() const {
+    return _count;
+}
+
+
+Servo_Readback_Stats Servo_Readback::getStats() const {
+    return _stats;
+}
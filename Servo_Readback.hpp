@@ -0,0 +1,146 @@
+//
+//  Servo_Readback.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Servo_Readback_hpp
+#define Servo_Readback_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Motor_Event_Log.hpp"
+
+
+
+/**
+ * \struct Servo_Readback_Stats
+ * \brief Counters of a Servo_Readback
+ */
+struct Servo_Readback_Stats {
+    uint64_t queries; // Get Position and Get Errors sent
+    uint64_t responses;
+    uint64_t mismatches; // position differing from the target sent
+    uint64_t device_errors; // Get Errors responses with bits set
+    uint64_t timeouts; // lost responses, by time or detected out of step
+    uint64_t skipped; // queries not sent, too many pending
+    uint64_t max_latency; // ticks between a query and its response
+    uint16_t last_error_bits;
+};
+
+
+
+
+/**
+ * \class Servo_Readback
+ * \brief Verifies the PWM targets with Maestro Get Position (0x90) and Get Errors (0xA1)
+ *
+ * Queries are appended to the target frames, every divider ticks : Get Position of one
+ * channel in turn, and Get Errors once per round of channels. The Maestro answers each with
+ * 2 bytes, in order, so responses are matched against a FIFO of pending queries on later
+ * ticks : the control loop never waits for them. Mismatches, device error bits and timeouts
+ * are pushed to the event log. After a timeout, input is discarded for a timeout period to
+ * get rid of late responses before querying again.
+ */
+class Servo_Readback {
+    
+public:
+    
+    enum { MAESTRO_GET_POSITION = 0x90, MAESTRO_GET_ERRORS = 0xA1, MAESTRO_ERROR_MASK = 0x01FF };
+    enum { NB_CHANNELS = 4, MAX_PENDING = 16, QUERY_SIZE = 3 };
+    
+    
+    /**
+     * \brief Constructor (disabled until setEnabled)
+     *
+     * \param unsigned int : ticks between queries, unsigned int : tolerance on positions in us
+     * \param unsigned int : ticks after which a query without response is a timeout
+     */
+    Servo_Readback(unsigned int divider = 5, unsigned int tolerance_us = 1, unsigned int timeout_ticks = 20);
+    
+    
+    /**
+     * \brief Turns verification on or off (off drops the pending queries)
+     */
+    void setEnabled(bool);
+    bool isEnabled() const;
+    
+    
+    /**
+     * \brief Sets the Maestro channel of a motor
+     */
+    void setChannel(int motor, uint8_t channel);
+    
+    
+    /**
+     * \brief Appends the queries due at this tick behind a target frame
+     *
+     * The targets must be the ones the frame leaves the device with
+     *
+     * \param const uint16_t* : 4 targets in us, char* : end of the frame, unsigned int : room left
+     * \param uint64_t : current tick
+     * \return bytes appended, 0 if none is due
+     */
+    unsigned int appendQueries(const uint16_t*, char*, unsigned int, uint64_t tick);
+    
+    
+    /**
+     * \brief The frame with the last appended queries was not transmitted
+     */
+    void cancelQueries();
+    
+    
+    /**
+     * \brief Matches received bytes with the pending queries, checks timeouts
+     *
+     * \param const char* : bytes read from the device, unsigned int : count
+     * \param uint64_t : current tick, Motor_Event_Log& : where faults go
+     */
+    void process(const char*, unsigned int, uint64_t tick, Motor_Event_Log&);
+    
+    
+    /**
+     * \brief Returns the number of queries waiting for a response
+     */
+    unsigned int getPending() const;
+    
+    
+    Servo_Readback_Stats getStats() const;
+    
+    
+private:
+    
+    struct Query {
+        uint8_t type; // MAESTRO_GET_POSITION or MAESTRO_GET_ERRORS
+        uint8_t motor;
+        uint16_t expected; // us
+        uint64_t tick;
+    };
+    
+    void _reset(uint64_t quiet_until);
+    
+    bool _enabled;
+    unsigned int _divider;
+    unsigned int _tolerance;
+    unsigned int _timeout;
+    
+    uint8_t _channel[NB_CHANNELS];
+    unsigned int _next_motor; // Get Position round robin
+    
+    Query _pending[MAX_PENDING]; // FIFO
+    unsigned int _head; // oldest
+    unsigned int _count;
+    unsigned int _last_appended;
+    unsigned int _last_motor; // _next_motor before the last append, restored by cancelQueries()
+    
+    uint8_t _response[2];
+    unsigned int _response_bytes;
+    uint64_t _quiet_until; // input discarded before that tick
+    
+    Servo_Readback_Stats _stats;
+};
+
+
+
+#endif /* Servo_Readback_hpp */
@@ -0,0 +1,128 @@
+//
+//  Servo_Telemetry.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Servo_Telemetry.hpp"
+#include <string.h>
+
+
+
+// CRC8, polynomial 0x07, one lookup per byte
+struct Crc8_Table {
+    uint8_t value[256];
+    Crc8_Table(){
+        for (int i=0; i<256; i++){
+            uint8_t crc = i;
+            for (int b=0; b<8; b++){
+                crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+            }
+            value[i] = crc;
+        }
+    }
+};
+
+static const Crc8_Table CRC8;
+
+
+
+Servo_Telemetry::Servo_Telemetry(unsigned int poles, bool shared) : _poles(poles > 1 ? poles : 2), _shared(shared), _requested(0){
+    memset(_length, 0, sizeof(_length));
+    memset(_data, 0, sizeof(_data));
+    memset(&_stats, 0, sizeof(_stats));
+    for (int i=0; i<NB_LINES; i++){
+        _motor[i] = i;
+    }
+    for (int i=0; i<NB_MOTORS; i++){
+        _fresh[i] = false;
+    }
+}
+
+
+void Servo_Telemetry::setRequested(int motor){
+    if (motor >= 0 && motor < NB_MOTORS) _requested = motor;
+}
+
+
+uint8_t Servo_Telemetry::crc8(const uint8_t* bytes, unsigned int length){
+    uint8_t crc = 0;
+    for (unsigned int i=0; i<length; i++){
+        crc = CRC8.value[crc ^ bytes[i]];
+    }
+    return crc;
+}
+
+
+unsigned int Servo_Telemetry::feed(int line, const char* bytes, unsigned int length, uint64_t now){
+    
+    if (line < 0 || line >= NB_LINES) return 0;
+    
+    uint8_t* buffer = _buffer[line];
+    unsigned int& count = _length[line];
+    unsigned int frames = 0;
+    _stats.bytes += length;
+    
+    for (unsigned int b=0; b<length; b++){
+        if (count == 0) _motor[line] = (_shared ? _requested : line);
+        buffer[count++] = (uint8_t)bytes[b];
+        if (count < FRAME_SIZE) continue;
+        
+        if (crc8(buffer, FRAME_SIZE-1) == buffer[FRAME_SIZE-1]){
+            _decode(_motor[line], buffer, now);
+            frames++;
+            count = 0;
+            continue;
+        }
+        
+        // Out of step : the frame starts further
+        memmove(buffer, buffer+1, FRAME_SIZE-1);
+        count = FRAME_SIZE-1;
+        _stats.dropped_bytes++;
+    }
+    return frames;
+}
+
+
+void Servo_Telemetry::_decode(int motor, const uint8_t* frame, uint64_t now){
+    
+    if (motor < 0 || motor >= NB_MOTORS) return;
+    Servo_Telemetry_Data& data = _data[motor];
+    
+    data.timestamp = now;
+    data.temperature = frame[0];
+    data.voltage = ((frame[1] << 8) | frame[2])*0.01f;
+    data.current = ((frame[3] << 8) | frame[4])*0.01f;
+    data.consumption = (frame[5] << 8) | frame[6];
+    
+    // Electrical RPM : one turn per pair of poles
+    float erpm = ((frame[7] << 8) | frame[8])*100.f;
+    data.rpm = erpm/(_poles/2);
+    data.speed = data.rpm*(2*3.14159265f/60);
+    data.frames++;
+    
+    _fresh[motor] = true;
+    _stats.frames++;
+}
+
+
+const Servo_Telemetry_Data& Servo_Telemetry::getData(int motor) const {
+    return _data[motor];
+}
+
+
+bool Servo_Telemetry::isFresh(int motor, uint64_t now, uint64_t max_age){
+    
+    bool fresh = _data[motor].frames > 0 && now - _data[motor].timestamp <= max_age;
+    
+    // Counted once per loss
+    if (_fresh[motor] && !fresh) _stats.stale++;
+    _fresh[motor] = fresh;
+    return fresh;
+}
+
+
+Servo_Telemetry_Stats Servo_Telemetry::getStats() const {
+    return _stats;
+}
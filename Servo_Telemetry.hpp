@@ -0,0 +1,126 @@
+//
+//  Servo_Telemetry.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Servo_Telemetry_hpp
+#define Servo_Telemetry_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+
+/**
+ * \struct Servo_Telemetry_Data
+ * \brief Last telemetry frame of an ESC
+ */
+struct Servo_Telemetry_Data {
+    uint64_t timestamp; // us, of the last frame
+    float rpm; // mechanical
+    float speed; // rd/s
+    float voltage; // V
+    float current; // A
+    uint16_t consumption; // mAh
+    uint8_t temperature; // °C
+    uint32_t frames;
+};
+
+
+/**
+ * \struct Servo_Telemetry_Stats
+ * \brief Counters of a Servo_Telemetry
+ */
+struct Servo_Telemetry_Stats {
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t dropped_bytes; // skipped to find a frame with a valid CRC
+    uint64_t stale; // fresh to stale transitions
+};
+
+
+
+
+/**
+ * \class Servo_Telemetry
+ * \brief Parses KISS / BLHeli_32 ESC telemetry frames of the 4 motors
+ *
+ * A frame is 10 bytes, big endian : temperature, voltage (10 mV), current (10 mA),
+ * consumption (mAh), eRPM (100 eRPM) and a CRC8 (polynomial 0x07). There is no sync byte :
+ * the parser slides over the stream until the CRC matches.
+ * The ESCs either have a line each, or share one line and answer in turn to the telemetry
+ * requests (DShot telemetry bit) : a frame then goes to the motor last requested when its
+ * first byte arrived.
+ * feed() and the readers run on the same thread (Motor_Pipeline loop). No allocation.
+ */
+class Servo_Telemetry {
+    
+public:
+    
+    enum { NB_MOTORS = 4, NB_LINES = 4, FRAME_SIZE = 10 };
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param unsigned int : motor poles, to turn eRPM into RPM
+     * \param bool : one line shared by the ESCs, answering requests
+     */
+    Servo_Telemetry(unsigned int poles = 14, bool shared = true);
+    
+    
+    /**
+     * \brief Shared line : the motor whose telemetry is requested by the frame being sent
+     */
+    void setRequested(int motor);
+    
+    
+    /**
+     * \brief Parses bytes read from a line
+     *
+     * \param int : line (the motor when not shared), const char* : bytes, unsigned int : count
+     * \param uint64_t : current time in us
+     * \return number of complete frames
+     */
+    unsigned int feed(int line, const char*, unsigned int, uint64_t now);
+    
+    
+    /**
+     * \brief Last frame of a motor, and whether it is younger than max_age us
+     */
+    const Servo_Telemetry_Data& getData(int motor) const;
+    bool isFresh(int motor, uint64_t now, uint64_t max_age);
+    
+    
+    Servo_Telemetry_Stats getStats() const;
+    
+    
+    /**
+     * \brief CRC8 of the frames
+     */
+    static uint8_t crc8(const uint8_t*, unsigned int);
+    
+    
+private:
+    
+    void _decode(int motor, const uint8_t*, uint64_t now);
+    
+    unsigned int _poles;
+    bool _shared;
+    int _requested;
+    
+    // One parser per line
+    uint8_t _buffer[NB_LINES][FRAME_SIZE];
+    unsigned int _length[NB_LINES];
+    int _motor[NB_LINES]; // latched at the first byte of a frame
+    
+    Servo_Telemetry_Data _data[NB_MOTORS];
+    bool _fresh[NB_MOTORS];
+    Servo_Telemetry_Stats _stats;
+};
+
+
+
+#endif /* Servo_Telemetry_hpp */
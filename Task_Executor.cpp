@@ -0,0 +1,282 @@
+//
+//  Task_Executor.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Task_Executor.hpp"
+#include "Motor_Event_Log.hpp"
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+
+
+
+Task_Executor::Task_Executor(unsigned int workers, int first_cpu, int priority) : _nb_tasks(0), _nb_workers(workers),
+                                                _first_cpu(first_cpu), _priority(priority), _nb_threads(0), _running(false), _started(false){
+    if (_nb_workers == 0) _nb_workers = 1;
+    if (_nb_workers > MAX_WORKERS) _nb_workers = MAX_WORKERS;
+    
+    memset(_tasks, 0, sizeof(_tasks));
+    
+    // Waits are on CLOCK_MONOTONIC, as task releases
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    
+    for (unsigned int i=0; i<MAX_WORKERS; i++){
+        _workers[i].executor = this;
+        _workers[i].id = i;
+        _workers[i].nb_tasks = 0;
+        pthread_mutex_init(&_workers[i].mutex, NULL);
+        pthread_cond_init(&_workers[i].wakeup, &attr);
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+
+Task_Executor::~Task_Executor(){
+    stop();
+    for (unsigned int i=0; i<MAX_WORKERS; i++){
+        pthread_cond_destroy(&_workers[i].wakeup);
+        pthread_mutex_destroy(&_workers[i].mutex);
+    }
+}
+
+
+int Task_Executor::addTask(const char* name, Task task, void* context, uint32_t period_us, uint32_t budget_us, int priority, int worker){
+    
+    if (_started || _nb_tasks == MAX_TASKS || task == NULL || period_us == 0) return -1;
+    if (worker >= (int)_nb_workers) return -1;
+    
+    Task_Entry& entry = _tasks[_nb_tasks];
+    entry.name = (name != NULL ? name : "task");
+    entry.task = task;
+    entry.context = context;
+    entry.period = 1000ULL*period_us;
+    entry.budget = 1000ULL*(budget_us > 0 ? budget_us : period_us);
+    entry.priority = priority;
+    entry.pinned = worker;
+    entry.worker = worker;
+    memset(&entry.stats, 0, sizeof(entry.stats));
+    return _nb_tasks++;
+}
+
+
+void Task_Executor::_place(){
+    
+    float load[MAX_WORKERS];
+    for (unsigned int w=0; w<_nb_workers; w++){
+        load[w] = 0;
+        _workers[w].nb_tasks = 0;
+    }
+    
+    // Pinned tasks first, then worst fit by decreasing utilization. The placement of a
+    // previous start() is dropped : only the workers asked in addTask() are kept
+    bool placed[MAX_TASKS];
+    for (unsigned int i=0; i<_nb_tasks; i++){
+        _tasks[i].worker = _tasks[i].pinned;
+        placed[i] = (_tasks[i].worker >= 0);
+        if (placed[i]) load[_tasks[i].worker] += (float)_tasks[i].budget/_tasks[i].period;
+    }
+    
+    while (true){
+        int largest = -1;
+        for (unsigned int i=0; i<_nb_tasks; i++){
+            if (placed[i]) continue;
+            if (largest < 0 || _tasks[i].budget*_tasks[largest].period > _tasks[largest].budget*_tasks[i].period) largest = i;
+        }
+        if (largest < 0) break;
+        
+        unsigned int lightest = 0;
+        for (unsigned int w=1; w<_nb_workers; w++){
+            if (load[w] < load[lightest]) lightest = w;
+        }
+        _tasks[largest].worker = lightest;
+        load[lightest] += (float)_tasks[largest].budget/_tasks[largest].period;
+        placed[largest] = true;
+    }
+    
+    // Per worker, by priority : explicit ones first (higher first), then the shorter period
+    for (unsigned int i=0; i<_nb_tasks; i++){
+        Worker& worker = _workers[_tasks[i].worker];
+        unsigned int pos = worker.nb_tasks++;
+        while (pos > 0){
+            const Task_Entry& other = _tasks[worker.tasks[pos-1]];
+            bool before;
+            if (_tasks[i].priority >= 0 || other.priority >= 0) before = (_tasks[i].priority > other.priority);
+            else before = (_tasks[i].period < other.period);
+            if (!before) break;
+            worker.tasks[pos] = worker.tasks[pos-1];
+            pos--;
+        }
+        worker.tasks[pos] = i;
+    }
+}
+
+
+bool Task_Executor::start(){
+    
+    if (_started) return false;
+    _place();
+    
+    // Every task is released once at start, then each period
+    uint64_t now = Motor_Event_Log::now();
+    for (unsigned int i=0; i<_nb_tasks; i++){
+        _tasks[i].release = now;
+    }
+    
+    _running = true;
+    _started = true;
+    for (_nb_threads=0; _nb_threads<_nb_workers; _nb_threads++){
+        if (pthread_create(&_workers[_nb_threads].thread, NULL, &Task_Executor::_run_worker, &_workers[_nb_threads]) != 0){
+            // Only the workers created are joined, the next start() creates them all again
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void Task_Executor::stop(){
+    if (!_started) return;
+    
+    _running = false;
+    for (unsigned int w=0; w<_nb_threads; w++){
+        pthread_mutex_lock(&_workers[w].mutex);
+        pthread_cond_signal(&_workers[w].wakeup);
+        pthread_mutex_unlock(&_workers[w].mutex);
+    }
+    for (unsigned int w=0; w<_nb_threads; w++){
+        pthread_join(_workers[w].thread, NULL);
+    }
+    _nb_threads = 0;
+    _started = false;
+}
+
+
+void* Task_Executor::_run_worker(void* arg){
+    Worker* worker = (Worker*)arg;
+    worker->executor->_run(*worker);
+    return NULL;
+}
+
+
+void Task_Executor::_run(Worker& worker){
+    
+    if (_first_cpu >= 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((_first_cpu + worker.id) % (cores > 0 ? cores : 1), &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    if (_priority > 0){
+        struct sched_param param;
+        param.sched_priority = _priority;
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+    
+    while (_running){
+        
+        // Highest priority task released, if any
+        uint64_t now = Motor_Event_Log::now();
+        uint64_t next = UINT64_MAX;
+        Task_Entry* ready = NULL;
+        
+        for (unsigned int t=0; t<worker.nb_tasks; t++){
+            Task_Entry& entry = _tasks[worker.tasks[t]];
+            if (entry.release <= now){
+                ready = &entry;
+                break;
+            }
+            if (entry.release < next) next = entry.release;
+        }
+        
+        if (ready == NULL){
+            struct timespec deadline;
+            deadline.tv_sec = next/1000000000ULL;
+            deadline.tv_nsec = next%1000000000ULL;
+            pthread_mutex_lock(&worker.mutex);
+            if (_running) pthread_cond_timedwait(&worker.wakeup, &worker.mutex, &deadline);
+            pthread_mutex_unlock(&worker.mutex);
+            continue;
+        }
+        
+        // Releases missed while late are skipped : the task runs once for all of them
+        uint64_t skipped = (now - ready->release)/ready->period;
+        uint64_t release = ready->release + skipped*ready->period;
+        
+        uint64_t start = Motor_Event_Log::now();
+        ready->task(ready->context);
+        uint64_t end = Motor_Event_Log::now();
+        
+        uint64_t exec = end - start;
+        pthread_mutex_lock(&worker.mutex);
+        Task_Stats& stats = ready->stats;
+        stats.runs++;
+        stats.skipped += skipped;
+        stats.total_exec += exec;
+        if (exec > stats.max_exec) stats.max_exec = exec;
+        if (start - release > stats.max_latency) stats.max_latency = start - release;
+        if (exec > ready->budget) stats.budget_overruns++;
+        if (end > release + ready->period) stats.deadline_misses++;
+        pthread_mutex_unlock(&worker.mutex);
+        
+        ready->release = release + ready->period;
+    }
+}
+
+
+Task_Stats Task_Executor::getStats(int id){
+    Task_Stats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (id < 0 || id >= (int)_nb_tasks) return stats;
+    
+    // Before start() tasks are on no worker yet
+    Worker& worker = _workers[_tasks[id].worker >= 0 ? _tasks[id].worker : 0];
+    pthread_mutex_lock(&worker.mutex);
+    stats = _tasks[id].stats;
+    pthread_mutex_unlock(&worker.mutex);
+    return stats;
+}
+
+
+float Task_Executor::getUtilization(unsigned int worker) const {
+    float load = 0;
+    for (unsigned int i=0; i<_nb_tasks; i++){
+        if (_tasks[i].worker == (int)worker) load += (float)_tasks[i].budget/_tasks[i].period;
+    }
+    return load;
+}
+
+
+void Task_Executor::printReport(FILE* file){
+    
+    fprintf(file, "%-12s %6s %10s %9s %8s %8s %8s %12s %12s %12s\n", "task", "worker", "period us", "runs",
+            "misses", "overruns", "skipped", "max lat us", "mean exec us", "max exec us");
+    
+    for (unsigned int i=0; i<_nb_tasks; i++){
+        Task_Stats stats = getStats(i);
+        fprintf(file, "%-12s %6d %10llu %9llu %8llu %8llu %8llu %12.1f %12.1f %12.1f\n", _tasks[i].name, _tasks[i].worker,
+                (unsigned long long)(_tasks[i].period/1000), (unsigned long long)stats.runs,
+                (unsigned long long)stats.deadline_misses, (unsigned long long)stats.budget_overruns, (unsigned long long)stats.skipped,
+                stats.max_latency/1000., (stats.runs > 0 ? stats.total_exec/1000./stats.runs : 0), stats.max_exec/1000.);
+    }
+    
+    // Rate monotonic is guaranteed below n(2^(1/n)-1) of utilization per worker
+    for (unsigned int w=0; w<_nb_workers; w++){
+        unsigned int n = 0;
+        for (unsigned int i=0; i<_nb_tasks; i++){
+            if (_tasks[i].worker == (int)w) n++;
+        }
+        float bound = (n > 0 ? n*(powf(2.f, 1.f/n)-1) : 1.f);
+        float load = getUtilization(w);
+        fprintf(file, "worker %u : %u tasks, utilization %.3f, bound %.3f%s\n", w, n, load, bound,
+                (load > bound ? " : NOT guaranteed" : ""));
+    }
+}
@@ -0,0 +1,165 @@
+//
+//  Task_Executor.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Task_Executor_hpp
+#define Task_Executor_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+
+
+/**
+ * \struct Task_Stats
+ * \brief Counters of one periodic task
+ */
+struct Task_Stats {
+    uint64_t runs;
+    uint64_t deadline_misses; // finished after the next release
+    uint64_t budget_overruns; // ran longer than its budget
+    uint64_t skipped; // releases dropped because the worker was late
+    uint64_t max_latency; // ns, release to start
+    uint64_t max_exec; // ns
+    uint64_t total_exec; // ns
+};
+
+
+
+
+/**
+ * \class Task_Executor
+ * \brief Rate-monotonic executor of periodic tasks on a fixed set of pinned workers
+ *
+ * Tasks are partitioned over the workers at start() (worst fit by utilization, unless
+ * pinned to one), and each worker runs its tasks by priority : rate monotonic, the shorter
+ * period first, unless given explicitly. Scheduling is non-preemptive within a worker :
+ * after each run the worker looks again from the highest priority, so a task waits at
+ * most for the longest budget of its worker. Sleeps are absolute (no drift) ; a late
+ * task runs once and its missed releases are counted, never replayed in a burst.
+ */
+class Task_Executor {
+    
+public:
+    
+    enum { MAX_TASKS = 16, MAX_WORKERS = 8 };
+    
+    /**
+     * \brief Task : called once per period, from its worker
+     */
+    typedef void (*Task)(void* context);
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param unsigned int : workers, int : core of the first one (the next ones follow, -1 not to pin)
+     * \param int : SCHED_FIFO priority of the workers, 0 to leave the policy (needs CAP_SYS_NICE)
+     */
+    Task_Executor(unsigned int workers = 1, int first_cpu = -1, int priority = 0);
+    
+    
+    /**
+     * \brief Destructor (stops the workers)
+     */
+    ~Task_Executor();
+    
+    
+    /**
+     * \brief Registers a periodic task, before start()
+     *
+     * \param const char* : name (kept as a pointer), Task, void* : its context
+     * \param uint32_t : period in us, uint32_t : budget in us (0 for the period)
+     * \param int : priority, higher first, -1 for rate monotonic
+     * \param int : worker to run it on, -1 to let start() place it
+     * \return id of the task, -1 if the table is full or started
+     */
+    int addTask(const char* name, Task, void* context, uint32_t period_us, uint32_t budget_us = 0, int priority = -1, int worker = -1);
+    
+    
+    /**
+     * \brief Places the tasks and starts the workers
+     *
+     * Tasks not pinned in addTask() are placed again at each start()
+     *
+     * \return false if a worker couldn't be created (those already created are stopped)
+     */
+    bool start();
+    
+    
+    /**
+     * \brief Stops the workers, after the tasks running return
+     */
+    void stop();
+    
+    
+    /**
+     * \brief Returns a snapshot of the counters of a task. Threadsafe
+     */
+    Task_Stats getStats(int id);
+    
+    
+    /**
+     * \brief Returns the sum of budget/period of the tasks of a worker
+     */
+    float getUtilization(unsigned int worker) const;
+    
+    
+    /**
+     * \brief Prints per task counters, and the Liu & Layland bound per worker
+     */
+    void printReport(FILE*);
+    
+    
+private:
+    
+    struct Task_Entry {
+        const char* name;
+        Task task;
+        void* context;
+        uint64_t period; // ns
+        uint64_t budget; // ns
+        int priority;
+        int pinned; // worker asked in addTask(), -1 if none
+        int worker; // worker it runs on, placed by start()
+        uint64_t release; // ns, next one
+        Task_Stats stats; // under the mutex of the worker
+    };
+    
+    struct Worker {
+        Task_Executor* executor;
+        unsigned int id;
+        pthread_t thread;
+        pthread_mutex_t mutex; // stats of its tasks, and its sleep
+        pthread_cond_t wakeup;
+        int tasks[MAX_TASKS]; // by priority
+        unsigned int nb_tasks;
+        char _pad[64];
+    };
+    
+    void _place();
+    void _run(Worker&);
+    static void* _run_worker(void*);
+    
+    Task_Entry _tasks[MAX_TASKS];
+    unsigned int _nb_tasks;
+    
+    Worker _workers[MAX_WORKERS];
+    unsigned int _nb_workers;
+    int _first_cpu;
+    int _priority;
+    unsigned int _nb_threads; // workers created by start(), joined by stop()
+    
+    std::atomic<bool> _running;
+    bool _started;
+    
+};
+
+
+
+#endif /* Task_Executor_hpp */
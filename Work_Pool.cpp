@@ -0,0 +1,145 @@
+//
+//  Work_Pool.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "Work_Pool.hpp"
+#include <unistd.h>
+
+
+
+Work_Pool::Work_Pool(unsigned int workers) : _workers(workers), _job(NULL), _context(NULL), _steals(0){
+    
+    if (_workers == 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        _workers = (cores > 0 ? cores : 1);
+    }
+    if (_workers > MAX_WORKERS) _workers = MAX_WORKERS;
+    
+    for (unsigned int i=0; i<MAX_WORKERS; i++){
+        pthread_mutex_init(&_ranges[i].mutex, NULL);
+        _ranges[i].begin = _ranges[i].end = 0;
+    }
+    pthread_mutex_init(&_mutex_steals, NULL);
+}
+
+
+Work_Pool::~Work_Pool(){
+    for (unsigned int i=0; i<MAX_WORKERS; i++){
+        pthread_mutex_destroy(&_ranges[i].mutex);
+    }
+    pthread_mutex_destroy(&_mutex_steals);
+}
+
+
+unsigned int Work_Pool::getWorkers() const {
+    return _workers;
+}
+
+
+
+unsigned int Work_Pool::run(unsigned int count, Job job, void* context){
+    
+    _job = job;
+    _context = context;
+    _steals = 0;
+    
+    // Even split to start with, stealing evens out the rest
+    for (unsigned int i=0; i<_workers; i++){
+        _ranges[i].begin = (uint64_t)count*i/_workers;
+        _ranges[i].end = (uint64_t)count*(i+1)/_workers;
+    }
+    
+    pthread_t threads[MAX_WORKERS];
+    Worker_Arg args[MAX_WORKERS];
+    for (unsigned int i=0; i<_workers; i++){
+        args[i].pool = this;
+        args[i].id = i;
+    }
+    unsigned int created = 1;
+    while (created < _workers && pthread_create(&threads[created], NULL, &Work_Pool::_run_worker, &args[created]) == 0){
+        created++;
+    }
+    
+    // The calling thread is worker 0, and takes over the workers that couldn't be created
+    // (their ranges, under their ids) before its own
+    for (unsigned int i=created; i<_workers; i++){
+        _run_worker(&args[i]);
+    }
+    _run_worker(&args[0]);
+    
+    for (unsigned int i=1; i<created; i++){
+        pthread_join(threads[i], NULL);
+    }
+    return _steals;
+}
+
+
+
+bool Work_Pool::_take(unsigned int id, unsigned int& index){
+    Range& range = _ranges[id];
+    pthread_mutex_lock(&range.mutex);
+    bool found = (range.begin < range.end);
+    if (found) index = range.begin++;
+    pthread_mutex_unlock(&range.mutex);
+    return found;
+}
+
+
+bool Work_Pool::_steal(unsigned int id){
+    
+    // Victim : the worker with the most indices left
+    unsigned int victim = id;
+    unsigned int largest = 0;
+    for (unsigned int i=0; i<_workers; i++){
+        if (i == id) continue;
+        unsigned int begin = _ranges[i].begin.load(std::memory_order_relaxed);
+        unsigned int end = _ranges[i].end.load(std::memory_order_relaxed);
+        unsigned int left = (end > begin ? end - begin : 0); // hint only, checked under lock below
+        if (left > largest){
+            largest = left;
+            victim = i;
+        }
+    }
+    if (victim == id) return false;
+    
+    Range& range = _ranges[victim];
+    pthread_mutex_lock(&range.mutex);
+    unsigned int begin = range.begin;
+    unsigned int end = range.end;
+    if (begin >= end){
+        pthread_mutex_unlock(&range.mutex);
+        return true; // emptied meanwhile, look again
+    }
+    unsigned int middle = begin + (end-begin)/2;
+    range.end = middle;
+    pthread_mutex_unlock(&range.mutex);
+    
+    Range& own = _ranges[id];
+    pthread_mutex_lock(&own.mutex);
+    own.begin = middle;
+    own.end = end;
+    pthread_mutex_unlock(&own.mutex);
+    
+    pthread_mutex_lock(&_mutex_steals);
+    _steals++;
+    pthread_mutex_unlock(&_mutex_steals);
+    return true;
+}
+
+
+void* Work_Pool::_run_worker(void* arg){
+    Worker_Arg* worker = (Worker_Arg*)arg;
+    Work_Pool* pool = worker->pool;
+    unsigned int index;
+    
+    while (true){
+        while (pool->_take(worker->id, index)){
+            pool->_job(pool->_context, index, worker->id);
+        }
+        if (!pool->_steal(worker->id)) break;
+    }
+    return NULL;
+}
@@ -0,0 +1,97 @@
+//
+//  Work_Pool.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef Work_Pool_hpp
+#define Work_Pool_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+
+
+/**
+ * \class Work_Pool
+ * \brief Work-stealing pool running many independent indexed jobs
+ *
+ * Each worker starts with a contiguous range of indices and takes from its front ;
+ * an idle worker steals the back half of the largest remaining range.
+ * Jobs are plain function pointers : nothing is allocated per job.
+ */
+class Work_Pool {
+    
+public:
+    
+    enum { MAX_WORKERS = 64 };
+    
+    /**
+     * \brief Job : called once per index, from any worker
+     */
+    typedef void (*Job)(void* context, unsigned int index, unsigned int worker);
+    
+    
+    /**
+     * \brief Constructor
+     *
+     * \param unsigned int : number of workers, 0 for one per online core
+     */
+    Work_Pool(unsigned int workers = 0);
+    
+    
+    ~Work_Pool();
+    
+    
+    /**
+     * \brief Returns the number of workers
+     */
+    unsigned int getWorkers() const;
+    
+    
+    /**
+     * \brief Runs job for every index in [0, count) and returns once all are done
+     *
+     * \return number of ranges stolen between workers
+     */
+    unsigned int run(unsigned int count, Job, void* context);
+    
+    
+private:
+    
+    /**
+     * \struct Range
+     * \brief Indices left to a worker, on its own cache line
+     */
+    struct Range {
+        pthread_mutex_t mutex; // held to move the bounds
+        std::atomic<unsigned int> begin; // atomic for the unlocked size hint of thieves
+        std::atomic<unsigned int> end;
+        char _pad[64];
+    };
+    
+    struct Worker_Arg {
+        Work_Pool* pool;
+        unsigned int id;
+    };
+    
+    static void* _run_worker(void*);
+    bool _take(unsigned int, unsigned int&);
+    bool _steal(unsigned int);
+    
+    unsigned int _workers;
+    Range _ranges[MAX_WORKERS];
+    
+    Job _job;
+    void* _context;
+    unsigned int _steals;
+    pthread_mutex_t _mutex_steals;
+    
+};
+
+
+
+#endif /* Work_Pool_hpp */
@@ -0,0 +1,165 @@
+//
+//  bench_downlink.cpp
+//  MaestroMotor
+//
+//  Runs a headless MaestroMotor and a Motor_Downlink sharing one simulated UART (virtual
+//  clock), with the four built-in streams and bursts of fault events, then reports the link
+//  utilisation, per-stream rates and latencies, how long the PWM frames waited behind
+//  telemetry, and checks that every packet decodes on the ground side.
+//  Usage : bench_downlink [seconds] [tick_ms] [baud_rate]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <deque>
+#include "../Motor_Downlink.hpp"
+#include "../Motor_Sim.hpp"
+#include "../Serial_Framer.hpp"
+#include "../navi_Estimator.hpp"
+#include "../Config.hpp"
+
+
+
+/**
+ * UART drained at the baud rate in virtual time : measures how long the PWM frames wait
+ * behind the telemetry bytes queued ahead of them
+ */
+class Bench_Uart : public Motor_Output {
+    
+public:
+    
+    Bench_Uart(Motor_Clock& clock, unsigned long baud_rate) : pwm(false), pwm_frames(0), pwm_wait(0), max_pwm_wait(0),
+                                                _clock(clock), _rate(baud_rate/10/1e6), _last(0) {}
+    
+    bool isOpen(){
+        return true;
+    }
+    
+    int write(const char* data, unsigned int length){
+        uint64_t now = _clock.now();
+        double drained = (now - _last)*_rate;
+        _last = now;
+        while (!_queue.empty() && drained > 0){
+            double bytes = (_queue.front().first < drained ? _queue.front().first : drained);
+            _queue.front().first -= bytes;
+            drained -= bytes;
+            if (_queue.front().first <= 0) _queue.pop_front();
+        }
+        
+        if (pwm){
+            double telemetry = 0;
+            for (size_t i=0; i<_queue.size(); i++){
+                if (!_queue[i].second) telemetry += _queue[i].first;
+            }
+            double wait = telemetry/_rate;
+            pwm_frames++;
+            pwm_wait += wait;
+            if (wait > max_pwm_wait) max_pwm_wait = wait;
+        }
+        else downlink.insert(downlink.end(), data, data+length);
+        _queue.push_back(std::make_pair((double)length, pwm));
+        return 1;
+    }
+    
+    bool pwm; // the next writes are PWM frames
+    uint64_t pwm_frames;
+    double pwm_wait; // us
+    double max_pwm_wait;
+    std::vector<char> downlink;
+    
+private:
+    
+    Motor_Clock& _clock;
+    double _rate; // bytes a us
+    std::deque<std::pair<double, bool> > _queue; // bytes left, PWM frame
+    uint64_t _last;
+};
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int seconds = (argc > 1 ? atoi(argv[1]) : 10);
+    unsigned int tick_ms = (argc > 2 ? atoi(argv[2]) : 1);
+    unsigned long baud_rate = (argc > 3 ? atol(argv[3]) : DOWNLINK_BAUD_RATE);
+    unsigned int ticks = seconds*1000/tick_ms;
+    
+    Motor_Virtual_Clock clock;
+    Bench_Uart uart(clock, baud_rate);
+    uart.pwm = true; // initial frame
+    MaestroMotor maestro(tick_ms, &uart, &clock);
+    uart.pwm = false;
+    
+    navi_State navi;
+    navi._update("?R,120,-40,150,150,10,0,-5,2,-1,157");
+    navi._update((uint8_t)87);
+    navi_Estimator estimator;
+    Motor_Event_Log events;
+    
+    Motor_Downlink downlink(&uart, &clock, baud_rate);
+    const char* names[] = {"events", "state", "motors", "battery"};
+    downlink.addStream(Motor_Downlink::packet_event, 3, DOWNLINK_EVENTS_DIVIDER, &Motor_Downlink::packEvent, &events, true);
+    downlink.addStream(Motor_Downlink::packet_state, 2, DOWNLINK_STATE_DIVIDER, &Motor_Downlink::packState, &estimator);
+    downlink.addStream(Motor_Downlink::packet_motors, 1, DOWNLINK_MOTORS_DIVIDER, &Motor_Downlink::packMotors, &maestro);
+    downlink.addStream(Motor_Downlink::packet_battery, 0, DOWNLINK_BATTERY_DIVIDER, &Motor_Downlink::packBattery, &navi);
+    
+    Eigen::Vector4f command(20, 0.1, -0.1, 0.05);
+    uint64_t pwm_bytes = 0;
+    unsigned int pushed = 0;
+    
+    for (unsigned int t=0; t<ticks; t++){
+        
+        // A burst of 20 faults every half second
+        if (t % (500/tick_ms) == 0){
+            for (int i=0; i<20; i++){
+                events.push(Motor_Event::speed_saturation_high, i%4, MAX_MOTOR_SPEED+i, MAX_MOTOR_SPEED);
+            }
+            pushed += 20;
+        }
+        command[0] = 20 + 5*((t/50) % 2); // steps, so the delta frames are not empty
+        estimator.update(navi, clock.now());
+        
+        uart.pwm = true;
+        maestro.tick(command);
+        uart.pwm = false;
+        
+        uint64_t sent = maestro.getOutputStats().bytes_sent;
+        downlink.charge(sent - pwm_bytes);
+        pwm_bytes = sent;
+        downlink.service();
+        
+        clock.sleep(1000*tick_ms);
+    }
+    
+    // Ground side
+    unsigned int received[5] = {0};
+    Serial_Framer framer(Serial_Framer::cobs, Motor_Downlink::PACKET_SIZE);
+    Frame_View frame;
+    size_t position = 0;
+    while (position < uart.downlink.size()){
+        position += framer.feed(&uart.downlink[position], uart.downlink.size()-position);
+        while (framer.next(frame)){
+            if (frame.length >= 2 && frame.data[0] >= 1 && frame.data[0] <= 4) received[(int)frame.data[0]]++;
+        }
+    }
+    
+    Motor_Downlink_Stats stats = downlink.getStats();
+    printf("%u s, %u ms ticks, %lu baud : utilisation %.1f %% (telemetry %llu B, PWM %llu B, capacity %llu B), write errors %llu\n",
+           seconds, tick_ms, baud_rate, 100*downlink.getUtilisation(), (unsigned long long)stats.sent,
+           (unsigned long long)stats.shared, (unsigned long long)stats.capacity, (unsigned long long)stats.write_errors);
+    printf("PWM frames %llu : wait behind telemetry mean %.0f us, max %.0f us (%.0f us a byte)\n", (unsigned long long)uart.pwm_frames,
+           uart.pwm_wait/(uart.pwm_frames > 0 ? uart.pwm_frames : 1), uart.max_pwm_wait, 1e7/baud_rate);
+    printf("%-8s %10s %10s %10s %10s %12s %10s\n", "stream", "packets/s", "bytes/s", "deferred", "superseded", "max lat us", "decoded");
+    for (int s=0; s<4; s++){
+        Motor_Downlink_Stream_Stats stream = downlink.getStreamStats(s);
+        int id = (s == 0 ? Motor_Downlink::packet_event : s == 1 ? Motor_Downlink::packet_state : s == 2 ? Motor_Downlink::packet_motors : Motor_Downlink::packet_battery);
+        printf("%-8s %10.1f %10.1f %10llu %10llu %12llu %10u\n", names[s], (double)stream.packets/seconds, (double)stream.bytes/seconds,
+               (unsigned long long)stream.deferred, (unsigned long long)stream.superseded, (unsigned long long)stream.max_latency, received[id]);
+    }
+    printf("events pushed %u, dropped by the log %u\n", pushed, events.getDropped());
+    
+    return 0;
+}
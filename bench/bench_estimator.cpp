@@ -0,0 +1,132 @@
+//
+//  bench_estimator.cpp
+//  MaestroMotor
+//
+//  Feeds navi_Estimator with 1 kHz navi_State lines of a simulated flight (noisy,
+//  quantised like the real telemetry), absolute or incremental, and reports the time of
+//  an update (line parsing included), its share of the 1 ms period, and the errors of
+//  the raw and filtered states against the simulated truth.
+//  Usage : bench_estimator [seconds] [I|R]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "../navi_Estimator.hpp"
+#include "../Motor_Event_Log.hpp"
+#include "../Config.hpp"
+
+
+
+// Standard normal draw (Box-Muller)
+static double gaussian(){
+    double u = (rand()+1.)/(RAND_MAX+2.);
+    double v = (rand()+1.)/(RAND_MAX+2.);
+    return sqrt(-2*log(u))*cos(2*M_PI*v);
+}
+
+
+static double wrapped(double angle){
+    while (angle > M_PI) angle -= 2*M_PI;
+    while (angle < -M_PI) angle += 2*M_PI;
+    return angle;
+}
+
+
+// Truth at t : slow loops in x, y, climbs in z, banks, and a yaw turning through +-pi
+static void truth(double t, double value[9], double rate[3]){
+    value[0] = 3*sin(0.5*t);    value[3] = 1.5*cos(0.5*t);
+    value[1] = 2*sin(0.8*t);    value[4] = 1.6*cos(0.8*t);
+    value[2] = 1.5 + sin(0.3*t); value[5] = 0.3*cos(0.3*t);
+    value[6] = 0.2*sin(2*t);    rate[0] = 0.4*cos(2*t);
+    value[7] = 0.15*sin(3*t);   rate[1] = 0.45*cos(3*t);
+    value[8] = wrapped(0.6*t);  rate[2] = 0.6;
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int seconds = (argc > 1 ? atoi(argv[1]) : 60);
+    char mode = (argc > 2 ? argv[2][0] : 'I');
+    unsigned int updates = seconds*1000;
+    const uint64_t period = 1000; // us
+    
+    const double noise[9] = {ESTIMATOR_POSITION_NOISE, ESTIMATOR_POSITION_NOISE, ESTIMATOR_POSITION_NOISE,
+        ESTIMATOR_VELOCITY_NOISE, ESTIMATOR_VELOCITY_NOISE, ESTIMATOR_VELOCITY_NOISE,
+        ESTIMATOR_ANGLE_NOISE, ESTIMATOR_ANGLE_NOISE, ESTIMATOR_ANGLE_NOISE};
+    
+    // Lines built beforehand : the timing covers navi_State::_update and the estimator only
+    srand(42);
+    std::vector<char> lines(updates*96);
+    std::vector<double> truths(updates*12);
+    int previous[9] = {0};
+    for (unsigned int n=0; n<updates; n++){
+        double* value = &truths[n*12];
+        truth(n*period*1e-6, value, value+9);
+        int sent[9];
+        for (int i=0; i<9; i++){
+            int quantised = (int)lround((value[i] + noise[i]*gaussian())*100);
+            sent[i] = (mode == 'I' ? quantised - previous[i] : quantised);
+            previous[i] = quantised;
+        }
+        // Field order of navi_State : x, y, z, z_ground, Vx, Vy, Vz, pitch, roll, yaw
+        snprintf(&lines[n*96], 96, "?%c,%d,%d,%d,0,%d,%d,%d,%d,%d,%d", mode,
+                 sent[0], sent[1], sent[2], sent[3], sent[4], sent[5], sent[6], sent[7], sent[8]);
+    }
+    
+    navi_State navi;
+    navi_Estimator estimator;
+    std::vector<uint32_t> times(updates);
+    double raw_error[3] = {0}, filtered_error[4] = {0};
+    uint64_t total = 0;
+    
+    for (unsigned int n=0; n<updates; n++){
+        
+        uint64_t start = Motor_Event_Log::now();
+        navi._update(&lines[n*96]);
+        estimator.update(navi, n*period);
+        uint64_t elapsed = Motor_Event_Log::now() - start;
+        times[n] = (uint32_t)elapsed;
+        total += elapsed;
+        
+        // Errors after the first second (start-up transient)
+        if (n < 1000) continue;
+        const double* value = &truths[n*12];
+        navi_Estimate estimate = estimator.getEstimate();
+        double raw[9] = {navi.get_X()/100., navi.get_Y()/100., navi.get_Z()/100.,
+            navi.get_Vx()/100., navi.get_Vy()/100., navi.get_Vz()/100.,
+            navi.get_Pitch()/100., navi.get_Roll()/100., navi.get_Yaw()/100.};
+        for (int i=0; i<3; i++){
+            double e;
+            e = raw[i] - value[i]; raw_error[0] += e*e;
+            e = raw[3+i] - value[3+i]; raw_error[1] += e*e;
+            e = wrapped(raw[6+i] - value[6+i]); raw_error[2] += e*e;
+            e = estimate.position(i) - value[i]; filtered_error[0] += e*e;
+            e = estimate.velocity(i) - value[3+i]; filtered_error[1] += e*e;
+            e = wrapped(estimate.attitude(i) - value[6+i]); filtered_error[2] += e*e;
+            e = estimate.rate(i) - value[9+i]; filtered_error[3] += e*e;
+        }
+    }
+    
+    std::sort(times.begin(), times.end());
+    double mean = (double)total/updates;
+    double samples = 3.*(updates > 1000 ? updates-1000 : 1);
+    navi_Estimator_Stats stats = estimator.getStats();
+    
+    printf("%u updates (%c), parse + update : mean %.0f ns, p50 %u ns, p99 %u ns, max %u ns\n", updates, mode,
+           mean, times[updates/2], times[updates*99/100], times[updates-1]);
+    printf("1 kHz budget used : %.3f %% (%.0fx headroom)\n", mean/1e4, 1e6/mean);
+    printf("rms error        raw      filtered\n");
+    printf("position  m    %8.4f  %8.4f\n", sqrt(raw_error[0]/samples), sqrt(filtered_error[0]/samples));
+    printf("velocity  m/s  %8.4f  %8.4f\n", sqrt(raw_error[1]/samples), sqrt(filtered_error[1]/samples));
+    printf("attitude  rad  %8.4f  %8.4f\n", sqrt(raw_error[2]/samples), sqrt(filtered_error[2]/samples));
+    printf("rate      rad/s       -  %8.4f\n", sqrt(filtered_error[3]/samples));
+    printf("rejected %llu, resets %llu\n", (unsigned long long)stats.rejected, (unsigned long long)stats.resets);
+    
+    return 0;
+}
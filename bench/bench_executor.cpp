@@ -0,0 +1,176 @@
+//
+//  bench_executor.cpp
+//  MaestroMotor
+//
+//  Hosts the motor tick, telemetry parsing, battery update and watchdog on a
+//  Task_Executor, then the same four loops as one sleeping thread each, and compares
+//  deadline misses and context switches. The motor runs headless (see Motor_Sim.hpp).
+//  Usage : bench_executor [seconds] [workers] [motor_period_us]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "../Task_Executor.hpp"
+#include "../Motor_Sim.hpp"
+#include "../Serial_Framer.hpp"
+
+
+
+struct Bench_State {
+    MaestroMotor* maestro;
+    Eigen::Vector4f command;
+    volatile uint64_t ticks;
+    
+    Serial_Framer* framer;
+    uint64_t lines;
+    
+    float battery;
+    
+    uint64_t watched_ticks;
+    uint64_t stalls; // watchdog found no tick since its last run
+    
+    volatile bool running;
+};
+
+
+static void motor_task(void* context){
+    Bench_State* state = (Bench_State*)context;
+    state->command[0] += (state->ticks % 100 < 50 ? 1.f : -1.f);
+    state->maestro->tick(state->command);
+    state->ticks++;
+}
+
+
+static void telemetry_task(void* context){
+    Bench_State* state = (Bench_State*)context;
+    static const char lines[] = "X120Y-40Z310\nP12R-3W85\nVx4Vy-2Vz11\n";
+    state->framer->feed(lines, sizeof(lines)-1);
+    Frame_View frame;
+    while (state->framer->next(frame)) state->lines++;
+}
+
+
+static void battery_task(void* context){
+    Bench_State* state = (Bench_State*)context;
+    state->battery = (state->battery > 0 ? state->battery - 0.01f : 100.f);
+}
+
+
+static void watchdog_task(void* context){
+    Bench_State* state = (Bench_State*)context;
+    uint64_t ticks = state->ticks;
+    if (ticks == state->watched_ticks) state->stalls++;
+    state->watched_ticks = ticks;
+}
+
+
+
+// Thread per loop, as each subsystem would have with its own Thread
+struct Loop_Arg {
+    Task_Executor::Task task;
+    Bench_State* state;
+    unsigned int period_us;
+};
+
+
+static void* loop_thread(void* arg){
+    Loop_Arg* loop = (Loop_Arg*)arg;
+    while (loop->state->running){
+        loop->task(loop->state);
+        usleep(loop->period_us);
+    }
+    return NULL;
+}
+
+
+static void switches(long& voluntary, long& involuntary){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    voluntary = usage.ru_nvcsw;
+    involuntary = usage.ru_nivcsw;
+}
+
+
+static void reset(Bench_State& state){
+    state.ticks = 0;
+    state.lines = 0;
+    state.battery = 100;
+    state.watched_ticks = 0;
+    state.stalls = 0;
+    state.running = true;
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int seconds = (argc > 1 ? atoi(argv[1]) : 3);
+    unsigned int workers = (argc > 2 ? atoi(argv[2]) : 1);
+    unsigned int motor_period = (argc > 3 ? atoi(argv[3]) : 1000);
+    if (motor_period == 0) motor_period = 1000;
+    
+    Motor_Virtual_Clock clock;
+    Motor_Memory_Output output;
+    MaestroMotor maestro(MIN_TIME_RATE, &output, &clock);
+    Serial_Framer framer(Serial_Framer::newline);
+    
+    Bench_State state;
+    state.maestro = &maestro;
+    state.command = Eigen::Vector4f(Motor_Sim::defaultScenario().hover[0], 0, 0, 0);
+    state.framer = &framer;
+    reset(state);
+    
+    long voluntary, involuntary, voluntary_end, involuntary_end;
+    
+    // Executor
+    Task_Executor executor(workers, 0, 0);
+    executor.addTask("motor", &motor_task, &state, motor_period, motor_period/4);
+    executor.addTask("telemetry", &telemetry_task, &state, 10000, 500);
+    executor.addTask("battery", &battery_task, &state, 1000000, 100);
+    executor.addTask("watchdog", &watchdog_task, &state, 100000, 100);
+    
+    switches(voluntary, involuntary);
+    executor.start();
+    sleep(seconds);
+    executor.stop();
+    switches(voluntary_end, involuntary_end);
+    
+    printf("Task_Executor, %u worker(s), %u s\n", workers, seconds);
+    executor.printReport(stdout);
+    printf("motor ticks %llu   telemetry lines %llu   watchdog stalls %llu\n",
+           (unsigned long long)state.ticks, (unsigned long long)state.lines, (unsigned long long)state.stalls);
+    printf("context switches : %ld voluntary, %ld involuntary\n\n", voluntary_end-voluntary, involuntary_end-involuntary);
+    
+    // One thread per loop
+    reset(state);
+    Loop_Arg loops[4] = {
+        {&motor_task, &state, motor_period},
+        {&telemetry_task, &state, 10000},
+        {&battery_task, &state, 1000000},
+        {&watchdog_task, &state, 100000}
+    };
+    pthread_t threads[4];
+    
+    switches(voluntary, involuntary);
+    for (int i=0; i<4; i++){
+        pthread_create(&threads[i], NULL, &loop_thread, &loops[i]);
+    }
+    sleep(seconds);
+    state.running = false;
+    for (int i=0; i<4; i++){
+        pthread_join(threads[i], NULL);
+    }
+    switches(voluntary_end, involuntary_end);
+    
+    printf("Thread per loop (usleep), %u s\n", seconds);
+    printf("motor ticks %llu (expected %llu)   telemetry lines %llu   watchdog stalls %llu\n",
+           (unsigned long long)state.ticks, (unsigned long long)seconds*1000000/motor_period,
+           (unsigned long long)state.lines, (unsigned long long)state.stalls);
+    printf("context switches : %ld voluntary, %ld involuntary\n", voluntary_end-voluntary, involuntary_end-involuntary);
+    return 0;
+}
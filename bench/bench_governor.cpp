@@ -0,0 +1,113 @@
+//
+//  bench_governor.cpp
+//  MaestroMotor
+//
+//  Ticks a headless MaestroMotor at 2 kHz on deadlines taken from getPeriod(), then steals
+//  the CPU between ticks for a while (spinning, as another task would) and lets it go.
+//  Prints the rate transitions of the governor, the tick rate reached in each phase, and
+//  checks that the acceleration limit held at every period.
+//  Usage : bench_governor [steal_us] [steal_seconds]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../MaestroMotor.hpp"
+#include "../Motor_Sim.hpp"
+
+
+
+static uint64_t now_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
+
+
+static void sleep_until(uint64_t deadline){
+    struct timespec ts;
+    ts.tv_sec = deadline/1000000;
+    ts.tv_nsec = (deadline%1000000)*1000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int steal = (argc > 1 ? atoi(argv[1]) : 1500);
+    unsigned int steal_seconds = (argc > 2 ? atoi(argv[2]) : 4);
+    const unsigned int phases[3] = {2, steal_seconds, 8}; // s : quiet, stolen, quiet
+    const char* names[3] = {"quiet", "stolen", "recovered"};
+    
+    Motor_System_Clock clock;
+    Motor_Memory_Output output;
+    MaestroMotor maestro(1, &output, &clock);
+    maestro.setPeriod(500);
+    
+    Eigen::Vector4f command(20, 0, 0, 0);
+    Eigen::Vector4f previous = maestro.getMotorSpeed();
+    float worst = 0; // highest |dspeed| / (max acceleration * period)
+    
+    uint64_t start = now_us();
+    uint64_t deadline = start;
+    uint64_t end = start;
+    printf("%8s  %s\n", "t (ms)", "transition");
+    
+    for (int phase=0; phase<3; phase++){
+        
+        end += 1000000ULL*phases[phase];
+        uint64_t ticks = 0;
+        uint64_t phase_start = now_us();
+        
+        while (now_us() < end){
+            
+            // Commands stepping every 100 ms : the acceleration limit is hit at every rate
+            command[0] = ((now_us()/100000) % 2 ? 30 : 5);
+            uint32_t period = maestro.getPeriod();
+            maestro.tick(command);
+            ticks++;
+            
+            Eigen::Vector4f speed = maestro.getMotorSpeed();
+            for (int i=0; i<4; i++){
+                float ratio = fabsf(speed[i]-previous[i])/(MAX_MOTOR_ACCELERATION*period*1e-6f);
+                if (ratio > worst) worst = ratio;
+            }
+            previous = speed;
+            
+            Motor_Event events[64];
+            unsigned int count = maestro.getEventLog()->pop(events, 64);
+            for (unsigned int e=0; e<count; e++){
+                if (events[e].type != Motor_Event::rate_change) continue;
+                printf("%8.0f  %.0f us -> %.0f us (%.0f Hz), load %.2f\n", (now_us()-start)/1e3, events[e].limit, events[e].value,
+                       1e6/events[e].value, maestro.getGovernor()->getStats().last_load);
+            }
+            
+            // Someone else takes the CPU between the ticks
+            if (phase == 1){
+                uint64_t until = now_us() + steal;
+                while (now_us() < until) ;
+            }
+            
+            // Next deadline at the current period ; a late loop doesn't burst to catch up
+            deadline += maestro.getPeriod();
+            uint64_t now = now_us();
+            if (deadline < now) deadline = now;
+            else sleep_until(deadline);
+        }
+        
+        double seconds = (now_us()-phase_start)/1e6;
+        printf("%-10s %5.1f s : %7.0f ticks/s, period at the end %u us\n", names[phase], seconds, ticks/seconds, maestro.getPeriod());
+    }
+    
+    Motor_Governor_Stats stats = maestro.getGovernor()->getStats();
+    printf("windows %llu, steps down %llu, steps up %llu, late ticks %llu, max load %.3f\n",
+           (unsigned long long)stats.windows, (unsigned long long)stats.steps_down, (unsigned long long)stats.steps_up,
+           (unsigned long long)stats.late_ticks, stats.max_load);
+    printf("largest speed step : %.3f of the acceleration limit at its period (%s)\n", worst, worst <= 1.0001f ? "held" : "EXCEEDED");
+    
+    return 0;
+}
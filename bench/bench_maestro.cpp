@@ -0,0 +1,369 @@
+//
+//  bench_maestro.cpp
+//  MaestroMotor
+//
+//  Microbenchmarks of the control pipeline : mixer (preCalcMotorSquareSpeed,
+//  _update_motor_speed nominal and saturating), _update_servo_out, setPosition frame
+//  encoding, a whole tick, Serial write and read on a pty, navi_State::_update parsing.
+//  Each case runs a warm-up, then repetitions of a timed batch of calls ; the reported
+//  p50/p99/min/max are over the repetitions, in ns per call. --json prints the results as
+//  one JSON document, to be stored and compared from run to run.
+//  Usage : bench_maestro [--json] [--repetitions n] [--filter name]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pty.h>
+#include <pthread.h>
+#include <sys/utsname.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "../MaestroMotor.hpp"
+#include "../Motor_Sim.hpp"
+#include "../navi_State.hpp"
+#include "../Serial.h"
+
+
+
+static const unsigned int WARMUP_BATCHES = 20;
+
+static volatile float sink; // keeps the results of the pure calls alive
+
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * One benchmark case : run(context, n) makes n calls ; prepare(context), if any, runs
+ * untimed before every batch (draining a log, resetting a state)
+ */
+struct Bench_Case {
+    const char* name;
+    unsigned int batch; // calls per timed repetition
+    void (*run)(void*, unsigned int);
+    void (*prepare)(void*);
+    void* context;
+};
+
+
+struct Bench_Result {
+    const char* name;
+    unsigned int batch;
+    unsigned int repetitions;
+    double p50; // ns per call
+    double p99;
+    double mean;
+    double min;
+    double max;
+};
+
+
+
+/**
+ * Fixtures : a headless MaestroMotor, a pty with a draining peer, a navi_State
+ */
+struct Bench_Fixture {
+    Motor_Virtual_Clock clock;
+    Motor_Memory_Output output;
+    MaestroMotor* maestro;
+    Eigen::Vector4f hover;
+    Eigen::Vector4f high;
+    Eigen::Vector4f low;
+    unsigned int toggle;
+    
+    int master;
+    Serial* port;
+    std::atomic<bool> draining;
+    pthread_t drainer;
+    
+    navi_State navi;
+};
+
+
+static void* drain_master(void* arg){
+    Bench_Fixture* fixture = (Bench_Fixture*)arg;
+    char buffer[4096];
+    while (fixture->draining.load()){
+        if (read(fixture->master, buffer, sizeof(buffer)) <= 0) usleep(50);
+    }
+    return NULL;
+}
+
+
+static const char FRAME[] = "0=1500us\n1=1500us\n2=1500us\n3=1500us\n";
+static const char NAVI_LINE[] = "#R,120,-40,310,0,4,-2,11,12,-3,85";
+
+
+
+static void run_square_speed(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    float total = 0;
+    for (unsigned int k=0; k<n; k++){
+        total += f->maestro->preCalcMotorSquareSpeed(f->hover, (MaestroMotor::SERVO_ID)(k & 3));
+    }
+    sink = total;
+}
+
+
+static void run_motor_speed(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->maestro->_update_motor_speed(f->hover);
+    }
+}
+
+
+// Above the speed ceiling then below zero : both saturations, the acceleration limit and an event per motor
+static void run_motor_speed_saturating(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->maestro->_update_motor_speed((f->toggle++ & 1) ? f->high : f->low);
+    }
+}
+
+
+static void run_servo_out(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->maestro->_update_servo_out();
+    }
+}
+
+
+static void run_set_position(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->maestro->setPosition();
+    }
+}
+
+
+static void run_tick(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->maestro->tick((f->toggle++ & 64) ? f->high : f->hover);
+        f->clock.sleep(f->maestro->getPeriod());
+    }
+}
+
+
+static void prepare_maestro(void* context){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    Motor_Event events[64];
+    while (f->maestro->getEventLog()->pop(events, 64) > 0) ;
+}
+
+
+static void run_serial_write(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->port->write_bytes(FRAME, sizeof(FRAME)-1);
+    }
+}
+
+
+// The peer writes a frame, the port reads it back : pty transfer included
+static void run_serial_read(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    char buffer[64];
+    for (unsigned int k=0; k<n; k++){
+        if (write(f->master, FRAME, sizeof(FRAME)-1) < 0) return;
+        unsigned int received = 0;
+        while (received < sizeof(FRAME)-1){
+            int length = f->port->read_available(buffer, sizeof(FRAME)-1-received);
+            if (length < 0) return;
+            received += length;
+        }
+    }
+}
+
+
+static void prepare_serial_read(void* context){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    f->draining.store(false);
+    if (f->drainer != 0){
+        pthread_join(f->drainer, NULL);
+        f->drainer = 0;
+    }
+}
+
+
+static void run_navi_line(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->navi._update(NAVI_LINE);
+    }
+    sink = f->navi.get_Z();
+}
+
+
+#ifndef MAESTRO_EMBEDDED
+static void run_navi_string(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    std::string line(NAVI_LINE);
+    for (unsigned int k=0; k<n; k++){
+        f->navi._update(line);
+    }
+    sink = f->navi.get_Z();
+}
+#endif
+
+
+static void run_navi_battery(void* context, unsigned int n){
+    Bench_Fixture* f = (Bench_Fixture*)context;
+    for (unsigned int k=0; k<n; k++){
+        f->navi._update((uint8_t)(k & 0x7F));
+    }
+    sink = f->navi.get_battery_state();
+}
+
+
+
+static Bench_Result measure(const Bench_Case& bench, unsigned int repetitions){
+    
+    for (unsigned int w=0; w<WARMUP_BATCHES; w++){
+        if (bench.prepare != NULL) bench.prepare(bench.context);
+        bench.run(bench.context, bench.batch);
+    }
+    
+    std::vector<double> samples(repetitions);
+    double total = 0;
+    for (unsigned int r=0; r<repetitions; r++){
+        if (bench.prepare != NULL) bench.prepare(bench.context);
+        uint64_t start = now_ns();
+        bench.run(bench.context, bench.batch);
+        samples[r] = (double)(now_ns() - start)/bench.batch;
+        total += samples[r];
+    }
+    std::sort(samples.begin(), samples.end());
+    
+    Bench_Result result;
+    result.name = bench.name;
+    result.batch = bench.batch;
+    result.repetitions = repetitions;
+    result.p50 = samples[repetitions/2];
+    result.p99 = samples[(repetitions*99)/100];
+    result.mean = total/repetitions;
+    result.min = samples[0];
+    result.max = samples[repetitions-1];
+    return result;
+}
+
+
+static void print_json(const std::vector<Bench_Result>& results, unsigned int repetitions){
+    struct utsname host;
+    uname(&host);
+#ifdef MAESTRO_EMBEDDED
+    const char* profile = "embedded";
+#else
+    const char* profile = "default";
+#endif
+    printf("{\n  \"benchmark\": \"bench_maestro\",\n  \"timestamp\": %ld,\n", (long)time(NULL));
+    printf("  \"host\": \"%s\",\n  \"machine\": \"%s\",\n  \"profile\": \"%s\",\n", host.nodename, host.machine, profile);
+    printf("  \"warmup_batches\": %u,\n  \"repetitions\": %u,\n  \"unit\": \"ns/call\",\n  \"results\": [\n",
+           WARMUP_BATCHES, repetitions);
+    for (size_t i=0; i<results.size(); i++){
+        const Bench_Result& r = results[i];
+        printf("    {\"name\": \"%s\", \"batch\": %u, \"p50\": %.2f, \"p99\": %.2f, \"mean\": %.2f, \"min\": %.2f, \"max\": %.2f}%s\n",
+               r.name, r.batch, r.p50, r.p99, r.mean, r.min, r.max, i+1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    bool json = false;
+    unsigned int repetitions = 200;
+    const char* filter = NULL;
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "--json") == 0) json = true;
+        else if (strcmp(argv[i], "--repetitions") == 0 && i+1 < argc) repetitions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--filter") == 0 && i+1 < argc) filter = argv[++i];
+        else {
+            fprintf(stderr, "Usage : %s [--json] [--repetitions n] [--filter name]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (repetitions == 0) repetitions = 1;
+    
+    Bench_Fixture fixture;
+    MaestroMotor maestro(1, &fixture.output, &fixture.clock);
+    fixture.maestro = &maestro;
+    fixture.maestro->setGoverning(false); // fixed period, whatever the machine load
+    const float hover = 4*thrust_factor*(MAX_MOTOR_SPEED/2)*(MAX_MOTOR_SPEED/2);
+    fixture.hover << hover, 0.001f, -0.001f, 0.0005f;
+    fixture.high << 8*hover, 0.05f, -0.05f, 0.01f;
+    fixture.low << -hover, 0, 0, 0;
+    fixture.toggle = 0;
+    
+    // pty : the peer swallows the writes until the read case takes it over
+    int slave;
+    char name[64];
+    struct termios raw;
+    cfmakeraw(&raw);
+    fixture.drainer = 0;
+    fixture.port = NULL;
+    if (openpty(&fixture.master, &slave, name, &raw, NULL) == 0){
+        fcntl(fixture.master, F_SETFL, O_NONBLOCK);
+        fixture.draining.store(true);
+        pthread_create(&fixture.drainer, NULL, drain_master, &fixture);
+        // Serial reports on stdout : kept out of the JSON document
+        fflush(stdout);
+        int saved = dup(1);
+        int null = open("/dev/null", O_WRONLY);
+        if (json && null >= 0) dup2(null, 1);
+        fixture.port = new Serial(name, 115200);
+        fflush(stdout);
+        dup2(saved, 1);
+        close(saved);
+        if (null >= 0) close(null);
+    }
+    else perror("openpty");
+    
+    Bench_Case cases[] = {
+        {"preCalcMotorSquareSpeed", 4096, &run_square_speed, NULL, &fixture},
+        {"_update_motor_speed", 1024, &run_motor_speed, &prepare_maestro, &fixture},
+        {"_update_motor_speed_saturating", 1024, &run_motor_speed_saturating, &prepare_maestro, &fixture},
+        {"_update_servo_out", 1024, &run_servo_out, &prepare_maestro, &fixture},
+        {"setPosition", 1024, &run_set_position, &prepare_maestro, &fixture},
+        {"tick", 256, &run_tick, &prepare_maestro, &fixture},
+        {"serial_write_pty", 64, &run_serial_write, NULL, &fixture},
+        {"serial_read_pty", 16, &run_serial_read, &prepare_serial_read, &fixture},
+        {"navi_update_line", 1024, &run_navi_line, NULL, &fixture},
+#ifndef MAESTRO_EMBEDDED
+        {"navi_update_string", 1024, &run_navi_string, NULL, &fixture},
+#endif
+        {"navi_update_battery", 4096, &run_navi_battery, NULL, &fixture}
+    };
+    
+    std::vector<Bench_Result> results;
+    if (!json) printf("%-32s %8s %10s %10s %10s %10s   (ns/call, %u repetitions)\n", "case", "batch", "p50", "p99", "min", "max", repetitions);
+    for (unsigned int c=0; c<sizeof(cases)/sizeof(cases[0]); c++){
+        const Bench_Case& bench = cases[c];
+        if (filter != NULL && strstr(bench.name, filter) == NULL) continue;
+        if (strncmp(bench.name, "serial", 6) == 0 && fixture.port == NULL) continue;
+        
+        Bench_Result result = measure(bench, repetitions);
+        results.push_back(result);
+        if (!json){
+            printf("%-32s %8u %10.1f %10.1f %10.1f %10.1f\n", result.name, result.batch, result.p50, result.p99, result.min, result.max);
+            fflush(stdout);
+        }
+    }
+    if (json) print_json(results, repetitions);
+    
+    prepare_serial_read(&fixture);
+    delete fixture.port;
+    return 0;
+}
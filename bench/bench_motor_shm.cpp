@@ -0,0 +1,100 @@
+//
+//  bench_motor_shm.cpp
+//  MaestroMotor
+//
+//  Command round trip through the shared segment : the client writes a command,
+//  an echo daemon waits for it (futex) and publishes a status, the client waits
+//  for that status. Run between two threads of one process, then between two
+//  processes, to isolate the cost of the process boundary.
+//  Usage : bench_motor_shm [round_trips]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <vector>
+#include "../Motor_Shm.hpp"
+#include "../Motor_Event_Log.hpp"
+
+#define BENCH_SHM_NAME "/maestro_motor_bench"
+
+
+
+// Echo daemon : acknowledges every command through the status block
+static void* echo(void*){
+    Motor_Shm shm(Motor_Shm::daemon, BENCH_SHM_NAME);
+    if (!shm.open()) return NULL;
+    
+    float command[4];
+    bool shutdown = false;
+    Motor_Status status;
+    memset(&status, 0, sizeof(status));
+    
+    while (!shutdown){
+        if (!shm.waitCommand(command, shutdown, 100000)) continue;
+        status.ticks++;
+        shm.writeStatus(status);
+    }
+    return NULL;
+}
+
+
+static void run(const char* name, unsigned int round_trips){
+    
+    Motor_Shm shm(Motor_Shm::client, BENCH_SHM_NAME);
+    if (!shm.open()){
+        fprintf(stderr, "Couldn't map %s\n", BENCH_SHM_NAME);
+        return;
+    }
+    
+    std::vector<uint64_t> latencies(round_trips);
+    float command[4] = {500, 0, 0, 0};
+    Motor_Status status;
+    
+    for (unsigned int i=0; i<round_trips+100; i++){
+        uint64_t start = Motor_Event_Log::now();
+        uint32_t sequence = shm.writeCommand(command);
+        do {
+            if (!shm.readStatus(status, 1000000)){
+                fprintf(stderr, "%s : no answer from the echo daemon\n", name);
+                return;
+            }
+        } while (status.command_sequence != sequence);
+        if (i >= 100) latencies[i-100] = Motor_Event_Log::now() - start; // first 100 are warmup
+    }
+    command[0] = 0;
+    shm.writeCommand(command, true);
+    
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-14s round trip  p50 %7.2f us   p99 %7.2f us   max %8.2f us\n", name,
+           latencies[round_trips/2]/1000., latencies[(round_trips*99)/100]/1000., latencies[round_trips-1]/1000.);
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int round_trips = (argc > 1 ? atoi(argv[1]) : 20000);
+    
+    Motor_Shm::unlink(BENCH_SHM_NAME);
+    
+    pthread_t thread;
+    pthread_create(&thread, NULL, echo, NULL);
+    run("in-process", round_trips);
+    pthread_join(thread, NULL);
+    
+    pid_t pid = fork();
+    if (pid == 0){
+        echo(NULL);
+        _exit(0);
+    }
+    run("cross-process", round_trips);
+    waitpid(pid, NULL, 0);
+    
+    Motor_Shm::unlink(BENCH_SHM_NAME);
+    return 0;
+}
@@ -0,0 +1,73 @@
+//
+//  bench_serial_framer.cpp
+//  MaestroMotor
+//
+//  Parsing throughput of Serial_Framer for each framing, on a pre-encoded
+//  stream of telemetry-sized frames fed in UART-like chunks
+//  Usage : bench_serial_framer [MB]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../Serial_Framer.hpp"
+#include "../Motor_Event_Log.hpp"
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int megabytes = (argc > 1 ? atoi(argv[1]) : 64);
+    const char* names[] = {"newline", "length_prefix", "cobs", "slip"};
+    
+    // Telemetry-like payloads, 8 to 64 bytes. Binary framings get every byte value
+    srand(42);
+    std::vector<char> payloads[2];
+    for (int kind=0; kind<2; kind++){
+        for (int i=0; i<4096; i++){
+            payloads[kind].push_back(8 + rand()%57);
+        }
+    }
+    
+    for (int framing=0; framing<4; framing++){
+        
+        // Build a 1 MB encoded stream
+        std::vector<char> stream;
+        char payload[64];
+        char encoded[256];
+        for (unsigned int i=0; stream.size() < (1<<20); i++){
+            unsigned int length = (uint8_t)payloads[framing != 0][i % 4096];
+            for (unsigned int j=0; j<length; j++){
+                payload[j] = (framing == Serial_Framer::newline ? 'a' + (i+j)%26 : (char)(rand() & 0xFF));
+            }
+            unsigned int n = Serial_Framer::encode((Serial_Framer::FRAMING)framing, payload, length, encoded, sizeof(encoded));
+            stream.insert(stream.end(), encoded, encoded+n);
+        }
+        
+        Serial_Framer framer((Serial_Framer::FRAMING)framing, 128);
+        Frame_View frame;
+        uint64_t checksum = 0;
+        const unsigned int chunk = 64; // what a poll of the UART typically returns
+        
+        uint64_t start = Motor_Event_Log::now();
+        for (unsigned int pass=0; pass<megabytes; pass++){
+            size_t position = 0;
+            while (position < stream.size()){
+                unsigned int count = (stream.size()-position < chunk ? stream.size()-position : chunk);
+                position += framer.feed(&stream[position], count);
+                while (framer.next(frame)) checksum += frame.length;
+            }
+        }
+        uint64_t elapsed = Motor_Event_Log::now() - start;
+        
+        Serial_Framer_Stats stats = framer.getStats();
+        double seconds = elapsed/1e9;
+        printf("%-14s %8.1f MB/s  %10.2f Mframes/s  (errors %llu, dropped %llu, checksum %llu)\n", names[framing],
+               stats.bytes_in/seconds/1e6, stats.frames/seconds/1e6,
+               (unsigned long long)stats.decode_errors, (unsigned long long)stats.dropped_bytes, (unsigned long long)checksum);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,111 @@
+//
+//  bench_serial_uring.cpp
+//  MaestroMotor
+//
+//  Compares the plain write path and the io_uring backend on a pty :
+//  syscalls per tick and frame latency percentiles (write call for plain,
+//  submit to reaped completion for io_uring)
+//  Usage : bench_serial_uring [ticks]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pty.h>
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "../Serial.h"
+#include "../Serial_Uring.hpp"
+
+
+
+static std::atomic<bool> reading(true);
+
+// Plays the device : swallows whatever is written on the pty
+static void* drain_master(void* arg){
+    int master = *(int*)arg;
+    char buffer[4096];
+    while (reading.load()){
+        if (read(master, buffer, sizeof(buffer)) <= 0) usleep(100);
+    }
+    return NULL;
+}
+
+
+static void report(const char* name, std::vector<uint64_t>& latencies, double syscalls_per_tick){
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    printf("%-16s syscalls/tick %5.2f   p50 %7.2f us   p99 %7.2f us   max %8.2f us\n", name, syscalls_per_tick,
+           latencies[n/2]/1000., latencies[(n*99)/100]/1000., latencies[n-1]/1000.);
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int ticks = (argc > 1 ? atoi(argv[1]) : 20000);
+    
+    int master, slave;
+    char name[64];
+    struct termios raw;
+    cfmakeraw(&raw);
+    if (openpty(&master, &slave, name, &raw, NULL) < 0){
+        perror("openpty");
+        return 1;
+    }
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    
+    pthread_t reader;
+    pthread_create(&reader, NULL, drain_master, &master);
+    
+    Serial port(name, 115200);
+    const char frame[] = "0=1500us\n1=1500us\n2=1500us\n3=1500us\n";
+    const unsigned int length = sizeof(frame)-1;
+    std::vector<uint64_t> latencies(ticks);
+    
+    // Plain path : one write syscall per tick
+    for (unsigned int i=0; i<ticks; i++){
+        uint64_t start = Motor_Event_Log::now();
+        port.write_bytes(frame, length);
+        latencies[i] = Motor_Event_Log::now() - start;
+    }
+    report("write", latencies, 1.);
+    
+    // io_uring, then io_uring with a kernel submission thread
+    for (int sqpoll=0; sqpoll<2; sqpoll++){
+        
+        Serial_Uring uring(port);
+        if (!uring.setup(sqpoll)){
+            printf("%-16s unavailable\n", sqpoll ? "io_uring sqpoll" : "io_uring");
+            continue;
+        }
+        if (sqpoll && !uring.isSqpoll()){
+            printf("%-16s refused by the kernel\n", "io_uring sqpoll");
+            continue;
+        }
+        
+        // Warmup, lets the SQPOLL thread spin up
+        for (unsigned int i=0; i<100; i++){
+            uring.submitFrame(frame, length);
+            uring.drain();
+        }
+        
+        Serial_Uring_Stats before = uring.getStats();
+        for (unsigned int i=0; i<ticks; i++){
+            uint64_t completed = uring.getStats().completed;
+            uring.submitFrame(frame, length);
+            while (uring.getStats().completed == completed) uring.reap();
+            latencies[i] = uring.getStats().last_latency;
+        }
+        Serial_Uring_Stats after = uring.getStats();
+        
+        report(sqpoll ? "io_uring sqpoll" : "io_uring", latencies, (double)(after.syscalls-before.syscalls)/ticks);
+        if (after.write_errors != before.write_errors) printf("  %llu write errors\n", (unsigned long long)(after.write_errors-before.write_errors));
+    }
+    
+    reading.store(false);
+    pthread_join(reader, NULL);
+    return 0;
+}
@@ -0,0 +1,278 @@
+//
+//  fuzz_serial_framer.cpp
+//  MaestroMotor
+//
+//  Randomised robustness test of the Serial_Framer COBS and SLIP decoders. Each case
+//  builds a stream of random frames and mangles it : left clean, truncated mid-frame,
+//  corrupted (flipped, dropped, inserted bytes, stray delimiters) or replaced by pure
+//  noise, then feeds it in random chunks followed by a clean tail (delimiter + frames).
+//  Checks :
+//    - clean streams round-trip exactly, without decode errors
+//    - frames before a truncation are intact, at most one comes out of the cut one
+//    - the clean tail is always decoded : the framer resyncs after any garbage
+//    - views stay within the framer and max_frame, the guard bytes around it are intact
+//    - feed() never stalls : a full buffer is freed by next()
+//  A failed case prints its seed and index, rerun with them to reproduce. Building with
+//  -fsanitize=address,undefined catches the overruns the guard bytes don't see.
+//  Usage : fuzz_serial_framer [cases] [seed]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../Serial_Framer.hpp"
+
+
+
+static const uint8_t GUARD = 0xA5;
+static const unsigned int TAIL_FRAMES = 4;
+
+
+// Framer between guard bytes : a write past its buffer shows up in them
+struct Guarded_Framer {
+    uint8_t before[64];
+    Serial_Framer framer;
+    uint8_t after[64];
+    
+    Guarded_Framer(Serial_Framer::FRAMING framing, unsigned int max_frame) : framer(framing, max_frame){
+        memset(before, GUARD, sizeof(before));
+        memset(after, GUARD, sizeof(after));
+    }
+    
+    bool intact() const {
+        for (unsigned int i=0; i<sizeof(before); i++){
+            if (before[i] != GUARD || after[i] != GUARD) return false;
+        }
+        return true;
+    }
+};
+
+
+typedef std::vector<char> Bytes;
+
+
+// xorshift : the same stream on every libc, for the reproduction
+struct Random {
+    uint64_t state;
+    
+    Random(uint64_t seed) : state(seed*0x9E3779B97F4A7C15ULL + 1) {}
+    
+    uint32_t next(){
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (uint32_t)(state >> 32);
+    }
+    
+    unsigned int below(unsigned int bound){
+        return next() % bound;
+    }
+};
+
+
+enum MUTATION { clean=0, truncated=1, corrupted=2, noise=3, NB_MUTATIONS=4 };
+static const char* MUTATION_NAMES[] = {"clean", "truncated", "corrupted", "noise"};
+
+
+
+static Bytes random_payload(Random& random, Serial_Framer::FRAMING framing, unsigned int max_frame){
+    
+    // Empty SLIP frames are delimiter runs, used to sync : never handed out
+    unsigned int min_length = (framing == Serial_Framer::slip ? 1 : 0);
+    Bytes payload(min_length + random.below(max_frame - min_length + 1));
+    
+    // Mostly the bytes the framings escape, so the escapes are exercised
+    for (size_t i=0; i<payload.size(); i++){
+        switch (random.below(4)) {
+            case 0 : payload[i] = 0; break;
+            case 1 : payload[i] = (char)(random.below(2) ? Serial_Framer::SLIP_END : Serial_Framer::SLIP_ESC); break;
+            default : payload[i] = (char)random.below(256); break;
+        }
+    }
+    return payload;
+}
+
+
+static void append_encoded(Bytes& stream, Serial_Framer::FRAMING framing, const Bytes& payload){
+    char encoded[Serial_Framer::BUFFER_SIZE];
+    unsigned int length = Serial_Framer::encode(framing, payload.empty() ? NULL : &payload[0], payload.size(), encoded, sizeof(encoded));
+    stream.insert(stream.end(), encoded, encoded+length);
+}
+
+
+static void corrupt(Random& random, Bytes& stream, char delimiter){
+    unsigned int count = 1 + random.below(8);
+    for (unsigned int i=0; i<count && !stream.empty(); i++){
+        size_t position = random.below(stream.size());
+        switch (random.below(4)) {
+            case 0 : stream[position] ^= (char)(1 << random.below(8)); break;
+            case 1 : stream.erase(stream.begin()+position); break;
+            case 2 : stream.insert(stream.begin()+position, (char)random.below(256)); break;
+            default : stream[position] = (random.below(2) ? delimiter : (char)Serial_Framer::SLIP_ESC); break;
+        }
+    }
+}
+
+
+
+/**
+ * \brief Runs one case
+ *
+ * \return NULL if it passed, else what failed
+ */
+static const char* run_case(uint64_t seed, uint64_t index, Serial_Framer::FRAMING& framing, MUTATION& mutation){
+    
+    Random random(seed ^ (index << 20));
+    framing = (random.below(2) ? Serial_Framer::slip : Serial_Framer::cobs);
+    mutation = (MUTATION)random.below(NB_MUTATIONS);
+    unsigned int max_frame = 1 + random.below((Serial_Framer::BUFFER_SIZE-4)/2);
+    char delimiter = (framing == Serial_Framer::cobs ? 0 : (char)Serial_Framer::SLIP_END);
+    
+    // Body
+    std::vector<Bytes> sent;
+    Bytes stream;
+    unsigned int nb_frames = random.below(16);
+    for (unsigned int i=0; i<nb_frames; i++){
+        sent.push_back(random_payload(random, framing, max_frame));
+        append_encoded(stream, framing, sent.back());
+    }
+    
+    size_t intact = sent.size(); // frames expected verbatim at the head of the output
+    switch (mutation) {
+        
+        case truncated : {
+            if (stream.empty()) break;
+            size_t cut = random.below(stream.size());
+            stream.resize(cut);
+            // Frames whose delimiter made it before the cut
+            Bytes reencoded;
+            intact = 0;
+            while (intact < sent.size()){
+                append_encoded(reencoded, framing, sent[intact]);
+                if (reencoded.size() > cut) break;
+                intact++;
+            }
+            break;
+        }
+        
+        case corrupted :
+            corrupt(random, stream, delimiter);
+            intact = 0;
+            break;
+        
+        case noise : {
+            stream.resize(random.below(4*Serial_Framer::BUFFER_SIZE));
+            for (size_t i=0; i<stream.size(); i++) stream[i] = (char)random.below(256);
+            intact = 0;
+            break;
+        }
+        
+        default :
+            break;
+    }
+    size_t body_length = stream.size();
+    
+    // Clean tail, after a delimiter that closes whatever the body left open
+    std::vector<Bytes> tail;
+    stream.push_back(delimiter);
+    for (unsigned int i=0; i<TAIL_FRAMES; i++){
+        tail.push_back(random_payload(random, framing, max_frame));
+        append_encoded(stream, framing, tail.back());
+    }
+    
+    // Feed in UART-like random chunks, frames copied out before the view goes stale
+    Guarded_Framer guarded(framing, max_frame);
+    const char* low = (const char*)&guarded.framer;
+    const char* high = low + sizeof(guarded.framer);
+    std::vector<Bytes> received;
+    Frame_View frame;
+    size_t position = 0;
+    bool stalled = false;
+    
+    while (position < stream.size()){
+        unsigned int count = 1 + random.below(128);
+        if (count > stream.size()-position) count = stream.size()-position;
+        unsigned int accepted = guarded.framer.feed(&stream[position], count);
+        position += accepted;
+        if (!guarded.intact()) return "guard bytes overwritten by feed()";
+        
+        unsigned int frames = 0;
+        while (guarded.framer.next(frame)){
+            if (frame.length > max_frame) return "frame longer than max_frame";
+            if (frame.data < low || frame.data + frame.length > high) return "view outside the framer";
+            received.push_back(Bytes(frame.data, frame.data + frame.length));
+            frames++;
+        }
+        if (!guarded.intact()) return "guard bytes overwritten by next()";
+        
+        // A full buffer must be freed by next() : two refusals in a row is a stall
+        if (accepted == 0 && frames == 0){
+            if (stalled) return "feed() stalled";
+            stalled = true;
+        }
+        else stalled = false;
+    }
+    
+    Serial_Framer_Stats stats = guarded.framer.getStats();
+    if (stats.bytes_in != stream.size()) return "bytes_in doesn't match the stream";
+    
+    // Round trip of the clean frames
+    if (received.size() < intact + TAIL_FRAMES) return "frames lost";
+    for (size_t i=0; i<intact; i++){
+        if (received[i] != sent[i]) return "frame decoded wrong";
+    }
+    for (size_t i=0; i<TAIL_FRAMES; i++){
+        if (received[received.size()-TAIL_FRAMES+i] != tail[i]) return "no resync : tail frame lost or decoded wrong";
+    }
+    
+    size_t extra = received.size() - intact - TAIL_FRAMES; // decoded out of the mangled part
+    if (mutation == clean && (extra != 0 || stats.decode_errors != 0 || stats.dropped_bytes != 0)) return "clean stream not decoded cleanly";
+    if (mutation == truncated && extra > 1) return "more than the partial frame out of a truncation";
+    if (body_length == 0 && extra != 0) return "frame out of nothing";
+    
+    return NULL;
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    uint64_t cases = (argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000);
+    uint64_t seed = (argc > 2 ? strtoull(argv[2], NULL, 10) : 42);
+    
+    uint64_t runs[2][NB_MUTATIONS];
+    memset(runs, 0, sizeof(runs));
+    uint64_t failures = 0;
+    
+    for (uint64_t index=0; index<cases; index++){
+        Serial_Framer::FRAMING framing;
+        MUTATION mutation;
+        const char* error = run_case(seed, index, framing, mutation);
+        runs[framing == Serial_Framer::slip][mutation]++;
+        if (error != NULL){
+            if (failures++ < 10){
+                printf("%s %s : %s (seed %llu case %llu)\n", framing == Serial_Framer::slip ? "slip" : "cobs",
+                       MUTATION_NAMES[mutation], error, (unsigned long long)seed, (unsigned long long)index);
+            }
+        }
+    }
+    
+    printf("%-6s", "");
+    for (int mutation=0; mutation<NB_MUTATIONS; mutation++) printf(" %12s", MUTATION_NAMES[mutation]);
+    printf("\n");
+    for (int kind=0; kind<2; kind++){
+        printf("%-6s", kind ? "slip" : "cobs");
+        for (int mutation=0; mutation<NB_MUTATIONS; mutation++) printf(" %12llu", (unsigned long long)runs[kind][mutation]);
+        printf("\n");
+    }
+    
+    if (failures > 0){
+        printf("FAIL : %llu of %llu cases\n", (unsigned long long)failures, (unsigned long long)cases);
+        return 1;
+    }
+    printf("PASS : %llu cases\n", (unsigned long long)cases);
+    return 0;
+}
@@ -6,20 +6,47 @@
 //  Copyright © 2016 Navi. All rights reserved.
 //
 
-#include <iostream>
+#include <stdio.h>
 #include "MaestroMotor.hpp"
+#include "Motor_Pipeline.hpp"
 
 
 
+static void stop_motors(void* context, uint32_t){
+    ((MaestroMotor*)context)->shutdown();
+}
+
+
 int main(int argc, const char * argv[]) {
     
+    // The whole motor stack runs on this thread : see Motor_Pipeline
+    Motor_Loop loop;
+    Serial servo_port(SERVO_PORT,9600);
+    Motor_Loop_Output output(loop, servo_port.getFd());
+    Motor_System_Clock clock;
     
-    MaestroMotor* maestro = new MaestroMotor(100);
-
-    maestro->start();
+    MaestroMotor maestro(100, &output, &clock);
+    
+    // Embedded profile : errors are returned, not thrown
+    const Motor_Exception* error = Motor_Exception::takeLast();
+    if (error != NULL){
+        fprintf(stderr, "%s", error->what());
+        return 1;
+    }
+    Motor_Pipeline pipeline(maestro, loop, 1000*100);
+    
+    Motor_Event_Drainer drainer("motor_events.bin");
+    drainer.attach(maestro.getEventLog());
+    drainer.start();
+    
+    maestro.getMetrics()->open();
+    maestro.getRecorder()->open("flight.rec", FLIGHT_RECORDER_CAPACITY, 1000*100);
     
-    usleep(10000000);
+    loop.addTimer(10000000, &stop_motors, &maestro);
+    loop.run(MOTOR_LOOP_CPU, MOTOR_LOOP_PRIORITY);
     
+    if (maestro.getPerf()->isOpen()) maestro.getPerf()->printReport();
     
+    drainer.stop();
     
 }
@@ -0,0 +1,196 @@
+//
+//  navi_Estimator.cpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include "navi_Estimator.hpp"
+#include "Config.hpp"
+#include <math.h>
+#include <string.h>
+
+
+
+// 99.9 % chi-square gates, 2 and 1 degrees of freedom
+static const float GATE_2 = 13.82;
+static const float GATE_1 = 10.83;
+
+// Rate variance of a starting attitude axis, (rad/s)^2
+static const float START_RATE_VARIANCE = 1.;
+
+// Quantisation of navi_State : 1 cm, 1 cm/s, 0.01 rad
+static const float QUANTUM = 0.01;
+
+
+static float wrap(float angle){
+    while (angle > M_PI) angle -= 2*M_PI;
+    while (angle < -M_PI) angle += 2*M_PI;
+    return angle;
+}
+
+
+
+navi_Estimator::navi_Estimator(){
+    setNoise(ESTIMATOR_POSITION_NOISE, ESTIMATOR_VELOCITY_NOISE, ESTIMATOR_ANGLE_NOISE,
+             ESTIMATOR_ACCELERATION_NOISE, ESTIMATOR_ANGULAR_ACCELERATION_NOISE);
+    reset();
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+void navi_Estimator::setNoise(float position, float velocity, float angle, float acceleration, float angular_acceleration){
+    float quantisation = QUANTUM*QUANTUM/12;
+    _r_position = position*position + quantisation;
+    _r_velocity = velocity*velocity + quantisation;
+    _r_angle = angle*angle + quantisation;
+    _q_acceleration = acceleration*acceleration;
+    _q_angular = angular_acceleration*angular_acceleration;
+}
+
+
+void navi_Estimator::reset(){
+    for (int a=0; a<NB_AXES; a++){
+        _axes[a].state.setZero();
+        _axes[a].covariance.setZero();
+        _axes[a].rejects = 0;
+    }
+    _started = false;
+    _timestamp = 0;
+}
+
+
+void navi_Estimator::update(navi_State& navi, uint64_t now){
+    
+    float position[3] = {navi.get_X()*QUANTUM, navi.get_Y()*QUANTUM, navi.get_Z()*QUANTUM};
+    float velocity[3] = {navi.get_Vx()*QUANTUM, navi.get_Vy()*QUANTUM, navi.get_Vz()*QUANTUM};
+    float attitude[3] = {navi.get_Pitch()*QUANTUM, navi.get_Roll()*QUANTUM, wrap(navi.get_Yaw()*QUANTUM)};
+    
+    _stats.updates++;
+    
+    if (!_started){
+        for (int i=0; i<3; i++){
+            _start(axis_x+i, position[i], velocity[i], _r_position, _r_velocity);
+            _start(axis_pitch+i, attitude[i], 0, _r_angle, START_RATE_VARIANCE);
+        }
+        _started = true;
+        _timestamp = now;
+        return;
+    }
+    
+    // Same timestamp (or clock going back) : correction only
+    float dt = (now > _timestamp ? (now - _timestamp)*1e-6f : 0);
+    _timestamp = (now > _timestamp ? now : _timestamp);
+    
+    for (int i=0; i<3; i++){
+        if (dt > 0){
+            _predict(axis_x+i, dt, _q_acceleration);
+            _predict(axis_pitch+i, dt, _q_angular);
+        }
+        _correct_full(axis_x+i, position[i], velocity[i]);
+        _correct_value(axis_pitch+i, attitude[i], i == 2);
+    }
+}
+
+
+void navi_Estimator::_start(int a, float value, float derivative, float variance, float derivative_variance){
+    Axis& axis = _axes[a];
+    axis.state << value, derivative;
+    axis.covariance << variance, 0, 0, derivative_variance;
+    axis.rejects = 0;
+}
+
+
+void navi_Estimator::_predict(int a, float dt, float noise){
+    
+    Axis& axis = _axes[a];
+    
+    Eigen::Matrix2f F;
+    F << 1, dt, 0, 1;
+    
+    // Piecewise constant white acceleration over dt
+    float dt2 = dt*dt;
+    Eigen::Matrix2f Q;
+    Q << dt2*dt2/4, dt2*dt/2, dt2*dt/2, dt2;
+    
+    axis.state = F*axis.state;
+    axis.covariance = F*axis.covariance*F.transpose() + noise*Q;
+}
+
+
+void navi_Estimator::_correct_full(int a, float value, float derivative){
+    
+    Axis& axis = _axes[a];
+    
+    Eigen::Matrix2f R;
+    R << _r_position, 0, 0, _r_velocity;
+    
+    Eigen::Vector2f innovation(value - axis.state(0), derivative - axis.state(1));
+    Eigen::Matrix2f S_inverse = (axis.covariance + R).inverse();
+    
+    if (innovation.dot(S_inverse*innovation) > GATE_2){
+        _stats.rejected++;
+        if (++axis.rejects >= MAX_REJECTS){
+            _start(a, value, derivative, _r_position, _r_velocity);
+            _stats.resets++;
+        }
+        return;
+    }
+    axis.rejects = 0;
+    
+    Eigen::Matrix2f K = axis.covariance*S_inverse;
+    axis.state += K*innovation;
+    
+    // Joseph form : stays symmetric positive in float
+    Eigen::Matrix2f I_K = Eigen::Matrix2f::Identity() - K;
+    axis.covariance = I_K*axis.covariance*I_K.transpose() + K*R*K.transpose();
+}
+
+
+void navi_Estimator::_correct_value(int a, float value, bool wrapped){
+    
+    Axis& axis = _axes[a];
+    
+    float innovation = value - axis.state(0);
+    if (wrapped) innovation = wrap(innovation);
+    float S = axis.covariance(0,0) + _r_angle;
+    
+    if (innovation*innovation > GATE_1*S){
+        _stats.rejected++;
+        if (++axis.rejects >= MAX_REJECTS){
+            _start(a, value, axis.state(1), _r_angle, START_RATE_VARIANCE);
+            _stats.resets++;
+        }
+        return;
+    }
+    axis.rejects = 0;
+    
+    Eigen::Vector2f K = axis.covariance.col(0)/S;
+    axis.state += K*innovation;
+    if (wrapped) axis.state(0) = wrap(axis.state(0));
+    
+    Eigen::Matrix2f I_KH;
+    I_KH << 1-K(0), 0, -K(1), 1;
+    axis.covariance = I_KH*axis.covariance*I_KH.transpose() + (_r_angle*K)*K.transpose();
+}
+
+
+navi_Estimate navi_Estimator::getEstimate() const {
+    navi_Estimate estimate;
+    estimate.timestamp = _timestamp;
+    for (int i=0; i<3; i++){
+        estimate.position(i) = _axes[axis_x+i].state(0);
+        estimate.velocity(i) = _axes[axis_x+i].state(1);
+        estimate.attitude(i) = _axes[axis_pitch+i].state(0);
+        estimate.rate(i) = _axes[axis_pitch+i].state(1);
+    }
+    for (int a=0; a<NB_AXES; a++){
+        estimate.covariance[a] = _axes[a].covariance;
+    }
+    return estimate;
+}
+
+
+navi_Estimator_Stats navi_Estimator::getStats() const {
+    return _stats;
+}
@@ -0,0 +1,151 @@
+//
+//  navi_Estimator.hpp
+//  MaestroMotor
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#ifndef navi_Estimator_hpp
+#define navi_Estimator_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "navi_State.hpp"
+#include "/usr/local/include/Dense"
+
+
+
+/**
+ * \struct navi_Estimate
+ * \brief Filtered state, SI units
+ */
+struct navi_Estimate {
+    uint64_t timestamp; // us, of the last update
+    Eigen::Vector3f position; // m : x, y, z
+    Eigen::Vector3f velocity; // m/s
+    Eigen::Vector3f attitude; // rad : pitch, roll, yaw (yaw in [-pi, pi])
+    Eigen::Vector3f rate; // rad/s : estimated only, navi_State has no rate
+    Eigen::Matrix2f covariance[6]; // per axis (navi_Estimator::AXIS), of (position, velocity) or (angle, rate)
+};
+
+
+/**
+ * \struct navi_Estimator_Stats
+ * \brief Counters of a navi_Estimator
+ */
+struct navi_Estimator_Stats {
+    uint64_t updates;
+    uint64_t rejected; // axis measurements outside the gate
+    uint64_t resets; // axes restarted from the measurement after MAX_REJECTS rejections in a row
+};
+
+
+
+
+/**
+ * \class navi_Estimator
+ * \brief Kalman filter of the navi_State measurements
+ *
+ * Six independent axes of two states each : x, y, z with (position, velocity), both measured,
+ * and pitch, roll, yaw with (angle, rate), the angle only measured. The motion model is a
+ * constant velocity driven by a white acceleration. The measurement noise is the quantisation
+ * of navi_State (1 cm, 1 cm/s, 0.01 rad : q^2/12) plus the sensor noise of Config.hpp.
+ * It reads navi_State after its _update, incremental or absolute alike : the increments are
+ * already summed there.
+ * A measurement whose innovation is beyond the 99.9 % gate is skipped ; MAX_REJECTS in a row
+ * restart the axis from it (a jump of an absolute update, a lost increment).
+ * All matrices are fixed-size 2x2 on the stack : no allocation, well under a microsecond an update (bench/bench_estimator.cpp).
+ */
+class navi_Estimator {
+    
+public:
+    
+    /**
+     * \enum AXIS
+     * \brief Filtered axes, index of navi_Estimate::covariance
+     */
+    enum AXIS {
+        axis_x=0,
+        axis_y=1,
+        axis_z=2,
+        axis_pitch=3,
+        axis_roll=4,
+        axis_yaw=5,
+        NB_AXES=6
+    };
+    
+    enum { MAX_REJECTS = 5 };
+    
+    
+    /**
+     * \brief Constructor, noises from Config.hpp
+     */
+    navi_Estimator();
+    
+    
+    /**
+     * \brief Noises, as standard deviations
+     *
+     * \param float : position (m), velocity (m/s), angle (rad) measurement noise, on top of the quantisation
+     * \param float : acceleration (m/s^2), angular acceleration (rad/s^2) process noise
+     */
+    void setNoise(float position, float velocity, float angle, float acceleration, float angular_acceleration);
+    
+    
+    /**
+     * \brief Forgets the state : the next update starts from its measurement
+     */
+    void reset();
+    
+    
+    /**
+     * \brief Predicts up to now, then corrects with the state
+     *
+     * \param navi_State& : state just updated, uint64_t : time of its message in us
+     */
+    void update(navi_State&, uint64_t now);
+    
+    
+    /**
+     * \brief Estimate at the last update
+     */
+    navi_Estimate getEstimate() const;
+    
+    
+    navi_Estimator_Stats getStats() const;
+    
+    
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    
+    
+private:
+    
+    struct Axis {
+        Eigen::Vector2f state;
+        Eigen::Matrix2f covariance;
+        unsigned int rejects; // in a row
+    };
+    
+    void _start(int, float value, float derivative, float variance, float derivative_variance);
+    void _predict(int, float dt, float noise);
+    void _correct_full(int, float value, float derivative);
+    void _correct_value(int, float value, bool wrapped);
+    
+    Axis _axes[NB_AXES];
+    
+    // Measurement variances
+    float _r_position;
+    float _r_velocity;
+    float _r_angle;
+    // Process noise variances
+    float _q_acceleration;
+    float _q_angular;
+    
+    bool _started;
+    uint64_t _timestamp;
+    navi_Estimator_Stats _stats;
+};
+
+
+
+#endif /* navi_Estimator_hpp */
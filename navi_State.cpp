@@ -7,10 +7,12 @@
 //
 
 #include "navi_State.hpp"
+#include <stdlib.h>
+#include <string.h>
 
 
 
-navi_State::navi_State() :  _x(0),_y(0),_z(0),
+navi_State::navi_State() :  _x(0),_y(0),_z(0),_z_ground(0),
                             _Vx(0),_Vy(0),_Vz(0),
                             _pitch(0),_roll(0),_yaw(0),
                             _battery_percentage(0)
@@ -31,30 +33,41 @@ navi_State::navi_State() :  _x(0),_y(0),_z(0),
 
 
 
+#ifndef MAESTRO_EMBEDDED
 void navi_State::_update(std::string s) {
-    std::stringstream ss(s);
-    std::string line(s);
-    std::getline(ss,line,',');
-    int count(0);
+    _update(s.c_str());
+}
+#endif
+
+
+void navi_State::_update(const char* s) {
+    // Header field first (its second char gives the mode), then up to 10 comma separated values
+    const char* field = strchr(s, ',');
+    if (field == NULL || field - s < 2) return;
+    char mode = s[1];
+    if (mode != 'I' && mode != 'R') return;
     
-    switch (line[1]) {
-            // In this case, we're working on incremental mode
-        case 'I' : {
-            while (std::getline(ss,line,',')){
-                (*_global[count]) += std::stoi(line);
-                count++;
-                }
-        }
-        case 'R' : {
-            while (std::getline(ss,line,',')){
-                (*_global[count]) = std::stoi(line);
-                count++;
-            }
-        }
+    int count = 0;
+    while (field != NULL && count < 10) {
+        char* end;
+        long value = strtol(field+1, &end, 10);
+        if (end == field+1) break;
+        
+        // In this case, we're working on incremental mode
+        if (mode == 'I') (*_global[count]) += value;
+        else (*_global[count]) = value;
+        
+        count++;
+        field = strchr(end, ',');
     }
 }
 
 
+void navi_State::_update(uint8_t battery_percentage) {
+    _battery_percentage = battery_percentage;
+}
+
+
 int16_t navi_State::get_X(){
     return _x;
 }
@@ -87,6 +100,14 @@ int16_t navi_State::get_Yaw(){
     return _yaw;
 }
 
+int16_t navi_State::get_Vx(){
+    return _Vx;
+}
+
+int16_t navi_State::get_Vy(){
+    return _Vy;
+}
+
 int16_t navi_State::get_Vz(){
     return _Vz;
 }
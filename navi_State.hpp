@@ -16,9 +16,12 @@
 #define navi_State_hpp
 
 #include <stdio.h>
+#include <stdint.h>
 #include </usr/local/include/Dense>
+#include "Maestro_Profile.hpp"
+#ifndef MAESTRO_EMBEDDED
 #include <string>
-#include <sstream>
+#endif
 
 class navi_State {
     
@@ -28,7 +31,11 @@ public:
     
     navi_State();
         
+#ifndef MAESTRO_EMBEDDED
     void _update(std::string); // Takes into account if info. is incremental or absolute
+#endif
+    
+    void _update(const char*); // Same, from a 0-terminated line : no allocation
     
     void _update(uint8_t); //Updating battery (lower frequency)
     
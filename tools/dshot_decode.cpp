@@ -0,0 +1,158 @@
+//
+//  dshot_decode.cpp
+//  MaestroMotor
+//
+//  Software DShot decoder, to check Servo_DShot without an ESC or a logic analyser.
+//  Without file, round-trips every value and telemetry bit of the 3 bit rates through the
+//  timer duty, GPIO mask and bridge layouts, checks that the CRC catches every single bit
+//  error, and times the encoding of a tick.
+//  With a file (a capture of the servo port with SERVO_PROTOCOL 2), decodes its bridge frames.
+//  Usage : dshot_decode [file]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../Servo_DShot.hpp"
+
+
+
+static const Servo_DShot::SPEED SPEEDS[3] = {Servo_DShot::dshot150, Servo_DShot::dshot300, Servo_DShot::dshot600};
+
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+
+static const char* describe(uint16_t value){
+    static char buffer[32];
+    if (value >= Servo_DShot::THROTTLE_MIN) snprintf(buffer, sizeof(buffer), "throttle %u", value - Servo_DShot::THROTTLE_MIN);
+    else if (value == Servo_DShot::motor_stop) snprintf(buffer, sizeof(buffer), "stop");
+    else snprintf(buffer, sizeof(buffer), "command %u", value);
+    return buffer;
+}
+
+
+static int decode_file(const char* path){
+    
+    FILE* file = fopen(path, "rb");
+    if (file == NULL){
+        perror(path);
+        return 1;
+    }
+    
+    unsigned long frames = 0, crc_errors = 0, skipped = 0;
+    char frame[Servo_DShot::BRIDGE_FRAME_SIZE];
+    int c;
+    
+    while ((c = fgetc(file)) != EOF){
+        
+        // Resynchronises on the sync byte
+        if (c != Servo_DShot::BRIDGE_SYNC){
+            skipped++;
+            continue;
+        }
+        frame[0] = c;
+        if (fread(frame+1, 1, sizeof(frame)-1, file) != sizeof(frame)-1) break;
+        
+        printf("%8lu", frames++);
+        for (int i=0; i<Servo_DShot::NB_CHANNELS; i++){
+            uint16_t packet, value;
+            bool telemetry;
+            Servo_DShot::decodeBridge(frame, i, packet);
+            if (!Servo_DShot::decodePacket(packet, value, telemetry)){
+                crc_errors++;
+                printf(" | %-16s", "CRC error");
+                continue;
+            }
+            printf(" | %-14s %s", describe(value), (telemetry ? "T" : " "));
+        }
+        printf("\n");
+    }
+    fclose(file);
+    
+    fprintf(stderr, "%lu frames, %lu CRC errors, %lu bytes out of frames\n", frames, crc_errors, skipped);
+    return crc_errors > 0;
+}
+
+
+static int self_check(){
+    
+    unsigned long checked = 0, failures = 0;
+    
+    for (int s=0; s<3; s++){
+        Servo_DShot dshot(SPEEDS[s]);
+        
+        // Timer at 72 MHz, as on common flight controllers
+        uint16_t period_ticks = 72000/SPEEDS[s];
+        
+        for (unsigned int value=0; value<2048; value++){
+            for (int telemetry=0; telemetry<2; telemetry++){
+                
+                // Every motor gets a different value, to catch swapped lanes
+                uint16_t packets[Servo_DShot::NB_CHANNELS];
+                uint16_t values[Servo_DShot::NB_CHANNELS];
+                for (int i=0; i<Servo_DShot::NB_CHANNELS; i++){
+                    values[i] = (value + 517*i) & 0x7FF;
+                    packets[i] = Servo_DShot::packet(values[i], telemetry ^ (i & 1));
+                }
+                
+                uint16_t duty[(Servo_DShot::FRAME_BITS+1)*Servo_DShot::NB_CHANNELS];
+                uint8_t masks[Servo_DShot::FRAME_BITS];
+                char bridge[Servo_DShot::BRIDGE_FRAME_SIZE];
+                dshot.encodeDuty(packets, period_ticks, duty, sizeof(duty)/sizeof(duty[0]));
+                dshot.encodeMasks(packets, masks);
+                dshot.encodeBridge(packets, bridge, sizeof(bridge));
+                
+                for (int i=0; i<Servo_DShot::NB_CHANNELS; i++){
+                    uint16_t from_duty, from_bridge, decoded;
+                    bool tel;
+                    bool ok = Servo_DShot::decodeDuty(duty, period_ticks, i, from_duty) && from_duty == packets[i];
+                    ok = ok && Servo_DShot::decodeMasks(masks, i) == packets[i];
+                    ok = ok && Servo_DShot::decodeBridge(bridge, i, from_bridge) && from_bridge == packets[i];
+                    ok = ok && Servo_DShot::decodePacket(packets[i], decoded, tel) && decoded == values[i] && tel == (bool)(telemetry ^ (i & 1));
+                    
+                    // Any single flipped bit must fail the CRC
+                    for (int b=0; b<Servo_DShot::FRAME_BITS; b++){
+                        if (Servo_DShot::decodePacket(packets[i] ^ (1 << b), decoded, tel)) ok = false;
+                    }
+                    checked++;
+                    if (!ok){
+                        if (failures++ < 10) printf("DShot%d : value %u telemetry %d motor %d FAILED\n", SPEEDS[s], values[i], telemetry, i);
+                    }
+                }
+            }
+        }
+        printf("DShot%-3d : bit %u ns, high %u / %u ns\n", SPEEDS[s], dshot.getBitPeriod(), dshot.getHighZero(), dshot.getHighOne());
+    }
+    
+    // Cost of a tick : packets of the 4 motors and their DMA layout
+    Servo_DShot dshot;
+    uint16_t throttles[Servo_DShot::NB_CHANNELS] = {100, 700, 1300, 2000};
+    uint16_t packets[Servo_DShot::NB_CHANNELS];
+    uint16_t duty[(Servo_DShot::FRAME_BITS+1)*Servo_DShot::NB_CHANNELS];
+    const int rounds = 1000000;
+    uint64_t start = now_ns();
+    unsigned int sink = 0;
+    for (int r=0; r<rounds; r++){
+        throttles[r & 3] = (throttles[r & 3] + 1) & 0x7FF;
+        dshot.encode(throttles, packets);
+        dshot.encodeDuty(packets, 240, duty, sizeof(duty)/sizeof(duty[0]));
+        sink += duty[r % 64];
+    }
+    double ns = (now_ns() - start)/(double)rounds;
+    
+    printf("%lu packets checked, %lu failures ; encode + duty layout : %.1f ns per tick (%u)\n", checked, failures, ns, sink & 1);
+    return failures > 0;
+}
+
+
+int main(int argc, const char * argv[]) {
+    if (argc > 1) return decode_file(argv[1]);
+    return self_check();
+}
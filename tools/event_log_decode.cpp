@@ -0,0 +1,80 @@
+//
+//  event_log_decode.cpp
+//  MaestroMotor
+//
+//  Decodes a binary event file written by Motor_Event_Drainer
+//  Usage : event_log_decode [--csv] file
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "../Motor_Event_Log.hpp"
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    bool csv = false;
+    const char* path = NULL;
+    
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else path = argv[i];
+    }
+    
+    if (path == NULL){
+        fprintf(stderr, "Usage : %s [--csv] file\n", argv[0]);
+        return 1;
+    }
+    
+    FILE* file = fopen(path, "rb");
+    if (file == NULL){
+        perror(path);
+        return 1;
+    }
+    
+    Motor_Event_File_Header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, MOTOR_EVENT_MAGIC, 4) != 0){
+        fprintf(stderr, "%s : not a motor event file\n", path);
+        fclose(file);
+        return 1;
+    }
+    if (header.format_version != MOTOR_EVENT_FORMAT_VERSION || header.record_size != sizeof(Motor_Event)){
+        fprintf(stderr, "%s : unsupported format version %u (record size %u)\n", path, header.format_version, header.record_size);
+        fclose(file);
+        return 1;
+    }
+    
+    if (csv) printf("timestamp_ns,source,sequence,type,motor_index,value,limit\n");
+    
+    Motor_Event event;
+    char line[160];
+    unsigned long count = 0;
+    unsigned long gaps = 0;
+    uint32_t expected[256]; // next sequence, per source
+    bool seen[256];
+    memset(seen, 0, sizeof(seen));
+    
+    while (fread(&event, sizeof(event), 1, file) == 1){
+        
+        if (seen[event.source] && event.sequence != expected[event.source]) gaps += event.sequence - expected[event.source];
+        expected[event.source] = event.sequence + 1;
+        seen[event.source] = true;
+        count++;
+        
+        if (csv){
+            printf("%llu,%u,%u,%s,%u,%g,%g\n", (unsigned long long)event.timestamp, event.source, event.sequence,
+                   Motor_Event::typeName(event.type), event.motor_index, event.value, event.limit);
+        }
+        else {
+            event.format(line, sizeof(line));
+            puts(line);
+        }
+    }
+    
+    fclose(file);
+    fprintf(stderr, "%lu events, %lu dropped\n", count, gaps);
+    return 0;
+}
@@ -0,0 +1,206 @@
+//
+//  flight_recorder_decode.cpp
+//  MaestroMotor
+//
+//  Decodes a flight recorder file written by Motor_Recorder, in sequence order.
+//  Without option, prints a summary. --csv prints one line per tick.
+//  --columns writes one raw little-endian array per field in dir (sequence.u64, command0.f32, ...)
+//  and a schema.txt, to be loaded column by column (numpy.fromfile, pandas, arrow).
+//  Usage : flight_recorder_decode [--csv | --columns dir] file
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../Motor_Recorder.hpp"
+
+
+
+/**
+ * One output column : offset of the field in Motor_Tick_Record
+ */
+struct Column {
+    char name[32];
+    const char* type;
+    unsigned int offset;
+    unsigned int size;
+    FILE* file;
+};
+
+
+static unsigned int add_columns(Column* columns, unsigned int n, const char* name, const char* type,
+                                unsigned int offset, unsigned int size, unsigned int count){
+    for (unsigned int i=0; i<count; i++){
+        Column& column = columns[n++];
+        if (count > 1) snprintf(column.name, sizeof(column.name), "%s%u", name, i);
+        else snprintf(column.name, sizeof(column.name), "%s", name);
+        column.type = type;
+        column.offset = offset + i*size;
+        column.size = size;
+        column.file = NULL;
+    }
+    return n;
+}
+
+
+static unsigned int build_columns(Column* columns){
+    unsigned int n = 0;
+    n = add_columns(columns, n, "sequence", "u64", offsetof(Motor_Tick_Record, sequence), 8, 1);
+    n = add_columns(columns, n, "timestamp", "u64", offsetof(Motor_Tick_Record, timestamp), 8, 1);
+    n = add_columns(columns, n, "command", "f32", offsetof(Motor_Tick_Record, command), 4, 4);
+    n = add_columns(columns, n, "square_speed", "f32", offsetof(Motor_Tick_Record, square_speed), 4, 4);
+    n = add_columns(columns, n, "motor_speed", "f32", offsetof(Motor_Tick_Record, motor_speed), 4, 4);
+    n = add_columns(columns, n, "servo_out", "u16", offsetof(Motor_Tick_Record, servo_out), 2, 4);
+    n = add_columns(columns, n, "flags", "u32", offsetof(Motor_Tick_Record, flags), 4, 1);
+    n = add_columns(columns, n, "params_version", "u32", offsetof(Motor_Tick_Record, params_version), 4, 1);
+    return n;
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    bool csv = false;
+    const char* dir = NULL;
+    const char* path = NULL;
+    
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (strcmp(argv[i], "--columns") == 0 && i+1 < argc) dir = argv[++i];
+        else path = argv[i];
+    }
+    
+    if (path == NULL){
+        fprintf(stderr, "Usage : %s [--csv | --columns dir] file\n", argv[0]);
+        return 1;
+    }
+    
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0){
+        perror(path);
+        return 1;
+    }
+    if ((size_t)st.st_size < MOTOR_RECORDER_HEADER_SIZE){
+        fprintf(stderr, "%s : not a flight recorder file\n", path);
+        return 1;
+    }
+    void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED){
+        perror("mmap");
+        return 1;
+    }
+    
+    const Motor_Recorder_Header* header = (const Motor_Recorder_Header*)ptr;
+    const Motor_Tick_Record* records = (const Motor_Tick_Record*)((const char*)ptr + MOTOR_RECORDER_HEADER_SIZE);
+    
+    if (memcmp(header->magic, MOTOR_RECORDER_MAGIC, 4) != 0){
+        fprintf(stderr, "%s : not a flight recorder file\n", path);
+        return 1;
+    }
+    if (header->version != MOTOR_RECORDER_FORMAT_VERSION || header->record_size != sizeof(Motor_Tick_Record)
+        || MOTOR_RECORDER_HEADER_SIZE + (size_t)header->capacity*sizeof(Motor_Tick_Record) > (size_t)st.st_size){
+        fprintf(stderr, "%s : unsupported format version %u (record size %u)\n", path, header->version, header->record_size);
+        return 1;
+    }
+    
+    // The ring holds the last capacity ticks. After a crash the header head may lag the last record by one
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    const Motor_Tick_Record& after = records[head % header->capacity];
+    if (after.sequence == head+1) head++;
+    uint64_t first = (head > header->capacity ? head - header->capacity + 1 : 1);
+    
+    Column columns[32];
+    unsigned int nb_columns = build_columns(columns);
+    
+    if (dir != NULL){
+        mkdir(dir, 0775);
+        char file_path[512];
+        snprintf(file_path, sizeof(file_path), "%s/schema.txt", dir);
+        FILE* schema = fopen(file_path, "w");
+        if (schema == NULL){
+            perror(file_path);
+            return 1;
+        }
+        fprintf(schema, "# flight recorder pid %u, period %u us, little-endian arrays\n", header->pid, header->period_us);
+        for (unsigned int c=0; c<nb_columns; c++){
+            snprintf(file_path, sizeof(file_path), "%s/%s.%s", dir, columns[c].name, columns[c].type);
+            columns[c].file = fopen(file_path, "wb");
+            if (columns[c].file == NULL){
+                perror(file_path);
+                return 1;
+            }
+            fprintf(schema, "%s %s\n", columns[c].name, columns[c].type);
+        }
+        fclose(schema);
+    }
+    
+    if (csv){
+        printf("sequence,timestamp_ns,u1,u2,u3,u4,square_speed0,square_speed1,square_speed2,square_speed3,"
+               "motor_speed0,motor_speed1,motor_speed2,motor_speed3,servo_out0,servo_out1,servo_out2,servo_out3,flags,params_version\n");
+    }
+    
+    uint64_t count = 0;
+    uint64_t missing = 0; // empty or torn slots
+    uint64_t failed = 0;
+    uint64_t saturated[4] = {0, 0, 0, 0}; // ticks with a flag, per motor
+    uint64_t first_timestamp = 0;
+    uint64_t last_timestamp = 0;
+    
+    for (uint64_t seq=first; seq<=head; seq++){
+        
+        const Motor_Tick_Record& record = records[(seq-1) % header->capacity];
+        if (record.sequence != seq){
+            missing++;
+            continue;
+        }
+        
+        if (count == 0) first_timestamp = record.timestamp;
+        last_timestamp = record.timestamp;
+        count++;
+        if (record.flags & Motor_Tick_Record::flag_tick_failed) failed++;
+        for (int i=0; i<4; i++){
+            if ((record.flags >> 4*i) & 0xF) saturated[i]++;
+        }
+        
+        if (csv){
+            printf("%llu,%llu,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%u,%u,%u,%u,0x%x,%u\n",
+                   (unsigned long long)record.sequence, (unsigned long long)record.timestamp,
+                   record.command[0], record.command[1], record.command[2], record.command[3],
+                   record.square_speed[0], record.square_speed[1], record.square_speed[2], record.square_speed[3],
+                   record.motor_speed[0], record.motor_speed[1], record.motor_speed[2], record.motor_speed[3],
+                   record.servo_out[0], record.servo_out[1], record.servo_out[2], record.servo_out[3],
+                   record.flags, record.params_version);
+        }
+        
+        if (dir != NULL){
+            for (unsigned int c=0; c<nb_columns; c++){
+                fwrite((const char*)&record + columns[c].offset, columns[c].size, 1, columns[c].file);
+            }
+        }
+    }
+    
+    if (dir != NULL){
+        for (unsigned int c=0; c<nb_columns; c++){
+            fclose(columns[c].file);
+        }
+    }
+    
+    fprintf(stderr, "%s : pid %u, period %u us, capacity %u\n", path, header->pid, header->period_us, header->capacity);
+    fprintf(stderr, "%llu ticks (sequence %llu..%llu), %llu missing, %llu failed, span %.3f s\n",
+            (unsigned long long)count, (unsigned long long)first, (unsigned long long)head,
+            (unsigned long long)missing, (unsigned long long)failed, (last_timestamp-first_timestamp)*1e-9);
+    fprintf(stderr, "saturated ticks per motor : %llu %llu %llu %llu\n",
+            (unsigned long long)saturated[0], (unsigned long long)saturated[1],
+            (unsigned long long)saturated[2], (unsigned long long)saturated[3]);
+    
+    munmap(ptr, st.st_size);
+    return 0;
+}
@@ -0,0 +1,162 @@
+//
+//  maestro_emulator.cpp
+//  MaestroMotor
+//
+//  Pololu Maestro emulated on a pseudo-terminal, for testing the output path without
+//  hardware. Compact protocol : Set Target (0x84), Get Position (0x90), Get Errors (0xA1,
+//  clears them). Other command bytes set the serial protocol error bit, as the device does.
+//  Faults can be injected to exercise Servo_Readback :
+//    --offset us   : positions read back are off by us
+//    --drop n      : every n-th query gets no response
+//    --error bits  : error bits reported by the first Get Errors
+//  The slave path is printed on stdout ; point SERVO_PORT (or a Serial) to it.
+//  Usage : maestro_emulator [--offset us] [--drop n] [--error bits] [seconds]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+
+// Error bits (Maestro user's guide)
+#define MAESTRO_ERROR_SERIAL_PROTOCOL (1 << 4)
+
+#define NB_SERVOS 24
+
+
+static volatile bool running = true;
+
+static void on_signal(int){
+    running = false;
+}
+
+
+struct Emulator {
+    uint16_t target[NB_SERVOS]; // quarters of us
+    uint16_t errors;
+    int offset; // us
+    unsigned int drop;
+    
+    uint8_t command[4];
+    unsigned int length; // bytes of the command received so far
+    
+    unsigned long targets;
+    unsigned long queries;
+    unsigned long dropped;
+};
+
+
+static void respond(int fd, Emulator& emulator, uint16_t value){
+    emulator.queries++;
+    if (emulator.drop > 0 && emulator.queries % emulator.drop == 0){
+        emulator.dropped++;
+        return;
+    }
+    uint8_t response[2] = {(uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+    if (write(fd, response, 2) != 2) return;
+}
+
+
+static void receive(int fd, Emulator& emulator, uint8_t byte){
+    
+    // A command byte starts a new command, data bytes have bit 7 clear
+    if (byte & 0x80){
+        if (emulator.length > 0) emulator.errors |= MAESTRO_ERROR_SERIAL_PROTOCOL; // previous one incomplete
+        emulator.length = 0;
+    }
+    else if (emulator.length == 0){
+        emulator.errors |= MAESTRO_ERROR_SERIAL_PROTOCOL;
+        return;
+    }
+    emulator.command[emulator.length++] = byte;
+    
+    switch (emulator.command[0]) {
+        case 0x84 : { // Set Target : channel, low 7 bits, high 7 bits
+            if (emulator.length < 4) return;
+            uint8_t channel = emulator.command[1];
+            if (channel < NB_SERVOS) emulator.target[channel] = emulator.command[2] | (emulator.command[3] << 7);
+            emulator.targets++;
+            break;
+        }
+        case 0x90 : { // Get Position : channel
+            if (emulator.length < 2) return;
+            uint8_t channel = emulator.command[1];
+            int position = (channel < NB_SERVOS ? emulator.target[channel] : 0) + 4*emulator.offset;
+            respond(fd, emulator, position > 0 ? position : 0);
+            break;
+        }
+        case 0xA1 : { // Get Errors
+            respond(fd, emulator, emulator.errors);
+            emulator.errors = 0;
+            break;
+        }
+        default :
+            emulator.errors |= MAESTRO_ERROR_SERIAL_PROTOCOL;
+    }
+    emulator.length = 0;
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    Emulator emulator;
+    memset(&emulator, 0, sizeof(emulator));
+    unsigned int seconds = 0;
+    
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "--offset") == 0 && i+1 < argc) emulator.offset = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--drop") == 0 && i+1 < argc) emulator.drop = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--error") == 0 && i+1 < argc) emulator.errors = strtol(argv[++i], NULL, 0);
+        else seconds = atoi(argv[i]);
+    }
+    
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0){
+        perror("posix_openpt");
+        return 1;
+    }
+    
+    // Raw on our side of the line ; keeping the slave open avoids EIO between clients
+    const char* slave_path = ptsname(master);
+    int slave = open(slave_path, O_RDWR | O_NOCTTY);
+    struct termios options;
+    tcgetattr(slave, &options);
+    cfmakeraw(&options);
+    tcsetattr(slave, TCSANOW, &options);
+    
+    printf("%s\n", slave_path);
+    fflush(stdout);
+    
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    time_t end = (seconds > 0 ? time(NULL) + seconds : 0);
+    
+    uint8_t buffer[256];
+    struct pollfd fd;
+    fd.fd = master;
+    fd.events = POLLIN;
+    
+    while (running && (end == 0 || time(NULL) < end)){
+        if (poll(&fd, 1, 100) <= 0) continue;
+        ssize_t length = read(master, buffer, sizeof(buffer));
+        if (length <= 0) continue;
+        for (ssize_t b=0; b<length; b++){
+            receive(master, emulator, buffer[b]);
+        }
+    }
+    
+    fprintf(stderr, "%lu targets, %lu queries (%lu dropped), pending errors 0x%x\n",
+            emulator.targets, emulator.queries, emulator.dropped, emulator.errors);
+    close(slave);
+    close(master);
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+//  maestro_footprint.cpp
+//  MaestroMotor
+//
+//  Memory footprint of the motor stack : runs headless ticks (see Motor_Sim.hpp) and
+//  reports the text/data/bss of the binary, the heap in use and the peak RSS.
+//  Build it once per profile (see Maestro_Profile.hpp) and compare, e.g. :
+//    default  : g++ -O2 ...
+//    embedded : g++ -Os -DMAESTRO_EMBEDDED -fno-exceptions -fno-rtti -ffunction-sections -Wl,--gc-sections ...
+//  Usage : maestro_footprint [ticks]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "../Motor_Sim.hpp"
+#include "../navi_State.hpp"
+
+
+// Segment bounds set by the linker
+extern char __executable_start;
+extern char etext;
+extern char edata;
+extern char __bss_start;
+extern char end;
+
+
+
+// Peak resident set, from the kernel (ru_maxrss would include the RSS of the process before exec)
+static long peak_rss(){
+    char line[128];
+    long kb = -1;
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status == NULL) return -1;
+    while (fgets(line, sizeof(line), status) != NULL){
+        if (strncmp(line, "VmHWM:", 6) == 0) kb = atol(line+6);
+    }
+    fclose(status);
+    return kb*1024;
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int ticks = (argc > 1 ? atoi(argv[1]) : 100000);
+    
+    Sim_Scenario scenario = Motor_Sim::defaultScenario();
+    scenario.ticks = ticks;
+    scenario.step_tick = ticks/2;
+    Sim_Result result = Motor_Sim::run(scenario);
+    
+    navi_State state;
+    state._update("#R,120,-40,310,0,4,-2,11,12,-3,85");
+    
+    struct mallinfo2 heap = mallinfo2();
+    long rss = peak_rss();
+    
+#ifdef MAESTRO_EMBEDDED
+    const char* profile = "embedded";
+#else
+    const char* profile = "default";
+#endif
+    
+    printf("profile %s, %u ticks (%llu bytes out), navi z %d\n", profile, ticks, (unsigned long long)result.bytes_out, state.get_Z());
+    printf("%-12s %10s\n", "segment", "bytes");
+    printf("%-12s %10lu\n", "text", (unsigned long)(&etext - &__executable_start));
+    printf("%-12s %10lu\n", "rodata+data", (unsigned long)(&edata - &etext));
+    printf("%-12s %10lu\n", "bss", (unsigned long)(&end - &__bss_start));
+    printf("%-12s %10lu\n", "heap", (unsigned long)heap.uordblks);
+    printf("%-12s %10lu\n", "MaestroMotor", (unsigned long)sizeof(MaestroMotor));
+    printf("%-12s %10ld\n", "peak rss", rss);
+    return 0;
+}
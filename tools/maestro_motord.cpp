@@ -0,0 +1,129 @@
+//
+//  maestro_motord.cpp
+//  MaestroMotor
+//
+//  Standalone motor daemon : owns MaestroMotor and the servo port, takes its
+//  commands from the shared segment (see Motor_Shm.hpp) written by the autopilot.
+//  A crash of the autopilot leaves the motors under control of this process : its commands
+//  go through the command mux as source_autopilot, so they expire with its lease.
+//  Limits and coefficients can be read from a parameters file (see Motor_Params::load,
+//  written by motor_identify).
+//  Usage : maestro_motord [time_rate_ms] [params_file]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <atomic>
+#include "../MaestroMotor.hpp"
+#include "../Motor_Shm.hpp"
+
+
+
+static std::atomic<bool> stop_requested(false);
+
+static void on_signal(int){
+    stop_requested.store(true);
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    // A 0 period would be a 0 dt in the acceleration limits : the rate is checked, not wrapped
+    long rate = MIN_TIME_RATE;
+    if (argc > 1){
+        char* end;
+        rate = strtol(argv[1], &end, 10);
+        if (*argv[1] == '\0' || *end != '\0' || rate < MIN_TIME_RATE || rate > 255){
+            fprintf(stderr, "Usage : %s [time_rate_ms] [params_file]\n", argv[0]);
+            fprintf(stderr, "time_rate_ms : %d to 255\n", MIN_TIME_RATE);
+            return 1;
+        }
+    }
+    uint8_t time_rate = (uint8_t)rate;
+    
+    Motor_Params params = Motor_Params::fromConfig();
+    if (argc > 2 && !params.load(argv[2])){
+        fprintf(stderr, "Couldn't read the parameters in %s\n", argv[2]);
+        return 1;
+    }
+    
+    Motor_Shm shm(Motor_Shm::daemon);
+    if (!shm.open()){
+        fprintf(stderr, "Couldn't map %s\n", MOTOR_SHM_NAME);
+        return 1;
+    }
+    
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    
+    MaestroMotor maestro(time_rate);
+    if (argc > 2) maestro.publishParams(params);
+    if (!maestro.getMetrics()->open()) fprintf(stderr, "Couldn't map %s, metrics not exported\n", MOTOR_METRICS_NAME);
+    
+    Motor_Event_Drainer drainer;
+    drainer.attach(maestro.getEventLog());
+    drainer.start();
+    
+    float received[4] = {0, 0, 0, 0};
+    bool shutdown = false;
+    bool fresh = false; // a command was taken since the last tick
+    uint64_t timestamp = 0;
+    uint64_t stale = 0;
+    Motor_Command_Mux* mux = maestro.getCommandMux();
+    Eigen::Vector4f command(0, 0, 0, 0);
+    Motor_Status status;
+    memset(&status, 0, sizeof(status));
+    
+    // Ticks on the period clock only, with the command the mux selects : the last autopilot
+    // one while its lease runs (the acceleration limits keep ramping towards it, their dt is
+    // the period), zero or a higher-priority source after. New commands in between replace it
+    uint64_t next_tick = Motor_Event_Log::now();
+    while (!stop_requested.load()){
+        
+        uint64_t now = Motor_Event_Log::now();
+        if (now < next_tick){
+            if (!shm.waitCommand(received, shutdown, (next_tick-now)/1000)) continue;
+            if (shutdown) break;
+            
+            // Left in the segment long ago (e.g. by the autopilot before our restart) : not applied
+            if (Motor_Event_Log::now() - shm.getCommandTimestamp() > (uint64_t)COMMAND_MAX_AGE*1000){
+                stale++;
+                continue;
+            }
+            // The lease runs from the write, not from our pickup
+            timestamp = shm.getCommandTimestamp();
+            mux->publish(Motor_Command_Mux::source_autopilot, Eigen::Vector4f(received[0], received[1], received[2], received[3]), timestamp/1000);
+            fresh = true;
+            continue;
+        }
+        
+        mux->select(command); // highest-priority live source, zero without any
+        maestro.tick(command);
+        
+        // Late by more than a period : start over rather than tick in a burst
+        next_tick += 1000ULL*maestro.getPeriod();
+        now = Motor_Event_Log::now();
+        if (next_tick < now) next_tick = now + 1000ULL*maestro.getPeriod();
+        
+        if (fresh) status.command_latency = now - timestamp;
+        fresh = false;
+        status.ticks++;
+        Eigen::Vector4f speed = maestro.getMotorSpeed();
+        for (int i=0; i<4; i++){
+            status.motor_speed[i] = speed[i];
+        }
+        maestro.getServoOut(status.servo_out);
+        shm.writeStatus(status);
+    }
+    
+    if (stale > 0) fprintf(stderr, "%llu stale commands dropped\n", (unsigned long long)stale);
+    maestro.setPositionToZero();
+    shm.writeStatus(status);
+    drainer.stop();
+    
+    return 0;
+}
@@ -0,0 +1,86 @@
+//
+//  maestro_sim.cpp
+//  MaestroMotor
+//
+//  Headless Monte-Carlo sweep of the motor parameters (see Motor_Sim.hpp).
+//  Sweeps the maximum acceleration and the maximum PWM around Config.hpp with random
+//  noise on the command, and reports saturations and settling time after a thrust step.
+//  The same batch is run with 1..threads workers to measure the scaling.
+//  Usage : maestro_sim [scenarios] [threads]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <time.h>
+#include "../Motor_Sim.hpp"
+#include "../Work_Pool.hpp"
+
+
+
+static double now_s(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int count = (argc > 1 ? atoi(argv[1]) : 256);
+    unsigned int threads = (argc > 2 ? atoi(argv[2]) : Work_Pool(0).getWorkers());
+    if (count == 0) count = 1;
+    if (threads == 0) threads = 1;
+    
+    // Scenarios : acceleration limit in [0.5, 1.5] x Config, speed mapped to the PWM ceiling in [0.8, 1.2] x Config, noise up to 10% of hover
+    std::vector<Sim_Scenario> scenarios(count);
+    std::vector<Sim_Result> results(count);
+    uint32_t random = 0x2545F491;
+    
+    for (unsigned int i=0; i<count; i++){
+        Sim_Scenario& scenario = scenarios[i];
+        scenario = Motor_Sim::defaultScenario();
+        
+        random = random*1664525 + 1013904223;
+        float a = (random >> 8) / (float)(1 << 24);
+        random = random*1664525 + 1013904223;
+        float b = (random >> 8) / (float)(1 << 24);
+        
+        scenario.params.max_motor_acceleration *= 0.5f + a;
+        scenario.params.servo_max_real *= 0.8f + 0.4f*b;
+        scenario.noise[0] = 0.1f*scenario.hover[0]*b;
+        scenario.seed = i+1;
+    }
+    
+    printf("%u scenarios of %u ticks\n\n", count, scenarios[0].ticks);
+    printf("%-8s %10s %14s %10s\n", "workers", "time (s)", "scenarios/s", "speedup");
+    
+    double reference = 0;
+    Sim_Summary summary;
+    for (unsigned int workers=1; workers<=threads; workers++){
+        double start = now_s();
+        summary = Motor_Sim::runAll(&scenarios[0], &results[0], count, workers);
+        double elapsed = now_s() - start;
+        if (workers == 1) reference = elapsed;
+        printf("%-8u %10.3f %14.1f %9.2fx\n", workers, elapsed, count/elapsed, reference/elapsed);
+    }
+    
+    printf("\nsaturations : speed_low %llu   speed_high %llu   acceleration %llu\n",
+           (unsigned long long)summary.saturations[Motor_Metrics_Data::saturation_speed_low],
+           (unsigned long long)summary.saturations[Motor_Metrics_Data::saturation_speed_high],
+           (unsigned long long)summary.saturations[Motor_Metrics_Data::saturation_acceleration]);
+    printf("settling : mean %.1f ticks   max %u ticks   unsettled %u/%u\n",
+           summary.mean_settle_ticks, summary.max_settle_ticks, summary.unsettled, summary.scenarios);
+    printf("max speed %.1f rd/s   max pwm %u us\n", summary.max_speed, summary.max_servo_out);
+    
+    // Slowest to settle
+    unsigned int worst = 0;
+    for (unsigned int i=1; i<count; i++){
+        if (results[i].settle_ticks > results[worst].settle_ticks) worst = i;
+    }
+    printf("slowest : #%u  max_acceleration %.1f  servo_max_real %.1f  settle %u ticks\n", worst,
+           scenarios[worst].params.max_motor_acceleration, scenarios[worst].params.servo_max_real, results[worst].settle_ticks);
+    return 0;
+}
@@ -0,0 +1,224 @@
+//
+//  maestro_soak.cpp
+//  MaestroMotor
+//
+//  Soak test : ticks a headless MaestroMotor (virtual clock, memory output) for hours of
+//  simulated time with commands that go through every saturation, parameters published and
+//  rolled back every simulated minute, and the event log drained as the drainer would.
+//  malloc and friends are interposed to count the allocations of every tick ; after the
+//  warm-up, a single allocation in a tick fails the run. The RSS is sampled every simulated
+//  10 minutes and fails the run too if it grows past the sample 10 minutes into the steady
+//  state (by then every code path has been faulted in : publish, rollback, saturations).
+//  Ends with the per-motor statistics of the run (Motor_Stats).
+//  Usage : maestro_soak [hours] [warmup_s] [recorder_file]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include "../Motor_Sim.hpp"
+
+
+
+// Interposed allocator : glibc entry points, counted
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+}
+
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> frees(0);
+
+extern "C" void* malloc(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size){
+    return memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size){
+    *ptr = memalign(alignment, size);
+    return (*ptr == NULL ? 12 /* ENOMEM */ : 0);
+}
+
+extern "C" void free(void* ptr){
+    if (ptr != NULL) frees.fetch_add(1, std::memory_order_relaxed);
+    __libc_free(ptr);
+}
+
+
+
+// Resident set in bytes, read without allocating (fopen would)
+static long rss(){
+    char buffer[128];
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t length = read(fd, buffer, sizeof(buffer)-1);
+    close(fd);
+    if (length <= 0) return -1;
+    buffer[length] = '\0';
+    long pages = 0;
+    const char* p = buffer;
+    while (*p != ' ' && *p != '\0') p++; // size, then resident
+    pages = atol(p);
+    return pages*sysconf(_SC_PAGESIZE);
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    double hours = (argc > 1 ? atof(argv[1]) : 2);
+    unsigned int warmup_s = (argc > 2 ? atoi(argv[2]) : 10);
+    const char* recorder_path = (argc > 3 ? argv[3] : NULL);
+    
+    const uint64_t SAMPLE_US = 600*1000000ULL; // RSS every 10 simulated minutes
+    const long RSS_TOLERANCE = 256*1024; // stack and allocator noise
+    
+    Motor_Virtual_Clock clock;
+    Motor_Memory_Output output;
+    MaestroMotor maestro(1, &output, &clock);
+    if (recorder_path != NULL && !maestro.getRecorder()->open(recorder_path, 1 << 16, maestro.getPeriod())){
+        fprintf(stderr, "Couldn't map %s\n", recorder_path);
+        return 1;
+    }
+    
+    Motor_Params params = maestro.getParams();
+    Motor_Params tuned = params;
+    tuned.max_motor_acceleration *= 0.8f;
+    
+    const uint64_t duration = (uint64_t)(hours*3600e6);
+    const uint64_t warmup = warmup_s*1000000ULL;
+    const float hover = 4*thrust_factor*(MAX_MOTOR_SPEED/2)*(MAX_MOTOR_SPEED/2);
+    Eigen::Vector4f command(hover, 0, 0, 0);
+    Motor_Event events[64];
+    
+    uint64_t ticks = 0;
+    uint64_t warmup_allocations = 0;
+    uint64_t max_tick_allocations = 0;
+    uint64_t failed_ticks = 0; // with an allocation after the warm-up
+    uint64_t failed_allocations = 0;
+    uint64_t first_failure = 0; // simulated us
+    uint64_t popped = 0;
+    uint64_t next_sample = warmup;
+    long steady_rss = -1;
+    long max_rss = 0;
+    
+    printf("soak : %.2f h simulated, warm-up %u s, period %u us%s\n", hours, warmup_s, maestro.getPeriod(),
+           recorder_path != NULL ? ", flight recorder on" : "");
+    printf("%10s %12s %12s %14s\n", "time (min)", "ticks", "rss (kB)", "allocations");
+    fflush(stdout);
+    
+    while (clock.now() < duration){
+        
+        uint64_t now = clock.now();
+        
+        // Hover with a slow roll/pitch wave, a full-throttle step every 7 s (speed_high,
+        // acceleration) and a cut every 11 s (speed_low)
+        float phase = now*1e-6f;
+        command[0] = hover;
+        if ((now/1000000) % 7 == 0) command[0] = 4*hover;
+        if ((now/1000000) % 11 == 0) command[0] = -hover;
+        command[1] = 0.02f*sinf(0.5f*phase);
+        command[2] = 0.02f*cosf(0.3f*phase);
+        command[3] = 0.005f*sinf(0.1f*phase);
+        
+        // Tuning thread : publish, then roll back a minute later
+        if (ticks > 0 && now % 60000000 < maestro.getPeriod()){
+            if ((now/60000000) % 2) maestro.publishParams(tuned);
+            else maestro.rollbackParams();
+        }
+        
+        uint64_t before = allocations.load(std::memory_order_relaxed);
+        maestro.tick(command);
+        uint64_t count = allocations.load(std::memory_order_relaxed) - before;
+        ticks++;
+        
+        if (now < warmup){
+            warmup_allocations += count;
+            if (count > max_tick_allocations) max_tick_allocations = count;
+        }
+        else if (count > 0){
+            if (failed_ticks == 0) first_failure = now;
+            failed_ticks++;
+            failed_allocations += count;
+        }
+        
+        // Drainer side
+        if (ticks % 10 == 0) popped += maestro.getEventLog()->pop(events, 64);
+        
+        if (now >= next_sample){
+            long resident = rss();
+            if (now >= warmup + SAMPLE_US){
+                if (steady_rss < 0) steady_rss = resident;
+                if (resident > max_rss) max_rss = resident;
+            }
+            printf("%10.0f %12llu %12ld %14llu\n", now/60e6, (unsigned long long)ticks, resident/1024,
+                   (unsigned long long)allocations.load());
+            fflush(stdout);
+            next_sample += SAMPLE_US;
+        }
+        
+        clock.sleep(maestro.getPeriod());
+    }
+    
+    long resident = rss();
+    if (steady_rss >= 0 && resident > max_rss) max_rss = resident;
+    bool leaked = (steady_rss >= 0 && max_rss > steady_rss + RSS_TOLERANCE);
+    
+    printf("\n%llu ticks, %llu events drained (%u dropped by the log)\n", (unsigned long long)ticks,
+           (unsigned long long)popped, maestro.getEventLog()->getDropped());
+    printf("warm-up : %llu allocations, at most %llu in a tick\n", (unsigned long long)warmup_allocations,
+           (unsigned long long)max_tick_allocations);
+    printf("steady state : %llu ticks with allocations (%llu allocations", (unsigned long long)failed_ticks,
+           (unsigned long long)failed_allocations);
+    if (failed_ticks > 0) printf(", first at %.3f s", first_failure*1e-6);
+    printf(")\n");
+    if (steady_rss >= 0) printf("rss : %ld kB in steady state, %ld kB at most, %ld kB at the end\n", steady_rss/1024, max_rss/1024, resident/1024);
+    else printf("rss : %ld kB at the end, run too short to check its growth\n", resident/1024);
+    printf("malloc %llu, free %llu\n", (unsigned long long)allocations.load(), (unsigned long long)frees.load());
+    
+    Motor_Stats_Snapshot stats;
+    maestro.getStats()->getSnapshot(stats);
+    printf("\n%-6s %9s %8s %8s %8s %8s %10s %8s %10s\n", "motor", "pwm mean", "stddev", "p5", "p50", "p99",
+           "imbalance", "duty %", "accel");
+    for (int i=0; i<4; i++){
+        const Motor_Stats_Motor& motor = stats.motors[i];
+        printf("%-6d %9.1f %8.1f %8.1f %8.1f %8.1f %10.2f %8.2f %10llu\n", i, motor.pwm_mean, motor.pwm_stddev, motor.pwm_p5,
+               motor.pwm_p50, motor.pwm_p99, motor.imbalance, 100*motor.duty_cycle,
+               (unsigned long long)motor.saturations[Motor_Stats_Motor::acceleration]);
+    }
+    
+    if (failed_ticks > 0 || leaked){
+        printf("FAIL%s%s\n", failed_ticks > 0 ? " : allocations on the hot path" : "", leaked ? " : rss growing" : "");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
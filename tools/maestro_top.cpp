@@ -0,0 +1,95 @@
+//
+//  maestro_top.cpp
+//  MaestroMotor
+//
+//  Live view of the metrics page published by MaestroMotor (see Motor_Metrics.hpp).
+//  The page is mapped read-only and polled : the motor thread is never disturbed.
+//  Usage : maestro_top [refresh_ms] [--once]
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../Motor_Metrics.hpp"
+
+
+
+static void print_page(const Motor_Metrics_Data& data, double tick_rate, bool stale){
+    
+    const char* stages[] = {"update", "output", "tick"};
+    
+    printf("MaestroMotor pid %u   period %u us   %.1f ticks/s\n", data.pid, data.period_us, tick_rate);
+    if (stale) printf("STALE : page left half-written, the motor process died while publishing\n");
+    printf("ticks %llu   overruns %llu   serial write errors %llu\n\n",
+           (unsigned long long)data.ticks, (unsigned long long)data.overruns, (unsigned long long)data.serial_write_errors);
+    
+    printf("%-8s %10s %10s %10s %10s   (us)\n", "stage", "p50", "p90", "p99", "max");
+    for (int i=0; i<Motor_Metrics_Data::NB_STAGES; i++){
+        printf("%-8s %10.2f %10.2f %10.2f %10.2f\n", stages[i],
+               data.p50[i]/1000., data.p90[i]/1000., data.p99[i]/1000., data.max[i]/1000.);
+    }
+    
+    printf("\n%-6s %8s %12s %12s %12s\n", "motor", "pwm", "speed_low", "speed_high", "accel");
+    for (int i=0; i<4; i++){
+        printf("%-6d %6u us %12llu %12llu %12llu\n", i, data.servo_out[i],
+               (unsigned long long)data.saturations[i][Motor_Metrics_Data::saturation_speed_low],
+               (unsigned long long)data.saturations[i][Motor_Metrics_Data::saturation_speed_high],
+               (unsigned long long)data.saturations[i][Motor_Metrics_Data::saturation_acceleration]);
+    }
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int refresh_ms = 500;
+    bool once = false;
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "--once") == 0) once = true;
+        else refresh_ms = atoi(argv[i]);
+    }
+    
+    int fd = shm_open(MOTOR_METRICS_NAME, O_RDONLY, 0);
+    if (fd < 0){
+        fprintf(stderr, "No metrics page %s : is MaestroMotor running with metrics open ?\n", MOTOR_METRICS_NAME);
+        return 1;
+    }
+    void* ptr = mmap(NULL, sizeof(Motor_Metrics_Page), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED){
+        perror("mmap");
+        return 1;
+    }
+    const Motor_Metrics_Page* page = (const Motor_Metrics_Page*)ptr;
+    if (page->magic != MOTOR_METRICS_MAGIC || page->version != MOTOR_METRICS_VERSION){
+        fprintf(stderr, "Unsupported metrics page\n");
+        return 1;
+    }
+    
+    Motor_Metrics_Data data, previous;
+    memset(&previous, 0, sizeof(previous));
+    Motor_Metrics::read(page, previous);
+    
+    while (true){
+        if (!once) usleep(1000*refresh_ms);
+        data = previous;
+        bool stale = !Motor_Metrics::read(page, data);
+        
+        double elapsed = (data.timestamp - previous.timestamp)/1e9;
+        double tick_rate = (elapsed > 0 ? (data.ticks - previous.ticks)/elapsed : 0);
+        
+        if (!once) printf("\033[H\033[2J"); // clear screen
+        print_page(data, tick_rate, stale);
+        fflush(stdout);
+        
+        if (once) break;
+        previous = data;
+    }
+    
+    munmap(ptr, sizeof(Motor_Metrics_Page));
+    return 0;
+}
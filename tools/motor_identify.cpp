@@ -0,0 +1,476 @@
+//
+//  motor_identify.cpp
+//  MaestroMotor
+//
+//  Fits the motor coefficients to recorded thrust-stand or flight logs : the thrust and drag
+//  factors (thrust = thrust_coef.w², torque = drag_coef.w²) and the PWM -> speed line of each
+//  motor, then writes them as a parameters file for Motor_Params::load (maestro_motord).
+//  Logs are CSV with a header naming the columns : motor (0..3), pwm (us), speed (rd/s) or
+//  rpm, thrust (N), torque (N.m), in any order, others ignored. Each fit uses the rows that
+//  have its columns, so a flight log with only pwm and speed still feeds the PWM curves.
+//  The files are mapped and cut into chunks on line boundaries ; the workers reduce every
+//  chunk to the sums of its normal equations, added up in chunk order afterwards (the same
+//  result whatever the number of workers). A second pass drops the samples more than
+//  3 sigma off the first fit : the transients of a stand after a PWM step.
+//  Usage : motor_identify [-j workers] [-o params_file] log...
+//
+//  Copyright © 2016 Navi. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "../Motor_Params.hpp"
+#include "../Work_Pool.hpp"
+
+
+
+enum COLUMN { col_motor, col_pwm, col_speed, col_rpm, col_thrust, col_torque, COL_COUNT };
+static const char* COLUMN_NAMES[COL_COUNT] = {"motor", "pwm", "speed", "rpm", "thrust", "torque"};
+
+enum { MOTORS = 4, SLOTS = MOTORS+1 }; // last slot : rows without a motor column
+enum { MAX_FIELDS = 64, CHUNK_SIZE = 4 << 20 };
+
+static const double REJECT_SIGMAS = 3;
+static const double MIN_SPEED = 0.05*MAX_MOTOR_SPEED; // below, the motor may sit in the ESC dead band
+
+
+
+/**
+ * One mapped log : where its columns are
+ */
+struct Log_File {
+    const char* path;
+    const char* data;
+    size_t size;
+    size_t body; // offset of the first row
+    int fields[MAX_FIELDS]; // COLUMN of each field, -1 : ignored
+    unsigned int nb_fields;
+};
+
+
+struct Chunk {
+    unsigned int file;
+    size_t begin; // rows starting in [begin, end)
+    size_t end;
+};
+
+
+/**
+ * Sums of the normal equations of one motor
+ * PWM line : speed = a + b.x, x = pwm - SERVO_VAL_MIN (keeps the sums small)
+ * Thrust and torque : y = k.w², through the origin
+ */
+struct Fit_Sums {
+    uint64_t n_pwm;
+    double x, xx, y, yy, xy;
+    uint64_t n_thrust;
+    double thrust_xx, thrust_xy, thrust_yy;
+    uint64_t n_torque;
+    double torque_xx, torque_xy, torque_yy;
+    uint64_t rejected;
+    
+    void add(const Fit_Sums& other){
+        n_pwm += other.n_pwm; x += other.x; xx += other.xx; y += other.y; yy += other.yy; xy += other.xy;
+        n_thrust += other.n_thrust; thrust_xx += other.thrust_xx; thrust_xy += other.thrust_xy; thrust_yy += other.thrust_yy;
+        n_torque += other.n_torque; torque_xx += other.torque_xx; torque_xy += other.torque_xy; torque_yy += other.torque_yy;
+        rejected += other.rejected;
+    }
+};
+
+
+struct Fit {
+    bool pwm_valid;
+    double pwm_zero; // us, PWM of zero speed
+    double slope; // rd/s per us
+    double pwm_sigma; // rd/s
+    bool thrust_valid;
+    double thrust_coef;
+    double thrust_sigma; // N
+    bool torque_valid;
+    double drag_coef;
+    double torque_sigma; // N.m
+};
+
+
+struct Identify_Context {
+    std::vector<Log_File>* files;
+    std::vector<Chunk>* chunks;
+    std::vector<Fit_Sums>* sums; // SLOTS per chunk
+    const Fit* fits; // SLOTS, NULL on the first pass
+    std::vector<uint64_t>* rows; // per chunk
+};
+
+
+
+/**
+ * Number parser bounded by the mapping (strtod could read past the last row)
+ * Stops at the separator ; false for an empty or malformed field
+ */
+static bool parse_number(const char*& p, const char* end, double& value){
+    
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    bool negative = (p < end && *p == '-');
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    
+    double mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+    while (p < end && *p >= '0' && *p <= '9'){
+        mantissa = 10*mantissa + (*p++ - '0');
+        digits = true;
+    }
+    if (p < end && *p == '.'){
+        p++;
+        while (p < end && *p >= '0' && *p <= '9'){
+            mantissa = 10*mantissa + (*p++ - '0');
+            exponent--;
+            digits = true;
+        }
+    }
+    if (digits && p < end && (*p == 'e' || *p == 'E')){
+        const char* mark = p++;
+        bool negative_exponent = (p < end && *p == '-');
+        if (p < end && (*p == '-' || *p == '+')) p++;
+        int e = 0;
+        bool exponent_digits = false;
+        while (p < end && *p >= '0' && *p <= '9'){
+            e = (e < 10000 ? 10*e + (*p - '0') : e);
+            p++;
+            exponent_digits = true;
+        }
+        if (exponent_digits) exponent += (negative_exponent ? -e : e);
+        else p = mark;
+    }
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    
+    bool valid = digits && (p == end || *p == ',' || *p == '\n');
+    while (p < end && *p != ',' && *p != '\n') p++;
+    if (!valid) return false;
+    
+    value = (exponent == 0 ? mantissa : mantissa*pow(10., exponent));
+    if (negative) value = -value;
+    return true;
+}
+
+
+static void accumulate(const Log_File& file, const Chunk& chunk, Fit_Sums* sums, const Fit* fits, uint64_t& rows){
+    
+    const char* p = file.data + chunk.begin;
+    const char* end = file.data + file.size;
+    const char* stop = file.data + chunk.end;
+    
+    while (p < stop){
+        
+        double values[COL_COUNT];
+        bool present[COL_COUNT] = {false, false, false, false, false, false};
+        
+        for (unsigned int f=0; p < end && *p != '\n'; f++){
+            double value;
+            bool valid = parse_number(p, end, value);
+            if (f < file.nb_fields && file.fields[f] >= 0 && valid){
+                values[file.fields[f]] = value;
+                present[file.fields[f]] = true;
+            }
+            if (p < end && *p == ',') p++;
+        }
+        if (p < end) p++; // '\n'
+        rows++;
+        
+        double speed = 0;
+        if (present[col_speed]) speed = values[col_speed];
+        else if (present[col_rpm]) speed = values[col_rpm]*(2*M_PI/60);
+        else continue;
+        
+        int slot = MOTORS;
+        if (present[col_motor] && values[col_motor] >= 0 && values[col_motor] < MOTORS) slot = (int)values[col_motor];
+        Fit_Sums& s = sums[slot];
+        const Fit* fit = (fits == NULL ? NULL : &fits[fits[slot].pwm_valid ? slot : MOTORS]);
+        const Fit* coefs = (fits == NULL ? NULL : &fits[fits[slot].thrust_valid ? slot : MOTORS]);
+        double square = speed*speed;
+        
+        if (present[col_pwm] && speed > MIN_SPEED){
+            double x = values[col_pwm] - SERVO_VAL_MIN;
+            if (fit != NULL && fit->pwm_valid
+                && fabs(speed - fit->slope*(values[col_pwm] - fit->pwm_zero)) > REJECT_SIGMAS*fit->pwm_sigma) s.rejected++;
+            else {
+                s.n_pwm++;
+                s.x += x; s.xx += x*x; s.y += speed; s.yy += speed*speed; s.xy += x*speed;
+            }
+        }
+        
+        if (present[col_thrust]){
+            double thrust = values[col_thrust];
+            if (coefs != NULL && coefs->thrust_valid
+                && fabs(thrust - coefs->thrust_coef*square) > REJECT_SIGMAS*coefs->thrust_sigma) s.rejected++;
+            else {
+                s.n_thrust++;
+                s.thrust_xx += square*square; s.thrust_xy += square*thrust; s.thrust_yy += thrust*thrust;
+            }
+        }
+        
+        if (present[col_torque]){
+            double torque = values[col_torque];
+            coefs = (fits == NULL ? NULL : &fits[fits[slot].torque_valid ? slot : MOTORS]);
+            if (coefs != NULL && coefs->torque_valid
+                && fabs(torque - coefs->drag_coef*square) > REJECT_SIGMAS*coefs->torque_sigma) s.rejected++;
+            else {
+                s.n_torque++;
+                s.torque_xx += square*square; s.torque_xy += square*torque; s.torque_yy += torque*torque;
+            }
+        }
+    }
+}
+
+
+static void identify_job(void* context, unsigned int index, unsigned int){
+    Identify_Context* identify = (Identify_Context*)context;
+    const Chunk& chunk = (*identify->chunks)[index];
+    accumulate((*identify->files)[chunk.file], chunk, &(*identify->sums)[index*SLOTS], identify->fits, (*identify->rows)[index]);
+}
+
+
+static Fit solve(const Fit_Sums& s){
+    
+    Fit fit;
+    memset(&fit, 0, sizeof(fit));
+    
+    if (s.n_pwm >= 3){
+        double n = (double)s.n_pwm;
+        double sxx = s.xx - s.x*s.x/n;
+        double sxy = s.xy - s.x*s.y/n;
+        double syy = s.yy - s.y*s.y/n;
+        if (sxx > 0 && sxy > 0){
+            fit.slope = sxy/sxx;
+            double intercept = (s.y - fit.slope*s.x)/n;
+            fit.pwm_zero = SERVO_VAL_MIN - intercept/fit.slope;
+            double sse = syy - fit.slope*sxy;
+            fit.pwm_sigma = sqrt((sse > 0 ? sse : 0)/(n-2));
+            fit.pwm_valid = true;
+        }
+    }
+    
+    if (s.n_thrust >= 2 && s.thrust_xx > 0){
+        fit.thrust_coef = s.thrust_xy/s.thrust_xx;
+        double sse = s.thrust_yy - fit.thrust_coef*s.thrust_xy;
+        fit.thrust_sigma = sqrt((sse > 0 ? sse : 0)/(s.n_thrust-1));
+        fit.thrust_valid = true;
+    }
+    
+    if (s.n_torque >= 2 && s.torque_xx > 0){
+        fit.drag_coef = s.torque_xy/s.torque_xx;
+        double sse = s.torque_yy - fit.drag_coef*s.torque_xy;
+        fit.torque_sigma = sqrt((sse > 0 ? sse : 0)/(s.n_torque-1));
+        fit.torque_valid = true;
+    }
+    
+    return fit;
+}
+
+
+/**
+ * Runs one pass over every chunk and solves each motor, then all of them together (last slot)
+ */
+static void run_pass(Work_Pool& pool, Identify_Context& context, Fit* fits, Fit_Sums* totals, uint64_t& rows){
+    
+    size_t count = context.chunks->size();
+    context.sums->assign(count*SLOTS, Fit_Sums());
+    memset(&(*context.sums)[0], 0, count*SLOTS*sizeof(Fit_Sums));
+    context.rows->assign(count, 0);
+    pool.run(count, &identify_job, &context);
+    
+    memset(totals, 0, (SLOTS+1)*sizeof(Fit_Sums));
+    rows = 0;
+    for (size_t c=0; c<count; c++){
+        for (int m=0; m<SLOTS; m++){
+            totals[m].add((*context.sums)[c*SLOTS+m]);
+        }
+        rows += (*context.rows)[c];
+    }
+    
+    // Pooled fit in the last slot, per-motor fits fall back to it
+    Fit_Sums pooled = totals[MOTORS];
+    for (int m=0; m<MOTORS; m++){
+        pooled.add(totals[m]);
+    }
+    totals[SLOTS] = pooled;
+    for (int m=0; m<MOTORS; m++){
+        fits[m] = solve(totals[m]);
+    }
+    fits[MOTORS] = solve(pooled);
+}
+
+
+static bool map_log(const char* path, Log_File& file){
+    
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0){
+        perror(path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    file.path = path;
+    file.size = st.st_size;
+    file.data = NULL;
+    if (file.size > 0){
+        void* ptr = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED){
+            perror("mmap");
+            close(fd);
+            return false;
+        }
+        madvise(ptr, file.size, MADV_SEQUENTIAL);
+        file.data = (const char*)ptr;
+    }
+    close(fd);
+    
+    // Header : names of the columns
+    const char* p = file.data;
+    const char* end = file.data + file.size;
+    file.nb_fields = 0;
+    bool speed = false;
+    while (p < end && *p != '\n' && file.nb_fields < MAX_FIELDS){
+        const char* name = p;
+        while (p < end && *p != ',' && *p != '\n') p++;
+        const char* name_end = p;
+        while (name < name_end && (*name == ' ' || *name == '\t' || *name == '"')) name++;
+        while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\r' || name_end[-1] == '"')) name_end--;
+        
+        int column = -1;
+        for (int c=0; c<COL_COUNT; c++){
+            if (strlen(COLUMN_NAMES[c]) == (size_t)(name_end-name) && strncasecmp(name, COLUMN_NAMES[c], name_end-name) == 0) column = c;
+        }
+        if (column == col_speed || column == col_rpm) speed = true;
+        file.fields[file.nb_fields++] = column;
+        if (p < end && *p == ',') p++;
+    }
+    while (p < end && *p != '\n') p++;
+    file.body = (p < end ? p+1 - file.data : file.size);
+    
+    if (!speed){
+        fprintf(stderr, "%s : no speed or rpm column in the header\n", path);
+        return false;
+    }
+    return true;
+}
+
+
+static double now_s(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+
+int main(int argc, const char * argv[]) {
+    
+    unsigned int workers = 0;
+    const char* output = "motor_params.conf";
+    std::vector<Log_File> files;
+    
+    for (int i=1; i<argc; i++){
+        if (strcmp(argv[i], "-j") == 0 && i+1 < argc) workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) output = argv[++i];
+        else {
+            Log_File file;
+            if (!map_log(argv[i], file)) return 1;
+            files.push_back(file);
+        }
+    }
+    
+    if (files.empty()){
+        fprintf(stderr, "Usage : %s [-j workers] [-o params_file] log...\n", argv[0]);
+        return 1;
+    }
+    
+    // Chunks on line boundaries
+    std::vector<Chunk> chunks;
+    uint64_t bytes = 0;
+    for (unsigned int f=0; f<files.size(); f++){
+        const Log_File& file = files[f];
+        bytes += file.size;
+        size_t begin = file.body;
+        while (begin < file.size){
+            size_t end = (file.size - begin > CHUNK_SIZE ? begin + CHUNK_SIZE : file.size);
+            const char* newline = (end < file.size ? (const char*)memchr(file.data+end, '\n', file.size-end) : NULL);
+            end = (newline != NULL ? newline+1 - file.data : file.size);
+            Chunk chunk = {f, begin, end};
+            chunks.push_back(chunk);
+            begin = end;
+        }
+    }
+    
+    Work_Pool pool(workers);
+    std::vector<Fit_Sums> sums;
+    std::vector<uint64_t> rows_per_chunk;
+    Identify_Context context = {&files, &chunks, &sums, NULL, &rows_per_chunk};
+    Fit first[SLOTS];
+    Fit fits[SLOTS];
+    Fit_Sums totals[SLOTS+1];
+    uint64_t rows = 0;
+    
+    double start = now_s();
+    run_pass(pool, context, first, totals, rows);
+    context.fits = first;
+    run_pass(pool, context, fits, totals, rows);
+    double elapsed = now_s() - start;
+    
+    printf("%zu logs, %.1f MB, %llu rows in %zu chunks : %.2f s with %u workers (%.0f MB/s over two passes)\n",
+           files.size(), bytes/1e6, (unsigned long long)rows, chunks.size(), elapsed, pool.getWorkers(), 2*bytes/1e6/elapsed);
+    printf("\n%-7s %10s %10s %10s %8s %12s %10s %12s %10s %9s\n", "motor", "pwm rows", "pwm zero", "rd/s/us", "sigma",
+           "thrust_coef", "sigma N", "drag_coef", "sigma N.m", "rejected");
+    for (int m=0; m<=MOTORS; m++){
+        const Fit& fit = fits[m];
+        const Fit_Sums& s = (m < MOTORS ? totals[m] : totals[SLOTS]);
+        if (s.n_pwm + s.n_thrust + s.n_torque == 0) continue;
+        char name[16];
+        if (m < MOTORS) snprintf(name, sizeof(name), "%d", m);
+        else snprintf(name, sizeof(name), "all");
+        printf("%-7s %10llu %10.1f %10.4f %8.2f %12.4g %10.4f %12.4g %10.5f %9llu\n", name, (unsigned long long)s.n_pwm,
+               fit.pwm_zero, fit.slope, fit.pwm_sigma, fit.thrust_coef, fit.thrust_sigma, fit.drag_coef, fit.torque_sigma,
+               (unsigned long long)s.rejected);
+    }
+    
+    // Shared mapping from the pooled fit, each motor as an offset and a slope ratio to it
+    Motor_Params params = Motor_Params::fromConfig();
+    const Fit& pooled = fits[MOTORS];
+    if (pooled.pwm_valid){
+        params.servo_val_min = pooled.pwm_zero;
+        params.servo_max_real = pooled.slope*(params.servo_val_max - pooled.pwm_zero);
+        for (int m=0; m<MOTORS; m++){
+            if (!fits[m].pwm_valid) continue;
+            params.pwm_offset[m] = fits[m].pwm_zero - pooled.pwm_zero;
+            params.pwm_scale[m] = pooled.slope/fits[m].slope;
+        }
+    }
+    if (pooled.thrust_valid) params.thrust_coef = pooled.thrust_coef;
+    if (pooled.torque_valid) params.drag_coef = pooled.drag_coef;
+    
+    printf("\n%-15s %12s %12s\n", "", "Config.hpp", "fitted");
+    printf("%-15s %12.4g %12.4g\n", "thrust_coef", thrust_factor, params.thrust_coef);
+    printf("%-15s %12.4g %12.4g\n", "drag_coef", drag_factor, params.drag_coef);
+    printf("%-15s %12.1f %12.1f\n", "servo_val_min", SERVO_VAL_MIN, params.servo_val_min);
+    printf("%-15s %12.1f %12.1f\n", "servo_max_real", SERVO_MAX_REAL, params.servo_max_real);
+    
+    char comment[128];
+    snprintf(comment, sizeof(comment), "motor_identify : %llu rows from %zu logs", (unsigned long long)rows, files.size());
+    if (!params.save(output, comment)){
+        perror(output);
+        return 1;
+    }
+    printf("\nwritten to %s\n", output);
+    
+    for (unsigned int f=0; f<files.size(); f++){
+        if (files[f].data != NULL) munmap((void*)files[f].data, files[f].size);
+    }
+    return 0;
+}